@@ -0,0 +1,230 @@
+#include "aabbtree.hpp"
+
+Frustum Frustum::FromMatrix(const glm::mat4 & m){
+	// Rows of the matrix; a point is inside when -w <= x, y, z <= w in clip space
+	glm::vec4 x(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 y(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 z(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = w + x;
+	frustum.planes[1] = w - x;
+	frustum.planes[2] = w + y;
+	frustum.planes[3] = w - y;
+	frustum.planes[4] = w + z;
+	frustum.planes[5] = w - z;
+	return frustum;
+}
+
+AABBTree::AABBTree(float margin):
+	margin_(margin),
+	root_(Null),
+	free_list_(Null),
+	proxy_count_(0) {}
+
+int AABBTree::AllocateNode(){
+	if (free_list_ == Null){
+		nodes_.emplace_back();
+		free_list_ = int(nodes_.size()) - 1;
+		nodes_[free_list_].next = Null;
+	}
+	int node = free_list_;
+	free_list_ = nodes_[node].next;
+
+	Node & n = nodes_[node];
+	n.user_data = NULL;
+	n.parent = Null;
+	n.child1 = Null;
+	n.child2 = Null;
+	n.height = 0;
+	return node;
+}
+
+void AABBTree::FreeNode(int node){
+	nodes_[node].next = free_list_;
+	nodes_[node].height = -1;
+	free_list_ = node;
+}
+
+void AABBTree::Clear(){
+	nodes_.clear();
+	root_ = Null;
+	free_list_ = Null;
+	proxy_count_ = 0;
+}
+
+int AABBTree::CreateProxy(const AABB & box, void * user_data){
+	int proxy = AllocateNode();
+	nodes_[proxy].box.lower = box.lower - glm::vec3(margin_);
+	nodes_[proxy].box.upper = box.upper + glm::vec3(margin_);
+	nodes_[proxy].user_data = user_data;
+	InsertLeaf(proxy);
+	proxy_count_++;
+	return proxy;
+}
+
+void AABBTree::DestroyProxy(int proxy){
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	proxy_count_--;
+}
+
+bool AABBTree::MoveProxy(int proxy, const AABB & box, const glm::vec3 & displacement){
+	if (nodes_[proxy].box.Contains(box))
+		return false;
+
+	RemoveLeaf(proxy);
+
+	// Stretch the box along the movement so it lasts a few updates
+	AABB fat = { box.lower - glm::vec3(margin_), box.upper + glm::vec3(margin_) };
+	fat.lower += glm::min(displacement, glm::vec3(0.0f)) * 2.0f;
+	fat.upper += glm::max(displacement, glm::vec3(0.0f)) * 2.0f;
+	nodes_[proxy].box = fat;
+
+	InsertLeaf(proxy);
+	return true;
+}
+
+void AABBTree::InsertLeaf(int leaf){
+	if (root_ == Null){
+		root_ = leaf;
+		nodes_[root_].parent = Null;
+		return;
+	}
+
+	// Walk down to the sibling that makes the tree's total surface area grow the least
+	AABB leaf_box = nodes_[leaf].box;
+	int index = root_;
+	while (!nodes_[index].IsLeaf()){
+		const Node & node = nodes_[index];
+		float area = node.box.SurfaceArea();
+		float combined_area = AABB::Union(node.box, leaf_box).SurfaceArea();
+
+		// Pairing with this node creates a parent over both
+		float cost = 2.0f * combined_area;
+		// Going further down enlarges this node anyway
+		float inheritance_cost = 2.0f * (combined_area - area);
+
+		float child_costs[2];
+		int children[2] = { node.child1, node.child2 };
+		for (int i = 0; i < 2; i++){
+			const Node & child = nodes_[children[i]];
+			float enlarged = AABB::Union(child.box, leaf_box).SurfaceArea();
+			if (child.IsLeaf())
+				child_costs[i] = enlarged + inheritance_cost;
+			else
+				child_costs[i] = enlarged - child.box.SurfaceArea() + inheritance_cost;
+		}
+
+		if (cost < child_costs[0] && cost < child_costs[1])
+			break;
+		index = child_costs[0] < child_costs[1] ? node.child1 : node.child2;
+	}
+
+	int sibling = index;
+	int old_parent = nodes_[sibling].parent;
+	int new_parent = AllocateNode();
+	nodes_[new_parent].parent = old_parent;
+	nodes_[new_parent].box = AABB::Union(leaf_box, nodes_[sibling].box);
+	nodes_[new_parent].height = nodes_[sibling].height + 1;
+	nodes_[new_parent].child1 = sibling;
+	nodes_[new_parent].child2 = leaf;
+	nodes_[sibling].parent = new_parent;
+	nodes_[leaf].parent = new_parent;
+
+	if (old_parent == Null)
+		root_ = new_parent;
+	else if (nodes_[old_parent].child1 == sibling)
+		nodes_[old_parent].child1 = new_parent;
+	else
+		nodes_[old_parent].child2 = new_parent;
+
+	// Refit the ancestors, rotating where one side got too deep
+	for (index = nodes_[leaf].parent; index != Null; index = nodes_[index].parent){
+		index = Balance(index);
+		Node & node = nodes_[index];
+		node.height = 1 + glm::max(nodes_[node.child1].height, nodes_[node.child2].height);
+		node.box = AABB::Union(nodes_[node.child1].box, nodes_[node.child2].box);
+	}
+}
+
+void AABBTree::RemoveLeaf(int leaf){
+	if (leaf == root_){
+		root_ = Null;
+		return;
+	}
+
+	int parent = nodes_[leaf].parent;
+	int grand_parent = nodes_[parent].parent;
+	int sibling = nodes_[parent].child1 == leaf ? nodes_[parent].child2 : nodes_[parent].child1;
+
+	// The sibling takes the parent's place
+	FreeNode(parent);
+	nodes_[sibling].parent = grand_parent;
+	if (grand_parent == Null){
+		root_ = sibling;
+		return;
+	}
+	if (nodes_[grand_parent].child1 == parent)
+		nodes_[grand_parent].child1 = sibling;
+	else
+		nodes_[grand_parent].child2 = sibling;
+
+	for (int index = grand_parent; index != Null; index = nodes_[index].parent){
+		index = Balance(index);
+		Node & node = nodes_[index];
+		node.height = 1 + glm::max(nodes_[node.child1].height, nodes_[node.child2].height);
+		node.box = AABB::Union(nodes_[node.child1].box, nodes_[node.child2].box);
+	}
+}
+
+// If one child of a is more than one level deeper than the other, the deeper
+// child is rotated up into a's place. Returns the root of the subtree.
+int AABBTree::Balance(int a_index){
+	Node & a = nodes_[a_index];
+	if (a.IsLeaf() || a.height < 2)
+		return a_index;
+
+	int b_index = a.child1;
+	int c_index = a.child2;
+	int balance = nodes_[c_index].height - nodes_[b_index].height;
+	if (balance >= -1 && balance <= 1)
+		return a_index;
+
+	// up is the deeper child, which takes a's place; a keeps the other child
+	int up_index = balance > 1 ? c_index : b_index;
+	Node & up = nodes_[up_index];
+	int f_index = up.child1;
+	int g_index = up.child2;
+	Node & f = nodes_[f_index];
+	Node & g = nodes_[g_index];
+
+	up.child1 = a_index;
+	up.parent = a.parent;
+	a.parent = up_index;
+
+	if (up.parent == Null)
+		root_ = up_index;
+	else if (nodes_[up.parent].child1 == a_index)
+		nodes_[up.parent].child1 = up_index;
+	else
+		nodes_[up.parent].child2 = up_index;
+
+	// The deeper grandchild stays under up, the shallower one moves to a
+	int stays = f.height > g.height ? f_index : g_index;
+	int moves = f.height > g.height ? g_index : f_index;
+	up.child2 = stays;
+	if (balance > 1)
+		a.child2 = moves;
+	else
+		a.child1 = moves;
+	nodes_[moves].parent = a_index;
+
+	a.box = AABB::Union(nodes_[a.child1].box, nodes_[a.child2].box);
+	a.height = 1 + glm::max(nodes_[a.child1].height, nodes_[a.child2].height);
+	up.box = AABB::Union(a.box, nodes_[stays].box);
+	up.height = 1 + glm::max(a.height, nodes_[stays].height);
+
+	return up_index;
+}
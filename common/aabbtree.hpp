@@ -0,0 +1,261 @@
+#ifndef AABBTREE_HPP
+#define AABBTREE_HPP
+
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct AABB {
+	glm::vec3 lower;
+	glm::vec3 upper;
+
+	float SurfaceArea() const {
+		glm::vec3 d = upper - lower;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	bool Contains(const AABB & other) const {
+		return glm::all(glm::lessThanEqual(lower, other.lower)) && glm::all(glm::lessThanEqual(other.upper, upper));
+	}
+
+	bool Overlaps(const AABB & other) const {
+		return glm::all(glm::lessThanEqual(lower, other.upper)) && glm::all(glm::lessThanEqual(other.lower, upper));
+	}
+
+	static AABB Union(const AABB & a, const AABB & b){
+		AABB box = { glm::min(a.lower, b.lower), glm::max(a.upper, b.upper) };
+		return box;
+	}
+
+	static AABB Sphere(const glm::vec3 & center, float radius){
+		AABB box = { center - glm::vec3(radius), center + glm::vec3(radius) };
+		return box;
+	}
+};
+
+// Six planes (a, b, c, d) with a*x + b*y + c*z + d >= 0 inside, normals not normalized
+struct Frustum {
+	glm::vec4 planes[6];
+
+	// Extracts the planes of a view-projection matrix, in world space
+	static Frustum FromMatrix(const glm::mat4 & view_projection);
+
+	// -1 if the box is entirely outside, 1 if entirely inside, 0 if it crosses a plane
+	int Classify(const AABB & box) const {
+		glm::vec3 center = (box.lower + box.upper) * 0.5f;
+		glm::vec3 extent = (box.upper - box.lower) * 0.5f;
+		int result = 1;
+		for (int i = 0; i < 6; i++){
+			glm::vec3 normal(planes[i]);
+			// Signed distance of the center and projected half-size of the box, both scaled by |normal|
+			float distance = glm::dot(normal, center) + planes[i].w;
+			float reach = glm::dot(glm::abs(normal), extent);
+			if (distance + reach < 0.0f)
+				return -1;
+			if (distance - reach < 0.0f)
+				result = 0;
+		}
+		return result;
+	}
+};
+
+// Dynamic bounding volume tree. Leaves store "fat" boxes, enlarged by a margin
+// and by the predicted displacement, so an object only has to be reinserted
+// when it leaves its fat box. Insertion walks down the branch with the least
+// surface area increase, and rotations keep the tree height balanced, so
+// queries stay logarithmic while objects come and go. Nodes live in one array
+// and are recycled through a free list.
+class AABBTree {
+public:
+	static const int Null = -1;
+
+	explicit AABBTree(float margin = 1.0f);
+
+	// Returns the proxy id that identifies the object in the tree
+	int CreateProxy(const AABB & box, void * user_data);
+	void DestroyProxy(int proxy);
+
+	// Reinserts the proxy if box left its fat box; displacement is the expected
+	// movement until the next update. Returns whether it was reinserted
+	bool MoveProxy(int proxy, const AABB & box, const glm::vec3 & displacement);
+
+	void Clear();
+
+	void * GetUserData(int proxy) const {
+		return nodes_[proxy].user_data;
+	}
+
+	const AABB & GetFatAABB(int proxy) const {
+		return nodes_[proxy].box;
+	}
+
+	int ProxyCount() const {
+		return proxy_count_;
+	}
+
+	int Height() const {
+		return root_ == Null ? 0 : nodes_[root_].height;
+	}
+
+	// Calls callback(proxy) for every fat box overlapping box; returning false stops the query
+	template <typename Callback>
+	void QueryAABB(const AABB & box, Callback callback) const {
+		Traverse([&](const AABB & node){ return node.Overlaps(box); }, callback);
+	}
+
+	// Calls callback(proxy) for every fat box touching the sphere
+	template <typename Callback>
+	void QuerySphere(const glm::vec3 & center, float radius, Callback callback) const {
+		float radius2 = radius * radius;
+		Traverse([&](const AABB & node){
+			glm::vec3 d = center - glm::clamp(center, node.lower, node.upper);
+			return glm::dot(d, d) <= radius2;
+		}, callback);
+	}
+
+	// Calls callback(proxy) for every fat box not entirely outside the frustum.
+	// Subtrees entirely inside are reported without testing their nodes.
+	template <typename Callback>
+	void QueryFrustum(const Frustum & frustum, Callback callback) const;
+
+	// Calls callback(proxy, max_distance) for every fat box the ray hits within
+	// max_distance, nearest boxes first where the tree allows it. The callback
+	// returns the new max_distance: the hit distance to clip the ray, the
+	// unchanged value to continue, or 0 to stop. direction must be normalized.
+	template <typename Callback>
+	void RayCast(const glm::vec3 & origin, const glm::vec3 & direction, float max_distance, Callback callback) const;
+
+private:
+	// Deep enough for any tree the rotations keep balanced
+	static const int StackSize = 128;
+
+	struct Node {
+		AABB box;
+		void * user_data;
+		union {
+			int parent;
+			int next; // free list
+		};
+		int child1;
+		int child2;
+		int height; // leaves are 0, free nodes -1
+
+		bool IsLeaf() const {
+			return child1 == Null;
+		}
+	};
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int node);
+
+	template <typename Test, typename Callback>
+	void Traverse(Test test, Callback callback) const {
+		if (root_ == Null)
+			return;
+		int stack[StackSize];
+		int count = 0;
+		stack[count++] = root_;
+		while (count > 0){
+			const Node & node = nodes_[stack[--count]];
+			if (!test(node.box))
+				continue;
+			if (node.IsLeaf()){
+				if (!callback(int(&node - &nodes_[0])))
+					return;
+			}else{
+				stack[count++] = node.child1;
+				stack[count++] = node.child2;
+			}
+		}
+	}
+
+	float margin_;
+	std::vector<Node> nodes_;
+	int root_;
+	int free_list_;
+	int proxy_count_;
+};
+
+template <typename Callback>
+void AABBTree::QueryFrustum(const Frustum & frustum, Callback callback) const {
+	if (root_ == Null)
+		return;
+
+	// The low bit of a stack entry marks subtrees known to be inside
+	int stack[StackSize];
+	int count = 0;
+	stack[count++] = root_ << 1;
+	while (count > 0){
+		int entry = stack[--count];
+		const Node & node = nodes_[entry >> 1];
+		int inside = entry & 1;
+		if (!inside){
+			int side = frustum.Classify(node.box);
+			if (side < 0)
+				continue;
+			inside = side;
+		}
+
+		if (node.IsLeaf()){
+			if (!callback(entry >> 1))
+				return;
+		}else{
+			stack[count++] = (node.child1 << 1) | inside;
+			stack[count++] = (node.child2 << 1) | inside;
+		}
+	}
+}
+
+template <typename Callback>
+void AABBTree::RayCast(const glm::vec3 & origin, const glm::vec3 & direction, float max_distance, Callback callback) const {
+	if (root_ == Null)
+		return;
+
+	glm::vec3 inverse = 1.0f / direction;
+
+	// Slab test; returns the entry distance or a negative value on a miss
+	auto enter = [&](const AABB & box){
+		glm::vec3 t0 = (box.lower - origin) * inverse;
+		glm::vec3 t1 = (box.upper - origin) * inverse;
+		glm::vec3 t_near = glm::min(t0, t1);
+		glm::vec3 t_far = glm::max(t0, t1);
+		float t_enter = glm::max(glm::max(t_near.x, t_near.y), glm::max(t_near.z, 0.0f));
+		float t_exit = glm::min(glm::min(t_far.x, t_far.y), glm::min(t_far.z, max_distance));
+		return t_enter <= t_exit ? t_enter : -1.0f;
+	};
+
+	int stack[StackSize];
+	int count = 0;
+	stack[count++] = root_;
+	while (count > 0){
+		const Node & node = nodes_[stack[--count]];
+		if (enter(node.box) < 0.0f)
+			continue;
+
+		if (node.IsLeaf()){
+			max_distance = callback(int(&node - &nodes_[0]), max_distance);
+			if (max_distance <= 0.0f)
+				return;
+			continue;
+		}
+
+		// Visit the nearer child first so hits clip the ray early
+		float t1 = enter(nodes_[node.child1].box);
+		float t2 = enter(nodes_[node.child2].box);
+		int first = node.child1, second = node.child2;
+		if (t2 >= 0.0f && (t1 < 0.0f || t2 < t1)){
+			std::swap(first, second);
+			std::swap(t1, t2);
+		}
+		if (t2 >= 0.0f)
+			stack[count++] = second;
+		if (t1 >= 0.0f)
+			stack[count++] = first;
+	}
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef ASSETID_HPP
+#define ASSETID_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Stable identifier of an asset: the 32-bit FNV-1a hash of its name
+typedef uint32_t AssetId;
+
+inline AssetId assetId(const char * name){
+	uint32_t hash = 2166136261u;
+	for (const unsigned char * c = (const unsigned char *)name; *c; c++){
+		hash ^= *c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// 32-bit FNV-1a of a block of memory, for checksums that only need to be stable
+inline uint32_t hashBytes(const void * data, size_t size){
+	uint32_t hash = 2166136261u;
+	for (const unsigned char * c = (const unsigned char *)data; c < (const unsigned char *)data + size; c++){
+		hash ^= *c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+#endif
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "assetloader.hpp"
+#include "memorytracker.hpp"
+#include "profiler.hpp"
+
+AssetLoader::AssetLoader(unsigned int worker_count):
+	worker_count_(worker_count),
+	wall_ms_(0.0)
+{
+	if (worker_count_ == 0)
+		worker_count_ = std::max(1u, std::thread::hardware_concurrency());
+}
+
+AssetLoader::TaskId AssetLoader::Add(const std::string & name, Step work, Step finish,
+                                     const std::vector<TaskId> & dependencies){
+	TaskId id = tasks_.size();
+	Task task;
+	task.name = name;
+	task.work = std::move(work);
+	task.finish = std::move(finish);
+	task.pending_dependencies = 0;
+	task.failed = false;
+	task.ready_ms = 0.0;
+	task.wait_ms = 0.0;
+	task.work_ms = 0.0;
+	task.finish_ms = 0.0;
+	tasks_.push_back(std::move(task));
+
+	// Only earlier tasks, so the graph cannot have cycles
+	for (TaskId dependency : dependencies){
+		if (dependency < id){
+			tasks_[dependency].dependents.push_back(id);
+			tasks_[id].pending_dependencies++;
+		} else {
+			printf("%s depends on a task added after it, ignoring the dependency\n", name.c_str());
+		}
+	}
+	return id;
+}
+
+bool AssetLoader::Run(const ProgressCallback & progress){
+	MemoryScope scope(MEMORY_ASSETS, "asset loader");
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	auto since_start = [start](){
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+	std::deque<TaskId> ready;    // waiting for a worker
+	std::deque<TaskId> worked;   // waiting for the finish step
+	bool stopping = false;
+
+	// Tasks without work go straight to the finish step
+	auto schedule = [&](TaskId id){
+		Task & task = tasks_[id];
+		task.ready_ms = since_start();
+		if (task.work)
+			ready.push_back(id);
+		else
+			worked.push_back(id);
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < worker_count_; i++){
+		workers.emplace_back([&](){
+			MemoryScope worker_scope(MEMORY_ASSETS, "asset loader");
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true){
+				work_ready.wait(lock, [&]{ return stopping || !ready.empty(); });
+				if (stopping)
+					return;
+				TaskId id = ready.front();
+				ready.pop_front();
+
+				// Only this worker touches the task until it is handed back
+				Task & task = tasks_[id];
+				lock.unlock();
+				double started = since_start();
+				task.wait_ms = started - task.ready_ms;
+				task.failed = !task.work();
+				task.work_ms = since_start() - started;
+				lock.lock();
+
+				worked.push_back(id);
+				work_done.notify_one();
+			}
+		});
+	}
+
+	size_t done = 0;
+	bool ok = true;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (TaskId id = 0; id < tasks_.size(); id++){
+			if (tasks_[id].pending_dependencies == 0)
+				schedule(id);
+		}
+		work_ready.notify_all();
+
+		while (done < tasks_.size()){
+			work_done.wait(lock, [&]{ return !worked.empty(); });
+			TaskId id = worked.front();
+			worked.pop_front();
+			Task & task = tasks_[id];
+
+			// GL calls belong on this thread, which holds the context
+			lock.unlock();
+			if (!task.failed && task.finish){
+				double started = since_start();
+				task.failed = !task.finish();
+				task.finish_ms = since_start() - started;
+			}
+			if (task.failed){
+				printf("Could not load %s\n", task.name.c_str());
+				ok = false;
+			}
+			done++;
+			if (progress)
+				progress(done, tasks_.size(), task.name);
+			lock.lock();
+
+			for (TaskId dependent : task.dependents){
+				if (task.failed)
+					tasks_[dependent].failed = true;
+				if (--tasks_[dependent].pending_dependencies > 0)
+					continue;
+				// A task whose dependency failed is not run, only reported
+				if (tasks_[dependent].failed)
+					worked.push_back(dependent);
+				else
+					schedule(dependent);
+			}
+			work_ready.notify_all();
+		}
+
+		stopping = true;
+		work_ready.notify_all();
+	}
+	for (std::thread & worker : workers)
+		worker.join();
+
+	wall_ms_ = since_start();
+	Profiler::Instance().Record("startup.load_ms", wall_ms_);
+	return ok;
+}
+
+void AssetLoader::Report(FILE * out) const {
+	double total_work_ms = 0.0;
+	double total_finish_ms = 0.0;
+	fprintf(out, "%-40s %10s %10s %10s\n", "asset", "wait ms", "work ms", "gl ms");
+	for (const Task & task : tasks_){
+		fprintf(out, "%-40s %10.3f %10.3f %10.3f%s\n", task.name.c_str(), task.wait_ms, task.work_ms,
+		        task.finish_ms, task.failed ? "  FAILED" : "");
+		total_work_ms += task.work_ms;
+		total_finish_ms += task.finish_ms;
+	}
+	fprintf(out, "Loaded %zu assets in %.3f ms on %u workers: %.3f ms of work, %.3f ms on the GL thread\n",
+	        tasks_.size(), wall_ms_, worker_count_, total_work_ms, total_finish_ms);
+}
@@ -0,0 +1,63 @@
+#ifndef ASSETLOADER_HPP
+#define ASSETLOADER_HPP
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Loads the startup assets as a graph of tasks. Each task has CPU work
+// (reading, decoding, cooking) that runs on a pool of worker threads, and
+// an optional finish step that runs on the thread calling Run(), which must
+// own the GL context, so GL objects are created there in one batch. A task
+// starts once every task it depends on has finished both steps.
+class AssetLoader {
+public:
+	typedef size_t TaskId;
+
+	// Either step returns false when the asset could not be loaded
+	typedef std::function<bool()> Step;
+
+	// Called on the thread running Run() after every finished task
+	typedef std::function<void(size_t done, size_t total, const std::string & name)> ProgressCallback;
+
+	// 0 workers means one per hardware thread
+	explicit AssetLoader(unsigned int worker_count = 0);
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// work or finish may be empty. Dependencies must have been added before.
+	TaskId Add(const std::string & name, Step work, Step finish = Step(),
+	           const std::vector<TaskId> & dependencies = std::vector<TaskId>());
+
+	// Runs every task and returns once all are done. False if any failed;
+	// tasks depending on a failed one are skipped and count as failed too.
+	bool Run(const ProgressCallback & progress = ProgressCallback());
+
+	// Per task: time spent waiting for a worker, in work and in finish, then
+	// the wall time against the sum of the work
+	void Report(FILE * out = stdout) const;
+
+private:
+	struct Task {
+		std::string name;
+		Step work;
+		Step finish;
+		std::vector<TaskId> dependents;
+		size_t pending_dependencies;
+		bool failed;
+		double ready_ms;   // since Run() started
+		double wait_ms;
+		double work_ms;
+		double finish_ms;
+	};
+
+	unsigned int worker_count_;
+	std::vector<Task> tasks_;
+	double wall_ms_;
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "assetpack.hpp"
+#include "memorytracker.hpp"
+#include "snapshot.hpp"
+
+static_assert(sizeof(PackHeader) == 32, "PackHeader layout changed");
+static_assert(sizeof(PackEntry) == 32, "PackEntry layout changed");
+
+static const char PackMagic[4] = { 'S', 'H', 'P', 'K' };
+static const uint32_t PackByteOrder = 0x01020304u;
+
+static uint64_t alignedOffset(uint64_t offset){
+	return (offset + ASSET_PACK_ALIGNMENT - 1) & ~(uint64_t)(ASSET_PACK_ALIGNMENT - 1);
+}
+
+static uint32_t checksum(const unsigned char * data, size_t size){
+	// crc32 takes the length as a uInt, so very large payloads go in pieces
+	uLong crc = crc32(0L, Z_NULL, 0);
+	while (size > 0){
+		uInt piece = (uInt)std::min<size_t>(size, 1u << 30);
+		crc = crc32(crc, data, piece);
+		data += piece;
+		size -= piece;
+	}
+	return (uint32_t)crc;
+}
+
+std::string normalizeAssetName(const char * name){
+	std::string normalized(name);
+	std::replace(normalized.begin(), normalized.end(), '\\', '/');
+	while (normalized.compare(0, 2, "./") == 0)
+		normalized.erase(0, 2);
+	return normalized;
+}
+
+bool writeAssetPack(const char * path, std::vector<PackInput> & inputs){
+
+	for (PackInput & input : inputs)
+		input.name = normalizeAssetName(input.name.c_str());
+	std::sort(inputs.begin(), inputs.end(), [](const PackInput & a, const PackInput & b){
+		return assetId(a.name.c_str()) < assetId(b.name.c_str());
+	});
+	for (size_t i = 1; i < inputs.size(); i++){
+		if (assetId(inputs[i - 1].name.c_str()) == assetId(inputs[i].name.c_str())){
+			printf("%s and %s have the same asset id, rename one of them\n",
+			       inputs[i - 1].name.c_str(), inputs[i].name.c_str());
+			return false;
+		}
+	}
+
+	std::vector<PackEntry> entries(inputs.size());
+	std::string names;
+	uint64_t offset = alignedOffset(sizeof(PackHeader));
+	for (size_t i = 0; i < inputs.size(); i++){
+		PackEntry & entry = entries[i];
+		entry.id = assetId(inputs[i].name.c_str());
+		entry.checksum = checksum(inputs[i].data.data(), inputs[i].data.size());
+		entry.offset = offset;
+		entry.size = inputs[i].data.size();
+		entry.name_offset = names.size();
+		entry.name_length = inputs[i].name.size();
+		names += inputs[i].name;
+		offset = alignedOffset(offset + entry.size);
+	}
+
+	PackHeader header;
+	memcpy(header.magic, PackMagic, 4);
+	header.version = ASSET_PACK_VERSION;
+	header.byte_order = PackByteOrder;
+	header.entry_count = entries.size();
+	header.index_offset = offset;
+	header.names_offset = offset + entries.size() * sizeof(PackEntry);
+
+	std::vector<unsigned char> out(header.names_offset + names.size(), 0);
+	memcpy(&out[0], &header, sizeof(header));
+	for (size_t i = 0; i < inputs.size(); i++){
+		if (!inputs[i].data.empty())
+			memcpy(&out[entries[i].offset], inputs[i].data.data(), inputs[i].data.size());
+	}
+	if (!entries.empty())
+		memcpy(&out[header.index_offset], entries.data(), entries.size() * sizeof(PackEntry));
+	if (!names.empty())
+		memcpy(&out[header.names_offset], names.data(), names.size());
+
+	return writeFileAtomically(path, out.data(), out.size());
+}
+
+AssetData::AssetData():
+	data_(NULL),
+	size_(0) {}
+
+void AssetData::Close(){
+	loose_.reset();
+	data_ = NULL;
+	size_ = 0;
+}
+
+AssetVfs & AssetVfs::Instance(){
+	static AssetVfs vfs;
+	return vfs;
+}
+
+AssetVfs::AssetVfs():
+	entries_(NULL),
+	entry_count_(0),
+	names_(NULL) {}
+
+bool AssetVfs::Mount(const char * pack_path){
+	MemoryScope scope(MEMORY_ASSETS, "asset pack");
+
+	// Entries are looked up at random, so no sequential read-ahead
+	if (!pack_.Open(pack_path, false))
+		return false;
+
+	const unsigned char * data = pack_.Data();
+	size_t size = pack_.Size();
+	PackHeader header;
+	if (size < sizeof(header)){
+		printf("%s is not an asset pack\n", pack_path);
+		pack_.Close();
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, PackMagic, 4) != 0 || header.version != ASSET_PACK_VERSION ||
+	    header.byte_order != PackByteOrder){
+		printf("%s is not an asset pack for this version and machine\n", pack_path);
+		pack_.Close();
+		return false;
+	}
+
+	// Everything the lookups will touch has to be inside the file
+	bool valid = header.index_offset % alignof(PackEntry) == 0 &&
+	             header.index_offset <= size &&
+	             header.entry_count <= (size - header.index_offset) / sizeof(PackEntry) &&
+	             header.names_offset == header.index_offset + header.entry_count * sizeof(PackEntry);
+	const PackEntry * entries = (const PackEntry *)(data + header.index_offset);
+	for (uint32_t i = 0; valid && i < header.entry_count; i++){
+		const PackEntry & entry = entries[i];
+		valid = entry.offset <= header.index_offset && entry.size <= header.index_offset - entry.offset &&
+		        (uint64_t)entry.name_offset + entry.name_length <= size - header.names_offset &&
+		        (i == 0 || entries[i - 1].id < entry.id);
+	}
+	if (!valid){
+		printf("%s is damaged\n", pack_path);
+		pack_.Close();
+		return false;
+	}
+
+	entries_ = entries;
+	entry_count_ = header.entry_count;
+	names_ = (const char *)data + header.names_offset;
+	verified_.reset(new std::atomic<bool>[entry_count_]);
+	for (uint32_t i = 0; i < entry_count_; i++)
+		verified_[i] = false;
+	printf("Mounted %s, %u assets\n", pack_path, entry_count_);
+	return true;
+}
+
+const PackEntry * AssetVfs::Find(const std::string & name) const {
+	if (entries_ == NULL)
+		return NULL;
+
+	AssetId id = assetId(name.c_str());
+	const PackEntry * end = entries_ + entry_count_;
+	const PackEntry * found = std::lower_bound(entries_, end, id, [](const PackEntry & entry, AssetId id){
+		return entry.id < id;
+	});
+	// A name that only shares the hash of a packed one is not in the pack
+	if (found == end || found->id != id || found->name_length != name.size() ||
+	    memcmp(names_ + found->name_offset, name.data(), name.size()) != 0)
+		return NULL;
+	return found;
+}
+
+bool AssetVfs::IsPacked(const char * name) const {
+	return Find(normalizeAssetName(name)) != NULL;
+}
+
+bool AssetVfs::Open(const char * name, AssetData & out){
+	out.Close();
+
+	std::string normalized = normalizeAssetName(name);
+	const PackEntry * entry = Find(normalized);
+	if (entry != NULL){
+		const unsigned char * data = pack_.Data() + entry->offset;
+		std::atomic<bool> & verified = verified_[entry - entries_];
+		if (!verified.load(std::memory_order_acquire)){
+			if (checksum(data, entry->size) != entry->checksum){
+				printf("%s is damaged in the asset pack\n", normalized.c_str());
+				return false;
+			}
+			verified.store(true, std::memory_order_release);
+		}
+		out.data_ = data;
+		out.size_ = entry->size;
+		return true;
+	}
+
+	std::unique_ptr<MappedFile> loose(new MappedFile());
+	if (!loose->Open(normalized.c_str()))
+		return false;
+	out.data_ = loose->Data();
+	out.size_ = loose->Size();
+	out.loose_ = std::move(loose);
+	return true;
+}
@@ -0,0 +1,117 @@
+#ifndef ASSETPACK_HPP
+#define ASSETPACK_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "assetid.hpp"
+#include "mappedfile.hpp"
+
+#define ASSET_PACK_VERSION 1
+
+// Payloads start at multiples of this, so loaders can read arrays in place
+#define ASSET_PACK_ALIGNMENT 64
+
+// A pack is a header, the payloads and an index sorted by the AssetId of the
+// names, followed by the names themselves. Every entry carries the CRC-32 of
+// its payload. Packs are built for the machine that runs them, in host byte
+// order; the byte order mark makes other hosts reject them.
+struct PackHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t entry_count;
+	uint64_t index_offset;  // entry_count PackEntry
+	uint64_t names_offset;  // names, not terminated
+};
+
+struct PackEntry {
+	AssetId id;
+	uint32_t checksum;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t name_offset;   // from names_offset
+	uint32_t name_length;
+};
+
+// One file for writeAssetPack: the name loaders will ask for and its contents
+struct PackInput {
+	std::string name;
+	std::vector<unsigned char> data;
+};
+
+// Names are stored the way normalizeAssetName leaves them. Fails, naming
+// both, if two names hash to the same AssetId.
+bool writeAssetPack(const char * path, std::vector<PackInput> & inputs);
+
+// Forward slashes and no leading "./", so every spelling finds the same entry
+std::string normalizeAssetName(const char * name);
+
+// The bytes of one asset. They point into the mounted pack, or into a loose
+// file this object keeps open; either way nothing is copied.
+class AssetData {
+public:
+	AssetData();
+
+	AssetData(AssetData&&) = default;
+	AssetData& operator=(AssetData&&) = default;
+
+	const unsigned char * Data() const {
+		return data_;
+	}
+
+	size_t Size() const {
+		return size_;
+	}
+
+	// Releases a loose file; pack data stays valid as long as the pack is mounted
+	void Close();
+
+private:
+	friend class AssetVfs;
+
+	const unsigned char * data_;
+	size_t size_;
+	std::unique_ptr<MappedFile> loose_;
+};
+
+// Where every loader gets its files from. Mount() maps a pack once; Open()
+// then serves names from its index, checking each entry's checksum the first
+// time it is opened, and falls back to loose files for names the pack does
+// not have, so development works without a pack. Safe to call from any
+// thread once mounted.
+class AssetVfs {
+public:
+	static AssetVfs & Instance();
+
+	// Only once, before any loader runs
+	bool Mount(const char * pack_path);
+
+	bool IsMounted() const {
+		return entries_ != NULL;
+	}
+
+	// Whether the mounted pack has the asset, without touching loose files
+	bool IsPacked(const char * name) const;
+
+	// Prints a message and returns false if the asset is neither packed nor a readable file
+	bool Open(const char * name, AssetData & out);
+
+private:
+	AssetVfs();
+
+	const PackEntry * Find(const std::string & name) const;
+
+	MappedFile pack_;
+	const PackEntry * entries_;
+	uint32_t entry_count_;
+	const char * names_;
+	std::unique_ptr<std::atomic<bool>[]> verified_;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include <algorithm>
+
+#include "broadphase.hpp"
+#include "sweepandprune.hpp"
+
+Broadphase * Broadphase::Create(BroadphaseType type){
+	switch (type){
+	case BROADPHASE_SWEEP_AND_PRUNE:
+		return new SweepAndPrune();
+	default:
+		return new TreeBroadphase();
+	}
+}
+
+void TreeBroadphase::MarkMoved(int proxy){
+	if (proxy >= (int)is_moved_.size())
+		is_moved_.resize(proxy + 1, false);
+	if (!is_moved_[proxy]){
+		is_moved_[proxy] = true;
+		moved_.push_back(proxy);
+	}
+}
+
+int TreeBroadphase::CreateProxy(const AABB & box, void * user_data){
+	int proxy = tree_.CreateProxy(box, user_data);
+	MarkMoved(proxy);
+	return proxy;
+}
+
+void TreeBroadphase::DestroyProxy(int proxy){
+	if (proxy < (int)is_moved_.size() && is_moved_[proxy]){
+		is_moved_[proxy] = false;
+		moved_.erase(std::find(moved_.begin(), moved_.end(), proxy));
+	}
+	tree_.DestroyProxy(proxy);
+}
+
+void TreeBroadphase::MoveProxy(int proxy, const AABB & box, const glm::vec3 & displacement){
+	tree_.MoveProxy(proxy, box, displacement);
+	MarkMoved(proxy);
+}
+
+void TreeBroadphase::Clear(){
+	tree_.Clear();
+	moved_.clear();
+	is_moved_.clear();
+}
+
+void TreeBroadphase::UpdatePairs(const PairCallback & callback){
+	for (int proxy : moved_){
+		tree_.QueryAABB(tree_.GetFatAABB(proxy), [&](int other){
+			// A pair of two moved proxies is reported from the lower id only
+			if (other != proxy && !(is_moved_[other] && other < proxy))
+				callback(proxy, other);
+			return true;
+		});
+	}
+	for (int proxy : moved_)
+		is_moved_[proxy] = false;
+	moved_.clear();
+}
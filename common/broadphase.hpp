@@ -0,0 +1,81 @@
+#ifndef BROADPHASE_HPP
+#define BROADPHASE_HPP
+
+#include <functional>
+#include <vector>
+
+#include "aabbtree.hpp"
+
+enum BroadphaseType {
+	BROADPHASE_AABB_TREE,
+	BROADPHASE_SWEEP_AND_PRUNE,
+};
+
+// Finds the objects whose boxes may overlap, so exact tests only run on those.
+// Objects are identified by the proxy id CreateProxy returns. Boxes may be
+// enlarged by the implementation, so every result is only a candidate.
+class Broadphase {
+public:
+	typedef std::function<bool(int proxy)> QueryCallback;
+	typedef std::function<void(int proxy_a, int proxy_b)> PairCallback;
+
+	static Broadphase * Create(BroadphaseType type);
+
+	virtual ~Broadphase() = default;
+
+	virtual const char * Name() const = 0;
+
+	virtual int CreateProxy(const AABB & box, void * user_data) = 0;
+	virtual void DestroyProxy(int proxy) = 0;
+
+	// displacement is the expected movement until the next update
+	virtual void MoveProxy(int proxy, const AABB & box, const glm::vec3 & displacement) = 0;
+
+	virtual void Clear() = 0;
+
+	virtual void * GetUserData(int proxy) const = 0;
+
+	// callback returns false to stop the query
+	virtual void QueryAABB(const AABB & box, const QueryCallback & callback) const = 0;
+	virtual void QueryFrustum(const Frustum & frustum, const QueryCallback & callback) const = 0;
+
+	// Reports every overlapping pair in which at least one proxy was created
+	// or moved since the previous call, each pair once
+	virtual void UpdatePairs(const PairCallback & callback) = 0;
+};
+
+// The AABBTree; pairs come from querying the tree with every moved proxy
+class TreeBroadphase : public Broadphase {
+public:
+	const char * Name() const override {
+		return "aabb-tree";
+	}
+
+	int CreateProxy(const AABB & box, void * user_data) override;
+	void DestroyProxy(int proxy) override;
+	void MoveProxy(int proxy, const AABB & box, const glm::vec3 & displacement) override;
+	void Clear() override;
+
+	void * GetUserData(int proxy) const override {
+		return tree_.GetUserData(proxy);
+	}
+
+	void QueryAABB(const AABB & box, const QueryCallback & callback) const override {
+		tree_.QueryAABB(box, callback);
+	}
+
+	void QueryFrustum(const Frustum & frustum, const QueryCallback & callback) const override {
+		tree_.QueryFrustum(frustum, callback);
+	}
+
+	void UpdatePairs(const PairCallback & callback) override;
+
+private:
+	void MarkMoved(int proxy);
+
+	AABBTree tree_;
+	std::vector<int> moved_;
+	std::vector<bool> is_moved_;
+};
+
+#endif
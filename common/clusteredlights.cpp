@@ -0,0 +1,205 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "aabbtree.hpp"
+#include "clusteredlights.hpp"
+#include "memorytracker.hpp"
+
+enum { LIGHT_DATA, CLUSTER_GRID, LIGHT_INDICES };
+
+// Bytes per texel of each buffer
+static const size_t TexelSizes[3] = { sizeof(glm::vec4), 2 * sizeof(GLuint), sizeof(GLushort) };
+
+// The grid does not depend on the lights; GL 3.3 guarantees buffer textures at least this many texels
+static_assert(CLUSTER_COUNT <= 65536, "the cluster grid outgrows the smallest texture buffer");
+
+ClusteredLights::ClusteredLights():
+	light_count_(0),
+	grid_(2 * CLUSTER_COUNT, 0),
+	cluster_capacity_(CLUSTER_COUNT, 0)
+{
+	MemoryScope scope(MEMORY_RENDERER, "clustered lights");
+	const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+
+	GLint max_texels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+	max_texels_ = max_texels > 0 ? size_t(max_texels) : 65536;
+
+	glGenBuffers(3, buffers_);
+	glGenTextures(3, textures_);
+	for (int i = 0; i < 3; i++){
+		capacities_[i] = 16;
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers_[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		MemoryTracker::Instance().TrackGpu(GPU_BUFFER, buffers_[i], 16);
+		glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers_[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+ClusteredLights::~ClusteredLights(){
+	for (int i = 0; i < 3; i++)
+		MemoryTracker::Instance().UntrackGpu(GPU_BUFFER, buffers_[i]);
+	glDeleteTextures(3, textures_);
+	glDeleteBuffers(3, buffers_);
+}
+
+void ClusteredLights::SetupProgram(GLuint programID){
+	glUseProgram(programID);
+	glUniform1i(GetUniformLocation(programID, "LightData"), LIGHT_DATA_UNIT);
+	glUniform1i(GetUniformLocation(programID, "ClusterGrid"), CLUSTER_GRID_UNIT);
+	glUniform1i(GetUniformLocation(programID, "LightIndices"), LIGHT_INDICES_UNIT);
+}
+
+// Exponential slicing keeps froxels roughly cubic along the view direction
+static int depthSlice(float depth, float near_plane, float far_plane){
+	int slice = (int)floorf(logf(depth / near_plane) / logf(far_plane / near_plane) * CLUSTER_SLICES);
+	return std::min(std::max(slice, 0), CLUSTER_SLICES - 1);
+}
+
+static float sliceDepth(int slice, float near_plane, float far_plane){
+	return near_plane * powf(far_plane / near_plane, (float)slice / CLUSTER_SLICES);
+}
+
+static int tile(float ndc, int tiles){
+	int index = (int)floorf((ndc * 0.5f + 0.5f) * tiles);
+	return std::min(std::max(index, 0), tiles - 1);
+}
+
+void ClusteredLights::Update(const std::vector<PointLight> & lights, const FrameUniforms & frame){
+	MemoryScope scope(MEMORY_RENDERER, "clustered lights");
+
+	float near_plane = frame.NearPlane;
+	float far_plane = frame.FarPlane;
+
+	// Only lights that reach into the view are binned, and if the light buffer
+	// cannot hold them all the nearest win; sorting them nearest first also
+	// makes the nearest win where a cluster's index list overflows
+	Frustum frustum = Frustum::FromMatrix(frame.ViewProjection);
+	glm::vec3 camera(frame.CameraPosition);
+	candidates_.clear();
+	for (size_t i = 0; i < lights.size(); i++){
+		const PointLight & light = lights[i];
+		if (frustum.Classify(AABB::Sphere(light.position, light.radius)) < 0)
+			continue;
+		glm::vec3 offset = light.position - camera;
+		LightCandidate candidate = { glm::dot(offset, offset), GLuint(i) };
+		candidates_.push_back(candidate);
+	}
+	size_t max_lights = std::min<size_t>(MAX_CLUSTERED_LIGHTS, max_texels_ / 2);
+	light_count_ = std::min(candidates_.size(), max_lights);
+	std::partial_sort(candidates_.begin(), candidates_.begin() + light_count_, candidates_.end(),
+	                  [](const LightCandidate & a, const LightCandidate & b){ return a.distance < b.distance; });
+
+	light_data_.resize(2 * light_count_);
+	ranges_.clear();
+	std::fill(grid_.begin(), grid_.end(), 0);
+
+	// First pass: find the tiles each light covers in each depth slice and count lights per cluster
+	for (size_t i = 0; i < light_count_; i++){
+		const PointLight & light = lights[candidates_[i].light];
+		light_data_[2 * i] = glm::vec4(light.position, light.radius);
+		light_data_[2 * i + 1] = glm::vec4(light.color, light.intensity);
+
+		glm::vec3 center = glm::vec3(frame.View * glm::vec4(light.position, 1.0f));
+		float center_depth = -center.z;
+		float closest = std::max(center_depth - light.radius, near_plane);
+		float farthest = std::min(center_depth + light.radius, far_plane);
+		if (closest > farthest)
+			continue;
+
+		int first_slice = depthSlice(closest, near_plane, far_plane);
+		int last_slice = depthSlice(farthest, near_plane, far_plane);
+		for (int z = first_slice; z <= last_slice; z++){
+			// Part of the sphere inside this slice: a depth band and the widest cross-section in it
+			float band_near = std::max(closest, sliceDepth(z, near_plane, far_plane));
+			float band_far = std::min(farthest, sliceDepth(z + 1, near_plane, far_plane));
+			float offset = 0.0f;
+			if (center_depth < band_near)
+				offset = band_near - center_depth;
+			else if (center_depth > band_far)
+				offset = center_depth - band_far;
+			float radius = sqrtf(std::max(light.radius * light.radius - offset * offset, 0.0f));
+
+			// Project the corners of the band's bounding box, the extremes are among them
+			float min_x = 1.0f, max_x = -1.0f, min_y = 1.0f, max_y = -1.0f;
+			const float depths[2] = { band_near, band_far };
+			for (int d = 0; d < 2; d++){
+				for (int s = -1; s <= 1; s += 2){
+					float x = frame.Projection[0][0] * (center.x + s * radius) / depths[d];
+					float y = frame.Projection[1][1] * (center.y + s * radius) / depths[d];
+					min_x = std::min(min_x, x); max_x = std::max(max_x, x);
+					min_y = std::min(min_y, y); max_y = std::max(max_y, y);
+				}
+			}
+			if (max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f)
+				continue;
+
+			ClusterRange range = {
+				(GLushort)i, (GLushort)z,
+				(GLushort)tile(min_x, CLUSTER_TILES_X), (GLushort)tile(max_x, CLUSTER_TILES_X),
+				(GLushort)tile(min_y, CLUSTER_TILES_Y), (GLushort)tile(max_y, CLUSTER_TILES_Y)
+			};
+			ranges_.push_back(range);
+
+			for (int y = range.y0; y <= range.y1; y++)
+				for (int x = range.x0; x <= range.x1; x++)
+					grid_[2 * (x + CLUSTER_TILES_X * (y + CLUSTER_TILES_Y * z)) + 1]++;
+		}
+	}
+
+	// Prefix sum of the counts gives every cluster its slice of the index list.
+	// Clusters are in depth order, so if the lists outgrow the index buffer the
+	// farthest clusters lose the lights that do not fit
+	GLuint offset = 0;
+	for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++){
+		GLuint count = std::min<GLuint>(grid_[2 * cluster + 1], GLuint(max_texels_ - offset));
+		grid_[2 * cluster] = offset;
+		grid_[2 * cluster + 1] = 0;
+		cluster_capacity_[cluster] = count;
+		offset += count;
+	}
+	indices_.resize(offset);
+
+	// Second pass: scatter the light indices, the counts are rebuilt on the way
+	for (const ClusterRange & range : ranges_){
+		for (int y = range.y0; y <= range.y1; y++)
+			for (int x = range.x0; x <= range.x1; x++){
+				int index = x + CLUSTER_TILES_X * (y + CLUSTER_TILES_Y * range.z);
+				GLuint * cluster = &grid_[2 * index];
+				if (cluster[1] < cluster_capacity_[index])
+					indices_[cluster[0] + cluster[1]++] = range.light;
+			}
+	}
+
+	Upload(LIGHT_DATA, light_data_.data(), light_data_.size() * sizeof(glm::vec4));
+	Upload(CLUSTER_GRID, grid_.data(), grid_.size() * sizeof(GLuint));
+	Upload(LIGHT_INDICES, indices_.data(), indices_.size() * sizeof(GLushort));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::Upload(int buffer, const void * data, size_t size){
+	// Orphan the old storage at the same size, so the tracker only hears of the
+	// buffer when it grows. An empty buffer texture would be incomplete, so the
+	// capacity starts at 16 bytes, and texels past the limit could not be read
+	if (size > capacities_[buffer]){
+		capacities_[buffer] = std::min(size + size / 2, max_texels_ * TexelSizes[buffer]);
+		MemoryTracker::Instance().TrackGpu(GPU_BUFFER, buffers_[buffer], capacities_[buffer]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers_[buffer]);
+	glBufferData(GL_TEXTURE_BUFFER, capacities_[buffer], NULL, GL_STREAM_DRAW);
+	if (size > 0)
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+}
+
+void ClusteredLights::Bind() const {
+	const GLenum units[3] = { LIGHT_DATA_UNIT, CLUSTER_GRID_UNIT, LIGHT_INDICES_UNIT };
+	for (int i = 0; i < 3; i++){
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
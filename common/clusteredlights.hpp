@@ -0,0 +1,94 @@
+#ifndef CLUSTEREDLIGHTS_HPP
+#define CLUSTEREDLIGHTS_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+
+// Froxel grid: screen tiles times exponential depth slices.
+// The same constants are hard-coded in SimpleFragmentShader.
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES  24
+#define CLUSTER_COUNT   (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+
+// Texture units of the light buffers, unit 0 is left to the material texture
+#define LIGHT_DATA_UNIT    1
+#define CLUSTER_GRID_UNIT  2
+#define LIGHT_INDICES_UNIT 3
+
+// Light indices are stored as 16 bits. The light and index buffers are also
+// held to GL_MAX_TEXTURE_BUFFER_SIZE, which is queried at init.
+#define MAX_CLUSTERED_LIGHTS 65535
+
+struct PointLight {
+	glm::vec3 position; // world space
+	float radius;       // no contribution beyond this distance
+	glm::vec3 color;
+	float intensity;
+};
+
+// Clustered forward shading. Every frame the lights are binned on the CPU into
+// view-space froxels; the fragment shader finds its froxel and only loops over
+// the lights listed there. Lights, per-cluster (offset, count) pairs and the
+// flattened index lists live in texture buffers, which GL 3.3 core has. Lights
+// outside the frustum are skipped, and when the buffers cannot hold all the
+// others the nearest are kept.
+class ClusteredLights {
+public:
+	ClusteredLights();
+	~ClusteredLights();
+
+	ClusteredLights(const ClusteredLights&) = delete;
+	ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+	// Sets the sampler units of a program that includes the clustered lighting code
+	static void SetupProgram(GLuint programID);
+
+	// Bins the lights for the camera described by frame and uploads the buffers
+	void Update(const std::vector<PointLight> & lights, const FrameUniforms & frame);
+
+	// Binds the light buffers to their texture units
+	void Bind() const;
+
+	size_t LightCount() const {
+		return light_count_;
+	}
+
+	size_t IndexCount() const {
+		return indices_.size();
+	}
+
+private:
+	// A light that reaches into the view, with its squared distance to the camera
+	struct LightCandidate {
+		float distance;
+		GLuint light;
+	};
+
+	// Tiles covered by one light in one depth slice
+	struct ClusterRange {
+		GLushort light, z;
+		GLushort x0, x1, y0, y1;
+	};
+
+	void Upload(int buffer, const void * data, size_t size);
+
+	GLuint buffers_[3];
+	GLuint textures_[3];
+	size_t capacities_[3]; // bytes, the buffers only grow
+	size_t max_texels_;    // GL_MAX_TEXTURE_BUFFER_SIZE
+
+	size_t light_count_;
+	std::vector<LightCandidate> candidates_;
+	std::vector<glm::vec4> light_data_;
+	std::vector<ClusterRange> ranges_;
+	std::vector<GLuint> grid_;
+	std::vector<GLuint> cluster_capacity_; // index slots per cluster that fit the index buffer
+	std::vector<GLushort> indices_;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#include <math.h>
+
+#include "collision.hpp"
+
+bool sweepSpheres(const glm::vec3 & a_center, float a_radius, const glm::vec3 & a_step,
+                  const glm::vec3 & b_center, float b_radius, const glm::vec3 & b_step,
+                  float & time_of_impact){
+
+	// In b's frame a is a ray from the center distance d along the relative step v,
+	// and they touch where |d + t v| = a_radius + b_radius
+	glm::vec3 d = a_center - b_center;
+	glm::vec3 v = a_step - b_step;
+	float radius = a_radius + b_radius;
+
+	float c = glm::dot(d, d) - radius * radius;
+	if (c < 0.0f){
+		time_of_impact = 0.0f;
+		return true;
+	}
+
+	float a = glm::dot(v, v);
+	float b = glm::dot(d, v);
+	// Not moving relative to each other, or moving apart
+	if (a == 0.0f || b >= 0.0f)
+		return false;
+
+	float discriminant = b * b - a * c;
+	if (discriminant < 0.0f)
+		return false;
+
+	float t = (-b - sqrtf(discriminant)) / a;
+	if (t > 1.0f)
+		return false;
+	time_of_impact = t;
+	return true;
+}
@@ -0,0 +1,13 @@
+#ifndef COLLISION_HPP
+#define COLLISION_HPP
+
+#include <glm/glm.hpp>
+
+// Continuous test of two spheres that move by a_step and b_step during a
+// step. Returns whether they touch during it and the time of impact as a
+// fraction of the step: 0 when they already overlap at the start.
+bool sweepSpheres(const glm::vec3 & a_center, float a_radius, const glm::vec3 & a_step,
+                  const glm::vec3 & b_center, float b_radius, const glm::vec3 & b_step,
+                  float & time_of_impact);
+
+#endif
@@ -0,0 +1,88 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+#include "framepacer.hpp"
+#include "profiler.hpp"
+
+namespace {
+
+// Frames kept for Stats(), ten seconds at 60 fps
+const unsigned int kStatsWindow = 600;
+
+// Bounds of the learned spin margin, in seconds
+const double kMinSpinMargin = 0.0002;
+const double kMaxSpinMargin = 0.002;
+
+}
+
+FramePacer::FramePacer(double target_fps):
+	period_(target_fps > 0.0 ? 1.0 / target_fps : 0.0),
+	deadline_(-1.0),
+	last_frame_(-1.0),
+	spin_margin_(0.001),
+	next_frame_time_(0)
+{
+	frame_times_.reserve(kStatsWindow);
+}
+
+void FramePacer::ApplyVsync(VsyncMode mode){
+	int interval = 0;
+	if (mode == VSYNC_ON){
+		interval = 1;
+	} else if (mode == VSYNC_ADAPTIVE){
+		if (glfwExtensionSupported("GLX_EXT_swap_control_tear") || glfwExtensionSupported("WGL_EXT_swap_control_tear")){
+			interval = -1;
+		} else {
+			printf("Adaptive vsync is not supported, using vsync\n");
+			interval = 1;
+		}
+	}
+	glfwSwapInterval(interval);
+}
+
+void FramePacer::Pace(){
+	if (period_ > 0.0){
+		double now = glfwGetTime();
+		// After a stall the next frames start over from now instead of rushing to catch up
+		if (deadline_ < 0.0 || now > deadline_ + period_)
+			deadline_ = now;
+		else
+			deadline_ += period_;
+		WaitUntil(deadline_);
+	}
+
+	double now = glfwGetTime();
+	if (last_frame_ >= 0.0){
+		double frame_ms = (now - last_frame_) * 1000.0;
+		Profiler::Instance().Record("frame.time_ms", frame_ms);
+		if (frame_times_.size() < kStatsWindow)
+			frame_times_.push_back(frame_ms);
+		else
+			frame_times_[next_frame_time_] = frame_ms;
+		next_frame_time_ = (next_frame_time_ + 1) % kStatsWindow;
+	}
+	last_frame_ = now;
+}
+
+void FramePacer::WaitUntil(double deadline){
+	double sleep_until = deadline - spin_margin_;
+	double now = glfwGetTime();
+	if (now < sleep_until){
+		std::this_thread::sleep_for(std::chrono::duration<double>(sleep_until - now));
+		// Widen the margin at once when the OS overslept, narrow it slowly otherwise
+		double overslept = glfwGetTime() - sleep_until;
+		spin_margin_ = std::max(spin_margin_ * 0.95, overslept * 1.25);
+		spin_margin_ = std::min(std::max(spin_margin_, kMinSpinMargin), kMaxSpinMargin);
+	}
+	while (glfwGetTime() < deadline)
+		std::this_thread::yield();
+}
+
+DurationStats FramePacer::Stats() const {
+	return durationStats(frame_times_);
+}
@@ -0,0 +1,50 @@
+#ifndef FRAMEPACER_HPP
+#define FRAMEPACER_HPP
+
+#include <vector>
+
+#include "profiler.hpp"
+
+struct GLFWwindow;
+
+enum VsyncMode {
+	VSYNC_OFF,
+	VSYNC_ON,
+	// Waits for vblank unless the frame is late, then swaps right away and tears
+	VSYNC_ADAPTIVE,
+};
+
+// Keeps frames to a target rate without pegging a core: the wait sleeps
+// until shortly before the deadline and spins the rest, with the spin margin
+// learned from how late the OS has been waking us up. Times come from
+// glfwGetTime, so GLFW must be initialised.
+class FramePacer {
+public:
+	// A target_fps of 0 leaves the rate to vsync
+	explicit FramePacer(double target_fps = 0.0);
+
+	// Sets the swap interval of the current context. Adaptive falls back to
+	// plain vsync where the driver lacks the swap_control_tear extension.
+	static void ApplyVsync(VsyncMode mode);
+
+	// Once per frame, before sampling input: waits out the rest of the frame
+	// and records the time since the previous call
+	void Pace();
+
+	// Frame times over the recent window
+	DurationStats Stats() const;
+
+private:
+	void WaitUntil(double deadline);
+
+	double period_;
+	double deadline_;
+	double last_frame_;
+	// How long before the deadline to stop sleeping and start spinning
+	double spin_margin_;
+
+	std::vector<double> frame_times_;
+	unsigned int next_frame_time_;
+};
+
+#endif
@@ -0,0 +1,276 @@
+#include <stdio.h>
+
+#include "aabbtree.hpp"
+#include "gpuculling.hpp"
+#include "memorytracker.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
+
+namespace {
+
+// Must match local_size_x in FrustumCullComputeShader
+const GLuint kWorkGroupSize = 64;
+
+// Storage buffer bindings of the culling pass
+const GLuint kInstancesBinding = 0;
+const GLuint kVisibleBinding = 1;
+const GLuint kCommandsBinding = 2;
+const GLuint kMeshCommandsBinding = 3;
+
+bool sameLayout(const VertexLayout & a, const VertexLayout & b){
+	if (a.stride != b.stride || a.attributes.size() != b.attributes.size())
+		return false;
+	for (size_t i = 0; i < a.attributes.size(); i++){
+		const VertexAttribute & x = a.attributes[i];
+		const VertexAttribute & y = b.attributes[i];
+		if (x.location != y.location || x.components != y.components || x.type != y.type ||
+		    x.normalized != y.normalized || x.offset != y.offset)
+			return false;
+	}
+	return true;
+}
+
+// Replaces target with a new buffer holding its first old_size bytes
+// followed by the contents of appended
+void appendBuffer(GLuint & target, GLsizeiptr old_size, GLuint appended, GLsizeiptr appended_size){
+	GLuint grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, old_size + appended_size, NULL, GL_STATIC_DRAW);
+	MemoryTracker::Instance().TrackGpu(GPU_BUFFER, grown, old_size + appended_size);
+	if (old_size > 0){
+		glBindBuffer(GL_COPY_READ_BUFFER, target);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, appended);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, old_size, appended_size);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	MemoryTracker::Instance().UntrackGpu(GPU_BUFFER, target);
+	glDeleteBuffers(1, &target);
+	target = grown;
+}
+
+}
+
+bool GpuCuller::IsSupported(){
+	return GLEW_VERSION_4_3 != 0;
+}
+
+GpuCuller::GpuCuller():
+	program_(0),
+	frustum_planes_location_(-1),
+	instance_count_location_(-1),
+	instance_buffer_(0),
+	visible_buffer_(0),
+	command_buffer_(0),
+	mesh_command_buffer_(0),
+	instance_capacity_(0)
+{
+}
+
+GpuCuller::~GpuCuller(){
+	MemoryTracker & tracker = MemoryTracker::Instance();
+	for (const Arena & arena : arenas_){
+		tracker.UntrackGpu(GPU_BUFFER, arena.vertex_buffer);
+		tracker.UntrackGpu(GPU_BUFFER, arena.index_buffer);
+		glDeleteVertexArrays(1, &arena.vertex_array);
+		glDeleteBuffers(1, &arena.vertex_buffer);
+		glDeleteBuffers(1, &arena.index_buffer);
+	}
+	GLuint buffers[] = {instance_buffer_, visible_buffer_, command_buffer_, mesh_command_buffer_};
+	for (GLuint buffer : buffers)
+		tracker.UntrackGpu(GPU_BUFFER, buffer);
+	glDeleteBuffers(4, buffers);
+	DeleteProgram(program_);
+}
+
+bool GpuCuller::Init(const char * compute_shader_path, const std::string & compute_shader_code){
+	MemoryScope scope(MEMORY_RENDERER, "gpu culler");
+	program_ = CompileComputeShader(compute_shader_path, compute_shader_code);
+	if (program_ == 0)
+		return false;
+	frustum_planes_location_ = GetUniformLocation(program_, "FrustumPlanes");
+	instance_count_location_ = GetUniformLocation(program_, "InstanceCount");
+
+	glGenBuffers(1, &instance_buffer_);
+	glGenBuffers(1, &visible_buffer_);
+	glGenBuffers(1, &command_buffer_);
+	glGenBuffers(1, &mesh_command_buffer_);
+	return true;
+}
+
+size_t GpuCuller::FindArena(const VertexLayout & layout){
+	for (size_t i = 0; i < arenas_.size(); i++){
+		if (sameLayout(arenas_[i].layout, layout))
+			return i;
+	}
+
+	Arena arena;
+	arena.layout = layout;
+	arena.vertex_count = 0;
+	arena.index_count = 0;
+	glGenVertexArrays(1, &arena.vertex_array);
+	glGenBuffers(1, &arena.vertex_buffer);
+	glGenBuffers(1, &arena.index_buffer);
+
+	glBindVertexArray(arena.vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vertex_buffer);
+	setVertexLayout(layout);
+
+	// The model matrices come straight from the culling pass's output
+	glBindBuffer(GL_ARRAY_BUFFER, visible_buffer_);
+	for (GLuint column = 0; column < 4; column++){
+		glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+		glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+		                      (void*)(column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+	}
+	glBindVertexArray(0);
+
+	arenas_.push_back(arena);
+	return arenas_.size() - 1;
+}
+
+GLuint GpuCuller::AddMesh(GLuint vertex_buffer, GLuint index_buffer, const VertexLayout & layout,
+                          GLsizei vertex_count, GLsizei index_count, TextureHandle texture, GLfloat emissive){
+	MemoryScope scope(MEMORY_RENDERER, "gpu culler");
+	size_t arena_index = FindArena(layout);
+	Arena & arena = arenas_[arena_index];
+
+	// Grow the arena's buffers and append the mesh; the indices stay relative
+	// to the mesh and the draw command adds its base vertex
+	appendBuffer(arena.vertex_buffer, GLsizeiptr(arena.vertex_count) * layout.stride,
+	             vertex_buffer, GLsizeiptr(vertex_count) * layout.stride);
+	appendBuffer(arena.index_buffer, GLsizeiptr(arena.index_count) * sizeof(GLuint),
+	             index_buffer, GLsizeiptr(index_count) * sizeof(GLuint));
+
+	glBindVertexArray(arena.vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vertex_buffer);
+	setVertexLayout(layout);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.index_buffer);
+	glBindVertexArray(0);
+
+	Mesh mesh;
+	mesh.base_vertex = arena.vertex_count;
+	mesh.first_index = arena.index_count;
+	mesh.index_count = index_count;
+	arena.vertex_count += vertex_count;
+	arena.index_count += index_count;
+
+	GLuint mesh_index = GLuint(meshes_.size());
+	meshes_.push_back(mesh);
+
+	DrawGroup * group = NULL;
+	for (DrawGroup & candidate : groups_){
+		if (candidate.arena == arena_index && candidate.texture == texture && candidate.emissive == emissive)
+			group = &candidate;
+	}
+	if (group == NULL){
+		groups_.push_back(DrawGroup());
+		group = &groups_.back();
+		group->arena = arena_index;
+		group->texture = texture;
+		group->emissive = emissive;
+	}
+	group->meshes.push_back(mesh_index);
+
+	UpdateCommandOrder();
+	return mesh_index;
+}
+
+void GpuCuller::UpdateCommandOrder(){
+	command_of_mesh_.assign(meshes_.size(), 0);
+	commands_.clear();
+	for (const DrawGroup & group : groups_){
+		for (GLuint mesh_index : group.meshes){
+			command_of_mesh_[mesh_index] = GLuint(commands_.size());
+			const Mesh & mesh = meshes_[mesh_index];
+			DrawCommand command = {GLuint(mesh.index_count), 0, mesh.first_index, mesh.base_vertex, 0};
+			commands_.push_back(command);
+		}
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh_command_buffer_);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, command_of_mesh_.size() * sizeof(GLuint), command_of_mesh_.data(),
+	             GL_STATIC_DRAW);
+	MemoryTracker::Instance().TrackGpu(GPU_BUFFER, mesh_command_buffer_, command_of_mesh_.size() * sizeof(GLuint));
+	// Cull() refills the commands every frame, but their count only changes here
+	MemoryTracker::Instance().TrackGpu(GPU_BUFFER, command_buffer_, commands_.size() * sizeof(DrawCommand));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCuller::Cull(const std::vector<GpuInstance> & instances, const glm::mat4 & view_projection){
+	ScopedTimer timer("render.gpu_cull_submit_ms");
+	MemoryScope scope(MEMORY_RENDERER, "gpu culler");
+	MemoryTracker & tracker = MemoryTracker::Instance();
+
+	size_t count = instances.size();
+	if (count > instance_capacity_){
+		instance_capacity_ = count + count / 2;
+		glBindBuffer(GL_ARRAY_BUFFER, visible_buffer_);
+		glBufferData(GL_ARRAY_BUFFER, instance_capacity_ * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+		tracker.TrackGpu(GPU_BUFFER, visible_buffer_, instance_capacity_ * sizeof(glm::mat4));
+		tracker.TrackGpu(GPU_BUFFER, instance_buffer_, instance_capacity_ * sizeof(GpuInstance));
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Every mesh's visible instances get a slice as long as its instances, so
+	// no mesh can overflow into the next one's and the slices add up to count
+	for (DrawCommand & command : commands_)
+		command.base_instance = 0;
+	for (const GpuInstance & instance : instances)
+		commands_[command_of_mesh_[instance.mesh]].base_instance++;
+	GLuint first_instance = 0;
+	for (DrawCommand & command : commands_){
+		GLuint mesh_instances = command.base_instance;
+		command.instance_count = 0;
+		command.base_instance = first_instance;
+		first_instance += mesh_instances;
+	}
+
+	// Orphan last frame's storage so the upload does not wait for its draws
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer_);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, instance_capacity_ * sizeof(GpuInstance), NULL, GL_STREAM_DRAW);
+	if (count > 0)
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GpuInstance), instances.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer_);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, commands_.size() * sizeof(DrawCommand), commands_.data(),
+	             GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (count == 0)
+		return;
+
+	Frustum frustum = Frustum::FromMatrix(view_projection);
+
+	glUseProgram(program_);
+	glUniform4fv(frustum_planes_location_, 6, &frustum.planes[0][0]);
+	glUniform1ui(instance_count_location_, GLuint(count));
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kInstancesBinding, instance_buffer_);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kVisibleBinding, visible_buffer_);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kCommandsBinding, command_buffer_);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kMeshCommandsBinding, mesh_command_buffer_);
+	glDispatchCompute(GLuint((count + kWorkGroupSize - 1) / kWorkGroupSize), 1, 1);
+
+	// The draws read the matrices as vertex attributes and the counts as indirect commands
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void GpuCuller::Draw(GLint emissive_location){
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+	glActiveTexture(GL_TEXTURE0);
+
+	size_t first_command = 0;
+	for (const DrawGroup & group : groups_){
+		glBindVertexArray(arenas_[group.arena].vertex_array);
+		glBindTexture(GL_TEXTURE_2D, group.texture->Name());
+		glUniform1f(emissive_location, group.emissive);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(first_command * sizeof(DrawCommand)),
+		                            GLsizei(group.meshes.size()), 0);
+		first_command += group.meshes.size();
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,112 @@
+#ifndef GPUCULLING_HPP
+#define GPUCULLING_HPP
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "texturestreamer.hpp"
+#include "vertexformat.hpp"
+
+// One object as the culling pass reads it, laid out like Instance in
+// FrustumCullComputeShader.computeshader (std430)
+struct GpuInstance {
+	glm::mat4 model;
+	glm::vec4 bounds; // bounding sphere, center and radius
+	GLuint mesh;      // what AddMesh returned
+	GLuint padding[3];
+};
+
+// Frustum culling and draw list generation on the GPU. Every frame the
+// instances go up in one upload, a compute pass tests their bounds against
+// the frustum, compacts the visible model matrices and counts them into
+// indirect draw commands, and meshes sharing a vertex layout, texture and
+// emissive factor are drawn by a single glMultiDrawElementsIndirect. The CPU
+// only counts the instances of each mesh, to lay out the compacted matrices.
+class GpuCuller {
+public:
+	// Compute shaders, storage buffers and indirect draws with a base
+	// instance, all core in GL 4.3
+	static bool IsSupported();
+
+	GpuCuller();
+	~GpuCuller();
+
+	GpuCuller(const GpuCuller&) = delete;
+	GpuCuller& operator=(const GpuCuller&) = delete;
+
+	// False if the compute shader does not build. The source has already been
+	// read, by ReadShaderSource(), the path only names it in messages.
+	bool Init(const char * compute_shader_path, const std::string & compute_shader_code);
+
+	// Copies the mesh out of its vertex and 32-bit index buffers, so the caller
+	// keeps ownership of them. Returns the mesh index for GpuInstance::mesh.
+	GLuint AddMesh(GLuint vertex_buffer, GLuint index_buffer, const VertexLayout & layout,
+	               GLsizei vertex_count, GLsizei index_count, TextureHandle texture, GLfloat emissive);
+
+	// Uploads the instances and runs the culling pass
+	void Cull(const std::vector<GpuInstance> & instances, const glm::mat4 & view_projection);
+
+	// Draws what the last Cull() left visible with the bound program, which
+	// samples texture unit 0 and reads Emissive from emissive_location
+	void Draw(GLint emissive_location);
+
+private:
+	// Meshes that share a vertex layout live in one buffer and one VAO
+	struct Arena {
+		VertexLayout layout;
+		GLuint vertex_array;
+		GLuint vertex_buffer;
+		GLuint index_buffer;
+		GLsizei vertex_count;
+		GLsizei index_count;
+	};
+
+	struct Mesh {
+		GLint base_vertex;
+		GLuint first_index;
+		GLsizei index_count;
+	};
+
+	// Meshes drawn together; their commands are consecutive
+	struct DrawGroup {
+		size_t arena;
+		TextureHandle texture;
+		GLfloat emissive;
+		std::vector<GLuint> meshes;
+	};
+
+	// Laid out like DrawElementsIndirectCommand
+	struct DrawCommand {
+		GLuint count;
+		GLuint instance_count;
+		GLuint first_index;
+		GLint base_vertex;
+		GLuint base_instance;
+	};
+
+	size_t FindArena(const VertexLayout & layout);
+	void UpdateCommandOrder();
+
+	GLuint program_;
+	GLint frustum_planes_location_;
+	GLint instance_count_location_;
+
+	std::vector<Arena> arenas_;
+	std::vector<Mesh> meshes_;
+	std::vector<DrawGroup> groups_;
+
+	// Index of each mesh's command, uploaded for the compute pass
+	std::vector<GLuint> command_of_mesh_;
+	std::vector<DrawCommand> commands_;
+
+	GLuint instance_buffer_;      // GpuInstance, every object
+	GLuint visible_buffer_;       // mat4 per visible instance, read as the instance attribute
+	GLuint command_buffer_;       // DrawCommand per mesh
+	GLuint mesh_command_buffer_;  // command_of_mesh_
+	size_t instance_capacity_;
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include <string.h>
+
+#include "inputjournal.hpp"
+
+// Journals are only replayed on the machine that recorded them, so the file
+// is in host byte order; the byte order mark makes other hosts reject it.
+struct JournalHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t byte_order;
+	InputJournalInfo info;
+};
+
+// A run with a repeat count of zero is a snapshot instead: input.buttons
+// holds its size and its bytes follow the run
+struct JournalRun {
+	TickInput input;
+	uint32_t repeat;
+};
+
+static_assert(sizeof(JournalHeader) == 28, "JournalHeader layout changed");
+static_assert(sizeof(JournalRun) == 16, "JournalRun layout changed");
+
+static const char JournalMagic[4] = { 'S', 'H', 'I', 'J' };
+static const uint32_t JournalByteOrder = 0x01020304u;
+
+static bool sameInput(const TickInput & a, const TickInput & b){
+	return memcmp(&a, &b, sizeof(TickInput)) == 0;
+}
+
+InputRecorder::InputRecorder():
+	file_(NULL),
+	run_length_(0) {}
+
+InputRecorder::~InputRecorder(){
+	if (file_ != NULL)
+		Close(0);
+}
+
+bool InputRecorder::Open(const char * path, uint32_t seed, uint32_t tick_rate){
+	file_ = fopen(path, "wb");
+	if (file_ == NULL){
+		printf("Impossible to open %s for writing\n", path);
+		return false;
+	}
+	info_.seed = seed;
+	info_.tick_rate = tick_rate;
+	info_.tick_count = 0;
+	info_.state_hash = 0;
+	run_length_ = 0;
+
+	// The header is rewritten with the tick count and hash on Close
+	JournalHeader header;
+	memcpy(header.magic, JournalMagic, 4);
+	header.version = INPUT_JOURNAL_VERSION;
+	header.byte_order = JournalByteOrder;
+	header.info = info_;
+	fwrite(&header, sizeof(header), 1, file_);
+	return true;
+}
+
+void InputRecorder::Write(const TickInput & input){
+	if (file_ == NULL)
+		return;
+	info_.tick_count++;
+	if (run_length_ > 0 && sameInput(input, run_))
+		run_length_++;
+	else{
+		Flush();
+		run_ = input;
+		run_length_ = 1;
+	}
+}
+
+void InputRecorder::WriteSnapshot(const std::vector<unsigned char> & serialized){
+	if (file_ == NULL)
+		return;
+	// The run so far ends with the tick that loaded, the snapshot goes after it
+	Flush();
+	JournalRun marker = { { 0.0f, 0.0f, (uint32_t)serialized.size() }, 0 };
+	fwrite(&marker, sizeof(marker), 1, file_);
+	if (!serialized.empty())
+		fwrite(serialized.data(), 1, serialized.size(), file_);
+}
+
+void InputRecorder::Flush(){
+	if (run_length_ == 0)
+		return;
+	JournalRun run = { run_, run_length_ };
+	fwrite(&run, sizeof(run), 1, file_);
+	run_length_ = 0;
+}
+
+bool InputRecorder::Close(uint32_t state_hash){
+	if (file_ == NULL)
+		return false;
+	Flush();
+	info_.state_hash = state_hash;
+
+	JournalHeader header;
+	memcpy(header.magic, JournalMagic, 4);
+	header.version = INPUT_JOURNAL_VERSION;
+	header.byte_order = JournalByteOrder;
+	header.info = info_;
+	bool ok = fseek(file_, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file_) == 1;
+	ok = fclose(file_) == 0 && ok;
+	file_ = NULL;
+	if (!ok)
+		printf("Could not finish writing the input journal\n");
+	return ok;
+}
+
+InputReplay::InputReplay():
+	offset_(0),
+	run_left_(0) {
+	memset(&info_, 0, sizeof(info_));
+}
+
+bool InputReplay::Open(const char * path){
+	if (!file_.Open(path))
+		return false;
+
+	JournalHeader header;
+	if (file_.Size() < sizeof(header)){
+		printf("%s is not an input journal\n", path);
+		return false;
+	}
+	memcpy(&header, file_.Data(), sizeof(header));
+	if (memcmp(header.magic, JournalMagic, 4) != 0){
+		printf("%s is not an input journal\n", path);
+		return false;
+	}
+	if (header.version != INPUT_JOURNAL_VERSION || header.byte_order != JournalByteOrder){
+		printf("%s was recorded by an incompatible build\n", path);
+		return false;
+	}
+	for (size_t offset = sizeof(header); offset < file_.Size();){
+		JournalRun run;
+		if (offset + sizeof(run) > file_.Size()){
+			printf("%s is truncated\n", path);
+			return false;
+		}
+		memcpy(&run, file_.Data() + offset, sizeof(run));
+		offset += sizeof(run);
+		if (run.repeat == 0){
+			if (run.input.buttons > file_.Size() - offset){
+				printf("%s is truncated\n", path);
+				return false;
+			}
+			offset += run.input.buttons;
+		}
+	}
+
+	info_ = header.info;
+	offset_ = sizeof(header);
+	run_left_ = 0;
+	return true;
+}
+
+bool InputReplay::Next(TickInput & input){
+	while (run_left_ == 0){
+		if (offset_ + sizeof(JournalRun) > file_.Size())
+			return false;
+		JournalRun run;
+		memcpy(&run, file_.Data() + offset_, sizeof(run));
+		offset_ += sizeof(run);
+		if (run.repeat == 0){
+			// A snapshot nothing asked for, the replay has diverged already
+			offset_ += run.input.buttons;
+			continue;
+		}
+		run_ = run.input;
+		run_left_ = run.repeat;
+	}
+	run_left_--;
+	input = run_;
+	return true;
+}
+
+bool InputReplay::NextSnapshot(std::vector<unsigned char> & serialized){
+	JournalRun run;
+	if (run_left_ != 0 || offset_ + sizeof(run) > file_.Size())
+		return false;
+	memcpy(&run, file_.Data() + offset_, sizeof(run));
+	if (run.repeat != 0)
+		return false;
+	offset_ += sizeof(run);
+	serialized.assign(file_.Data() + offset_, file_.Data() + offset_ + run.input.buttons);
+	offset_ += run.input.buttons;
+	return true;
+}
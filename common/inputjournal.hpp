@@ -0,0 +1,96 @@
+#ifndef INPUTJOURNAL_HPP
+#define INPUTJOURNAL_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "mappedfile.hpp"
+
+// Input journals record everything the simulation reads from the player, one
+// TickInput per fixed simulation tick, together with the spawner's RNG seed.
+// Replaying a journal through the same code paths reproduces the session bit
+// for bit; the recorder stores a hash of the final scene so a replay can check
+// that. Runs of identical ticks are stored once with a repeat count. A load
+// depends on a file rather than on the input, so the recorder also stores the
+// snapshot each load read and the replay restores that instead of the file.
+
+#define INPUT_JOURNAL_VERSION 2
+
+enum InputButton {
+	INPUT_FIRE        = 1 << 0,
+	INPUT_SAVE        = 1 << 1,
+	INPUT_LOAD        = 1 << 2,
+	INPUT_TEXT_FORMAT = 1 << 3, // held together with save or load
+};
+
+struct TickInput {
+	float cursor_dx;  // pixels the cursor moved since the previous tick
+	float cursor_dy;
+	uint32_t buttons; // InputButton bits held during the tick
+};
+
+struct InputJournalInfo {
+	uint32_t seed;
+	uint32_t tick_rate;   // ticks per second
+	uint32_t tick_count;
+	uint32_t state_hash;  // of the scene after the last tick
+};
+
+class InputRecorder {
+public:
+	InputRecorder();
+	~InputRecorder();
+
+	InputRecorder(const InputRecorder&) = delete;
+	InputRecorder& operator=(const InputRecorder&) = delete;
+
+	bool Open(const char * path, uint32_t seed, uint32_t tick_rate);
+
+	void Write(const TickInput & input);
+
+	// What the current tick's load read, empty if it failed
+	void WriteSnapshot(const std::vector<unsigned char> & serialized);
+
+	// Stores the final scene hash and closes the file
+	bool Close(uint32_t state_hash);
+
+private:
+	void Flush();
+
+	FILE * file_;
+	InputJournalInfo info_;
+	TickInput run_;
+	uint32_t run_length_;
+};
+
+class InputReplay {
+public:
+	InputReplay();
+
+	InputReplay(const InputReplay&) = delete;
+	InputReplay& operator=(const InputReplay&) = delete;
+
+	bool Open(const char * path);
+
+	const InputJournalInfo & Info() const {
+		return info_;
+	}
+
+	// The next tick's input, false once the journal is exhausted
+	bool Next(TickInput & input);
+
+	// The snapshot the current tick's load read while recording, false if the
+	// journal has none here
+	bool NextSnapshot(std::vector<unsigned char> & serialized);
+
+private:
+	MappedFile file_;
+	InputJournalInfo info_;
+	size_t offset_;
+	uint32_t run_left_;
+	TickInput run_;
+};
+
+#endif
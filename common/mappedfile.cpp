@@ -0,0 +1,84 @@
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.hpp"
+
+MappedFile::MappedFile():
+	data_(NULL),
+	size_(0),
+	mapped_(false) {}
+
+MappedFile::~MappedFile(){
+	Close();
+}
+
+bool MappedFile::Open(const char * path, bool sequential){
+	Close();
+
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	if (fd < 0){
+		printf("Impossible to open %s\n", path);
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0){
+		printf("Impossible to open %s\n", path);
+		close(fd);
+		return false;
+	}
+	// Mapping an empty file fails, and there is nothing to map anyway
+	if (info.st_size > 0){
+		void * data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED){
+			if (sequential)
+				madvise(data, info.st_size, MADV_SEQUENTIAL);
+			data_ = (const unsigned char *)data;
+			size_ = info.st_size;
+			mapped_ = true;
+			close(fd);
+			return true;
+		}
+	}
+	close(fd);
+#else
+	(void)sequential;
+#endif
+
+	FILE * file = fopen(path, "rb");
+	if (file == NULL){
+		printf("Impossible to open %s\n", path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	fallback_.resize(size > 0 ? size : 0);
+	size_t read = fallback_.empty() ? 0 : fread(&fallback_[0], 1, fallback_.size(), file);
+	fclose(file);
+	if (read != fallback_.size()){
+		printf("Could not read %s\n", path);
+		fallback_.clear();
+		return false;
+	}
+	data_ = fallback_.empty() ? NULL : &fallback_[0];
+	size_ = fallback_.size();
+	return true;
+}
+
+void MappedFile::Close(){
+#ifndef _WIN32
+	if (mapped_)
+		munmap((void *)data_, size_);
+#endif
+	std::vector<unsigned char>().swap(fallback_);
+	data_ = NULL;
+	size_ = 0;
+	mapped_ = false;
+}
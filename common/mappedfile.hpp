@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <stddef.h>
+
+#include <vector>
+
+// Read-only view of a whole file. Memory-mapped where the platform allows it,
+// read into memory otherwise.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// sequential hints the OS that the file is read front to back once
+	bool Open(const char * path, bool sequential = true);
+	void Close();
+
+	const unsigned char * Data() const {
+		return data_;
+	}
+
+	size_t Size() const {
+		return size_;
+	}
+
+private:
+	const unsigned char * data_;
+	size_t size_;
+	bool mapped_;
+	std::vector<unsigned char> fallback_;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#include <algorithm>
+
+#include "memoryreport.hpp"
+
+void MemoryReport::Add(const std::string & asset, size_t cpu_bytes, size_t gpu_bytes){
+	Entry entry = { asset, cpu_bytes, gpu_bytes };
+	entries_.push_back(entry);
+}
+
+size_t MemoryReport::CpuBytes() const {
+	size_t total = 0;
+	for (const Entry & entry : entries_)
+		total += entry.cpu_bytes;
+	return total;
+}
+
+size_t MemoryReport::GpuBytes() const {
+	size_t total = 0;
+	for (const Entry & entry : entries_)
+		total += entry.gpu_bytes;
+	return total;
+}
+
+void MemoryReport::Print(FILE * out) const {
+	std::vector<Entry> sorted = entries_;
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Entry & a, const Entry & b){
+		return a.cpu_bytes + a.gpu_bytes > b.cpu_bytes + b.gpu_bytes;
+	});
+	fprintf(out, "%-40s %12s %12s\n", "asset", "cpu bytes", "gpu bytes");
+	for (const Entry & entry : sorted)
+		fprintf(out, "%-40s %12zu %12zu\n", entry.asset.c_str(), entry.cpu_bytes, entry.gpu_bytes);
+	fprintf(out, "%-40s %12zu %12zu\n", "total", CpuBytes(), GpuBytes());
+}
@@ -0,0 +1,32 @@
+#ifndef MEMORYREPORT_HPP
+#define MEMORYREPORT_HPP
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+// What each asset keeps resident, in system memory and in GPU buffers and
+// textures. The owners of assets add themselves, then Print() lists them
+// from the largest down with the totals.
+class MemoryReport {
+public:
+	void Add(const std::string & asset, size_t cpu_bytes, size_t gpu_bytes);
+
+	size_t CpuBytes() const;
+	size_t GpuBytes() const;
+
+	void Print(FILE * out = stdout) const;
+
+private:
+	struct Entry {
+		std::string asset;
+		size_t cpu_bytes;
+		size_t gpu_bytes;
+	};
+
+	std::vector<Entry> entries_;
+};
+
+#endif
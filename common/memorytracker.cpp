@@ -0,0 +1,332 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "memorytracker.hpp"
+
+static const char * const MemoryTagNames[MEMORY_TAG_COUNT] = {
+	"other", "renderer", "assets", "simulation", "ui"
+};
+
+static const char * const GpuResourceNames[] = { "buffer", "texture", "program" };
+
+const char * memoryTagName(MemoryTag tag){
+	return tag < MEMORY_TAG_COUNT ? MemoryTagNames[tag] : "?";
+}
+
+bool parseMemoryTag(const char * name, MemoryTag & tag){
+	for (int i = 0; i < MEMORY_TAG_COUNT; i++){
+		if (strcmp(name, MemoryTagNames[i]) == 0){
+			tag = (MemoryTag)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Everything operator new touches is zero-initialized static data, so it
+// works before main and while other statics are being constructed
+struct TagCounters {
+	std::atomic<size_t> live_bytes;
+	std::atomic<size_t> peak_bytes;
+	std::atomic<size_t> live_count;
+	std::atomic<size_t> allocations;
+	std::atomic<size_t> allocated_bytes;
+	std::atomic<size_t> budget;
+	std::atomic<bool> over_budget;
+};
+
+static TagCounters heap_counters[MEMORY_TAG_COUNT];
+static TagCounters gpu_counters[MEMORY_TAG_COUNT];
+
+// In front of every allocation; a multiple of 16 bytes, so what follows is
+// aligned like malloc's own result
+struct alignas(16) AllocationHeader {
+	AllocationHeader * previous; // in the leak list, when tracked
+	AllocationHeader * next;
+	const char * label;
+	size_t size;
+	uint32_t tag;
+	uint32_t tracked;
+};
+
+static std::atomic<bool> leak_tracking;
+static std::mutex leak_mutex;
+static AllocationHeader * leak_list;
+static size_t leak_list_size;
+
+static const double MiB = 1024.0 * 1024.0;
+
+static void addBytes(TagCounters & counters, MemoryTag tag, size_t bytes, const char * kind){
+	size_t live = counters.live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	size_t peak = counters.peak_bytes.load(std::memory_order_relaxed);
+	while (live > peak && !counters.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)){
+	}
+
+	// Once per crossing, not on every allocation past the budget
+	size_t budget = counters.budget.load(std::memory_order_relaxed);
+	if (budget != 0 && live > budget && !counters.over_budget.exchange(true, std::memory_order_relaxed))
+		fprintf(stderr, "Memory: %s is over its %s budget, %.2f MiB of %.2f MiB\n", memoryTagName(tag), kind,
+		        live / MiB, budget / MiB);
+}
+
+static void removeBytes(TagCounters & counters, size_t bytes){
+	size_t live = counters.live_bytes.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+	size_t budget = counters.budget.load(std::memory_order_relaxed);
+	if (budget != 0 && live <= budget && counters.over_budget.load(std::memory_order_relaxed))
+		counters.over_budget.store(false, std::memory_order_relaxed);
+}
+
+MemoryTracker & MemoryTracker::Instance(){
+	static MemoryTracker tracker;
+	return tracker;
+}
+
+void * MemoryTracker::Allocate(size_t size){
+	AllocationHeader * header = (AllocationHeader *)malloc(sizeof(AllocationHeader) + size);
+	if (header == NULL)
+		return NULL;
+	MemoryTag tag = MemoryScope::CurrentTag();
+	header->previous = NULL;
+	header->next = NULL;
+	header->label = MemoryScope::CurrentLabel();
+	header->size = size;
+	header->tag = tag;
+	header->tracked = 0;
+
+	if (leak_tracking.load(std::memory_order_relaxed)){
+		std::lock_guard<std::mutex> lock(leak_mutex);
+		header->next = leak_list;
+		if (leak_list)
+			leak_list->previous = header;
+		leak_list = header;
+		leak_list_size++;
+		header->tracked = 1;
+	}
+
+	TagCounters & counters = heap_counters[tag];
+	counters.live_count.fetch_add(1, std::memory_order_relaxed);
+	counters.allocations.fetch_add(1, std::memory_order_relaxed);
+	counters.allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	addBytes(counters, tag, size, "heap");
+	return header + 1;
+}
+
+void MemoryTracker::Free(void * pointer){
+	if (pointer == NULL)
+		return;
+	AllocationHeader * header = (AllocationHeader *)pointer - 1;
+
+	if (header->tracked){
+		std::lock_guard<std::mutex> lock(leak_mutex);
+		if (header->previous)
+			header->previous->next = header->next;
+		else
+			leak_list = header->next;
+		if (header->next)
+			header->next->previous = header->previous;
+		leak_list_size--;
+	}
+
+	TagCounters & counters = heap_counters[header->tag];
+	counters.live_count.fetch_sub(1, std::memory_order_relaxed);
+	removeBytes(counters, header->size);
+	free(header);
+}
+
+void MemoryTracker::EnableLeakTracking(){
+	leak_tracking.store(true, std::memory_order_relaxed);
+}
+
+void MemoryTracker::SetBudget(MemoryTag tag, size_t budget, size_t gpu_budget){
+	heap_counters[tag].budget.store(budget, std::memory_order_relaxed);
+	gpu_counters[tag].budget.store(gpu_budget, std::memory_order_relaxed);
+}
+
+void MemoryTracker::TrackGpu(GpuResourceKind kind, unsigned int name, size_t bytes){
+	std::lock_guard<std::mutex> lock(gpu_mutex_);
+	auto found = gpu_resources_.find(std::make_pair((int)kind, name));
+	if (found == gpu_resources_.end()){
+		GpuResource resource = { MemoryScope::CurrentTag(), MemoryScope::CurrentLabel(), bytes };
+		gpu_resources_[std::make_pair((int)kind, name)] = resource;
+		TagCounters & counters = gpu_counters[resource.tag];
+		counters.live_count.fetch_add(1, std::memory_order_relaxed);
+		counters.allocations.fetch_add(1, std::memory_order_relaxed);
+		addBytes(counters, resource.tag, bytes, "GPU");
+		return;
+	}
+
+	// A resize stays with the tag the object was created under
+	GpuResource & resource = found->second;
+	if (bytes > resource.bytes)
+		addBytes(gpu_counters[resource.tag], resource.tag, bytes - resource.bytes, "GPU");
+	else
+		removeBytes(gpu_counters[resource.tag], resource.bytes - bytes);
+	resource.bytes = bytes;
+}
+
+void MemoryTracker::UntrackGpu(GpuResourceKind kind, unsigned int name){
+	std::lock_guard<std::mutex> lock(gpu_mutex_);
+	auto found = gpu_resources_.find(std::make_pair((int)kind, name));
+	if (found == gpu_resources_.end())
+		return;
+	TagCounters & counters = gpu_counters[found->second.tag];
+	counters.live_count.fetch_sub(1, std::memory_order_relaxed);
+	removeBytes(counters, found->second.bytes);
+	gpu_resources_.erase(found);
+}
+
+MemoryTagStats MemoryTracker::Stats(MemoryTag tag){
+	const TagCounters & heap = heap_counters[tag];
+	const TagCounters & gpu = gpu_counters[tag];
+	MemoryTagStats stats;
+	stats.live_bytes = heap.live_bytes.load(std::memory_order_relaxed);
+	stats.peak_bytes = heap.peak_bytes.load(std::memory_order_relaxed);
+	stats.live_count = heap.live_count.load(std::memory_order_relaxed);
+	stats.allocations = heap.allocations.load(std::memory_order_relaxed);
+	stats.allocated_bytes = heap.allocated_bytes.load(std::memory_order_relaxed);
+	stats.gpu_live_bytes = gpu.live_bytes.load(std::memory_order_relaxed);
+	stats.gpu_peak_bytes = gpu.peak_bytes.load(std::memory_order_relaxed);
+	stats.gpu_live_count = gpu.live_count.load(std::memory_order_relaxed);
+	stats.budget = heap.budget.load(std::memory_order_relaxed);
+	stats.gpu_budget = gpu.budget.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void MemoryTracker::Report(FILE * out){
+	fprintf(out, "%-12s %12s %12s %12s %10s %12s %12s %10s\n", "memory", "heap live", "heap peak", "allocations",
+	        "budget MiB", "gpu live", "gpu peak", "budget MiB");
+	for (int i = 0; i < MEMORY_TAG_COUNT; i++){
+		MemoryTagStats stats = Stats((MemoryTag)i);
+		fprintf(out, "%-12s %12zu %12zu %12zu %10.1f %12zu %12zu %10.1f\n", memoryTagName((MemoryTag)i),
+		        stats.live_bytes, stats.peak_bytes, stats.allocations, stats.budget / MiB,
+		        stats.gpu_live_bytes, stats.gpu_peak_bytes, stats.gpu_budget / MiB);
+	}
+}
+
+void MemoryTracker::DumpLeaks(FILE * out){
+	// Libraries and statics allocate outside any scope and keep it until
+	// exit, so only the subsystems are expected to be empty by now
+	bool clean = true;
+	for (int i = MEMORY_OTHER + 1; i < MEMORY_TAG_COUNT; i++){
+		MemoryTagStats stats = Stats((MemoryTag)i);
+		if (stats.live_count == 0 && stats.gpu_live_count == 0)
+			continue;
+		fprintf(out, "Leaked by %s: %zu allocations, %zu bytes; %zu GL objects, %zu bytes\n",
+		        memoryTagName((MemoryTag)i), stats.live_count, stats.live_bytes, stats.gpu_live_count,
+		        stats.gpu_live_bytes);
+		clean = false;
+	}
+
+	if (leak_tracking.load(std::memory_order_relaxed)){
+		struct Leak {
+			uint32_t tag;
+			const char * label;
+			size_t size;
+		};
+		// Allocating under leak_mutex would deadlock, so room is made first
+		// and the list copied into it; the copy's own block is skipped
+		size_t room;
+		{
+			std::lock_guard<std::mutex> lock(leak_mutex);
+			room = leak_list_size + 64;
+		}
+		std::vector<Leak> leaks;
+		leaks.reserve(room);
+		{
+			std::lock_guard<std::mutex> lock(leak_mutex);
+			for (AllocationHeader * header = leak_list; header && leaks.size() < room; header = header->next){
+				if (header->tag == MEMORY_OTHER || (void *)(header + 1) == (void *)leaks.data())
+					continue;
+				Leak leak = { header->tag, header->label, header->size };
+				leaks.push_back(leak);
+			}
+		}
+
+		// Grouped by tag and label, largest first
+		std::map<std::pair<uint32_t, std::string>, std::pair<size_t, size_t>> groups;
+		for (const Leak & leak : leaks){
+			std::pair<size_t, size_t> & group = groups[std::make_pair(leak.tag, std::string(leak.label))];
+			group.first++;
+			group.second += leak.size;
+		}
+		std::vector<std::pair<std::pair<uint32_t, std::string>, std::pair<size_t, size_t>>> sorted(
+			groups.begin(), groups.end());
+		std::stable_sort(sorted.begin(), sorted.end(), [](const decltype(sorted)::value_type & a,
+		                                                  const decltype(sorted)::value_type & b){
+			return a.second.second > b.second.second;
+		});
+		for (const auto & group : sorted)
+			fprintf(out, "  %s, %s: %zu allocations, %zu bytes\n", memoryTagName((MemoryTag)group.first.first),
+			        group.first.second.c_str(), group.second.first, group.second.second);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(gpu_mutex_);
+		for (const auto & entry : gpu_resources_){
+			if (entry.second.tag == MEMORY_OTHER)
+				continue;
+			fprintf(out, "  %s, %s: GL %s %u, %zu bytes\n", memoryTagName(entry.second.tag), entry.second.label,
+			        GpuResourceNames[entry.first.first], entry.first.second, entry.second.bytes);
+		}
+	}
+
+	if (clean)
+		fprintf(out, "No leaks: every subsystem freed its memory and GL objects\n");
+}
+
+// The global allocation functions, so every new and delete of the program
+// is accounted, standard containers included. The array and nothrow forms
+// would forward to these anyway; they are replaced too so no library
+// implementation can pair one of ours with one of its own.
+void * operator new(size_t size){
+	void * pointer = MemoryTracker::Allocate(size);
+	if (pointer == NULL)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void * operator new[](size_t size){
+	void * pointer = MemoryTracker::Allocate(size);
+	if (pointer == NULL)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept {
+	return MemoryTracker::Allocate(size);
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return MemoryTracker::Allocate(size);
+}
+
+void operator delete(void * pointer) noexcept {
+	MemoryTracker::Free(pointer);
+}
+
+void operator delete[](void * pointer) noexcept {
+	MemoryTracker::Free(pointer);
+}
+
+void operator delete(void * pointer, size_t) noexcept {
+	MemoryTracker::Free(pointer);
+}
+
+void operator delete[](void * pointer, size_t) noexcept {
+	MemoryTracker::Free(pointer);
+}
+
+void operator delete(void * pointer, const std::nothrow_t &) noexcept {
+	MemoryTracker::Free(pointer);
+}
+
+void operator delete[](void * pointer, const std::nothrow_t &) noexcept {
+	MemoryTracker::Free(pointer);
+}
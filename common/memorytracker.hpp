@@ -0,0 +1,133 @@
+#ifndef MEMORYTRACKER_HPP
+#define MEMORYTRACKER_HPP
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <map>
+#include <mutex>
+#include <utility>
+
+// The subsystems memory is accounted to. Allocations made outside any
+// MemoryScope, by libraries or before main, go to MEMORY_OTHER.
+enum MemoryTag {
+	MEMORY_OTHER,
+	MEMORY_RENDERER,
+	MEMORY_ASSETS,
+	MEMORY_SIMULATION,
+	MEMORY_UI,
+	MEMORY_TAG_COUNT
+};
+
+const char * memoryTagName(MemoryTag tag);
+
+// False for names that are not a tag
+bool parseMemoryTag(const char * name, MemoryTag & tag);
+
+// Every operator new on this thread is accounted to tag until the scope
+// ends; scopes nest. The label names the allocations in the leak dump, so it
+// must be a string literal or otherwise outlive them.
+class MemoryScope {
+public:
+	MemoryScope(MemoryTag tag, const char * label):
+		previous_tag_(current_tag),
+		previous_label_(current_label)
+	{
+		current_tag = tag;
+		current_label = label;
+	}
+
+	~MemoryScope(){
+		current_tag = previous_tag_;
+		current_label = previous_label_;
+	}
+
+	MemoryScope(const MemoryScope&) = delete;
+	MemoryScope& operator=(const MemoryScope&) = delete;
+
+	static MemoryTag CurrentTag(){
+		return current_tag;
+	}
+
+	static const char * CurrentLabel(){
+		return current_label;
+	}
+
+private:
+	// Plain thread locals, so operator new can read them at any time
+	static inline thread_local MemoryTag current_tag = MEMORY_OTHER;
+	static inline thread_local const char * current_label = "untagged";
+
+	MemoryTag previous_tag_;
+	const char * previous_label_;
+};
+
+enum GpuResourceKind {
+	GPU_BUFFER,
+	GPU_TEXTURE,
+	GPU_PROGRAM
+};
+
+struct MemoryTagStats {
+	size_t live_bytes;
+	size_t peak_bytes;
+	size_t live_count;
+	size_t allocations;     // since startup
+	size_t allocated_bytes; // since startup
+	size_t gpu_live_bytes;
+	size_t gpu_peak_bytes;
+	size_t gpu_live_count;
+	size_t budget;          // 0 is no budget
+	size_t gpu_budget;
+};
+
+// Accounts every heap allocation of the program, through the global
+// operator new and delete in memorytracker.cpp, to the tag of the scope it
+// was made in, and the GL objects the renderer and loaders register to the
+// tag they were created under. Warns once on stderr whenever a tag goes
+// over its budget. Safe to use from any thread.
+class MemoryTracker {
+public:
+	static MemoryTracker & Instance();
+
+	// Backs operator new and delete; nothing else should call them
+	static void * Allocate(size_t size);
+	static void Free(void * pointer);
+
+	// Also keeps a list of the live allocations from now on, for DumpLeaks().
+	// Costs a lock per allocation, so it is off unless asked for.
+	void EnableLeakTracking();
+
+	// In bytes, 0 for no budget
+	void SetBudget(MemoryTag tag, size_t budget, size_t gpu_budget);
+
+	// Registers or resizes a GL object under the current scope's tag. The
+	// size is what the object holds (buffer data, texels with their mipmaps,
+	// program binary), not what the driver may add around it.
+	void TrackGpu(GpuResourceKind kind, unsigned int name, size_t bytes);
+	void UntrackGpu(GpuResourceKind kind, unsigned int name);
+
+	MemoryTagStats Stats(MemoryTag tag);
+
+	// One line per tag: live, peak and budget, on the heap and on the GPU
+	void Report(FILE * out = stdout);
+
+	// For shutdown, once everything has been freed: what every tag still
+	// holds, grouped by scope label when leak tracking is on, and the GL
+	// objects that were never deleted
+	void DumpLeaks(FILE * out = stdout);
+
+private:
+	MemoryTracker() {}
+
+	struct GpuResource {
+		MemoryTag tag;
+		const char * label;
+		size_t bytes;
+	};
+
+	std::mutex gpu_mutex_;
+	std::map<std::pair<int, unsigned int>, GpuResource> gpu_resources_;
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+
+#include "assetpack.hpp"
+#include "mappedfile.hpp"
+#include "meshcache.hpp"
+#include "meshoptimizer.hpp"
+#include "meshsimplify.hpp"
+#include "objloader.hpp"
+#include "snapshot.hpp"
+
+struct MeshCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t vertex_count;
+	uint64_t source_stamp;
+	uint32_t uv_count;
+	uint32_t normal_count;
+	uint32_t index_count;
+	uint32_t lod_count;
+};
+
+// Follows the full mesh's arrays once per LOD, then its indices
+struct MeshCacheLod {
+	uint32_t index_count;
+	float error;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 40, "MeshCacheHeader layout changed");
+
+static const char MeshCacheMagic[4] = { 'S', 'H', 'M', 'C' };
+static const uint32_t MeshCacheByteOrder = 0x01020304u;
+
+uint64_t meshSourceStamp(const char * path){
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return 0;
+	return ((uint64_t)info.st_mtime << 32) ^ (uint64_t)info.st_size;
+}
+
+void serializeMeshCache(const MeshData & mesh, uint64_t source_stamp, std::vector<unsigned char> & out){
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MeshCacheMagic, 4);
+	header.version = MESH_CACHE_VERSION;
+	header.byte_order = MeshCacheByteOrder;
+	header.source_stamp = source_stamp;
+	header.vertex_count = mesh.vertices.size();
+	header.uv_count = mesh.uvs.size();
+	header.normal_count = mesh.normals.size();
+	header.index_count = mesh.indices.size();
+	header.lod_count = mesh.lods.size();
+
+	size_t vertices_size = mesh.vertices.size() * sizeof(glm::vec3);
+	size_t uvs_size = mesh.uvs.size() * sizeof(glm::vec2);
+	size_t normals_size = mesh.normals.size() * sizeof(glm::vec3);
+	size_t indices_size = mesh.indices.size() * sizeof(unsigned int);
+	size_t lods_size = 0;
+	for (const MeshLod & lod : mesh.lods)
+		lods_size += sizeof(MeshCacheLod) + lod.indices.size() * sizeof(unsigned int);
+
+	out.assign(sizeof(header) + vertices_size + uvs_size + normals_size + indices_size + lods_size, 0);
+	unsigned char * cursor = &out[0];
+	memcpy(cursor, &header, sizeof(header));
+	cursor += sizeof(header);
+	if (vertices_size > 0)
+		memcpy(cursor, mesh.vertices.data(), vertices_size);
+	cursor += vertices_size;
+	if (uvs_size > 0)
+		memcpy(cursor, mesh.uvs.data(), uvs_size);
+	cursor += uvs_size;
+	if (normals_size > 0)
+		memcpy(cursor, mesh.normals.data(), normals_size);
+	cursor += normals_size;
+	if (indices_size > 0)
+		memcpy(cursor, mesh.indices.data(), indices_size);
+	cursor += indices_size;
+	for (const MeshLod & lod : mesh.lods){
+		MeshCacheLod lod_header = { (uint32_t)lod.indices.size(), lod.error };
+		memcpy(cursor, &lod_header, sizeof(lod_header));
+		cursor += sizeof(lod_header);
+		if (!lod.indices.empty())
+			memcpy(cursor, lod.indices.data(), lod.indices.size() * sizeof(unsigned int));
+		cursor += lod.indices.size() * sizeof(unsigned int);
+	}
+}
+
+bool saveMeshCache(const char * cache_path, const MeshData & mesh, uint64_t source_stamp){
+	std::vector<unsigned char> out;
+	serializeMeshCache(mesh, source_stamp, out);
+	return writeFileAtomically(cache_path, out.data(), out.size());
+}
+
+template<typename T>
+static void readArray(const unsigned char *& cursor, uint32_t count, std::vector<T> & out){
+	out.resize(count);
+	if (count > 0)
+		memcpy(out.data(), cursor, count * sizeof(T));
+	cursor += count * sizeof(T);
+}
+
+bool parseMeshCache(const unsigned char * data, size_t size, const char * cache_path, uint64_t source_stamp,
+                    MeshData & mesh){
+
+	MeshCacheHeader header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, MeshCacheMagic, 4) != 0 || header.version != MESH_CACHE_VERSION ||
+	    header.byte_order != MeshCacheByteOrder || header.source_stamp != source_stamp)
+		return false;
+
+	// Counts are checked against the file size before anything is copied
+	uint64_t expected = sizeof(header) +
+		(uint64_t)header.vertex_count * sizeof(glm::vec3) +
+		(uint64_t)header.uv_count * sizeof(glm::vec2) +
+		(uint64_t)header.normal_count * sizeof(glm::vec3) +
+		(uint64_t)header.index_count * sizeof(unsigned int);
+	if (expected > size){
+		printf("%s is damaged, ignoring it\n", cache_path);
+		return false;
+	}
+
+	// The LODs' sizes are in their own headers, each checked before it is read
+	const unsigned char * lod_cursor = data + expected;
+	for (uint32_t i = 0; i < header.lod_count; i++){
+		MeshCacheLod lod_header;
+		if (expected + sizeof(lod_header) > size)
+			break;
+		memcpy(&lod_header, lod_cursor, sizeof(lod_header));
+		expected += sizeof(lod_header) + (uint64_t)lod_header.index_count * sizeof(unsigned int);
+		lod_cursor = data + std::min<uint64_t>(expected, size);
+	}
+	if (expected != size){
+		printf("%s is damaged, ignoring it\n", cache_path);
+		return false;
+	}
+	if ((header.uv_count != 0 && header.uv_count != header.vertex_count) ||
+	    (header.normal_count != 0 && header.normal_count != header.vertex_count)){
+		printf("%s is damaged, ignoring it\n", cache_path);
+		return false;
+	}
+
+	const unsigned char * cursor = data + sizeof(header);
+	readArray(cursor, header.vertex_count, mesh.vertices);
+	readArray(cursor, header.uv_count, mesh.uvs);
+	readArray(cursor, header.normal_count, mesh.normals);
+	readArray(cursor, header.index_count, mesh.indices);
+	mesh.lods.resize(header.lod_count);
+	for (MeshLod & lod : mesh.lods){
+		MeshCacheLod lod_header;
+		memcpy(&lod_header, cursor, sizeof(lod_header));
+		cursor += sizeof(lod_header);
+		lod.error = lod_header.error;
+		readArray(cursor, lod_header.index_count, lod.indices);
+	}
+
+	bool valid = true;
+	for (unsigned int index : mesh.indices)
+		valid = valid && index < header.vertex_count;
+	for (const MeshLod & lod : mesh.lods){
+		for (unsigned int index : lod.indices)
+			valid = valid && index < header.vertex_count;
+	}
+	if (!valid){
+		printf("%s is damaged, ignoring it\n", cache_path);
+		return false;
+	}
+	return true;
+}
+
+bool loadMeshCache(const char * cache_path, uint64_t source_stamp, MeshData & mesh){
+	// No cache yet is the normal first run, not worth a message
+	if (meshSourceStamp(cache_path) == 0)
+		return false;
+	MappedFile file;
+	if (!file.Open(cache_path))
+		return false;
+	return parseMeshCache(file.Data(), file.Size(), cache_path, source_stamp, mesh);
+}
+
+bool loadMesh(const char * path, MeshData & mesh){
+
+	std::string cache_path = std::string(path) + ".meshcache";
+
+	// A packed cache was cooked with the pack and is used as it is
+	AssetVfs & vfs = AssetVfs::Instance();
+	if (vfs.IsPacked(cache_path.c_str())){
+		AssetData packed;
+		if (vfs.Open(cache_path.c_str(), packed) &&
+		    parseMeshCache(packed.Data(), packed.Size(), cache_path.c_str(), 0, mesh))
+			return true;
+	}
+
+	uint64_t stamp = meshSourceStamp(path);
+	if (stamp != 0 && loadMeshCache(cache_path.c_str(), stamp, mesh))
+		return true;
+
+	if (!cookMesh(path, mesh))
+		return false;
+
+	// A cache that cannot be written only costs the next run the import
+	if (stamp != 0)
+		saveMeshCache(cache_path.c_str(), mesh, stamp);
+	return true;
+}
+
+bool cookMesh(const char * path, MeshData & mesh){
+
+	mesh = MeshData();
+#ifdef USE_ASSIMP
+	if (!loadAssImp(path, mesh.indices, mesh.vertices, mesh.uvs, mesh.normals))
+		return false;
+#else
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	if (!loadOBJ(path, vertices, uvs, normals))
+		return false;
+	indexMesh(vertices, uvs, normals, mesh.indices, mesh.vertices, mesh.uvs, mesh.normals);
+#endif
+	optimizeMesh(mesh, path);
+
+	// The LODs index the optimized vertices, so they come last
+	const float ratios[] = MESH_LOD_RATIOS;
+	buildMeshLods(mesh, std::vector<float>(ratios, ratios + sizeof(ratios) / sizeof(ratios[0])));
+	for (size_t i = 0; i < mesh.lods.size(); i++)
+		printf("LOD %zu of %s: %zu triangles, error %.4f\n", i + 1, path, mesh.lods[i].indices.size() / 3,
+		       mesh.lods[i].error);
+	return true;
+}
@@ -0,0 +1,54 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#define MESH_CACHE_VERSION 3
+
+// A coarser version of a mesh over the same vertices, see buildMeshLods()
+struct MeshLod {
+	std::vector<unsigned int> indices;
+	float error; // how far it strays from the full mesh, relative to the mesh's extent
+};
+
+// An indexed triangle mesh, as the importers produce it and the cache stores it.
+// uvs and normals are either empty or one per vertex. lods go from fine to
+// coarse and may be empty.
+struct MeshData {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<unsigned int> indices;
+	std::vector<MeshLod> lods;
+};
+
+// Size and modification time of the source file, 0 if it cannot be read
+uint64_t meshSourceStamp(const char * path);
+
+// Cache files are a header and the raw arrays in host byte order; they are
+// derived data, so a file from another host or version is just a miss.
+// Caches cooked into an asset pack have a source_stamp of 0.
+void serializeMeshCache(const MeshData & mesh, uint64_t source_stamp, std::vector<unsigned char> & out);
+bool saveMeshCache(const char * cache_path, const MeshData & mesh, uint64_t source_stamp);
+
+// False if the data is stale for source_stamp or damaged; cache_path is only for messages
+bool parseMeshCache(const unsigned char * data, size_t size, const char * cache_path, uint64_t source_stamp,
+                    MeshData & mesh);
+bool loadMeshCache(const char * cache_path, uint64_t source_stamp, MeshData & mesh);
+
+// Reads path through "<path>.meshcache", from the asset pack if it has one
+// and next to the source otherwise: a hit is a few memcpys, a miss imports
+// the model (with assimp when built with USE_ASSIMP, loadOBJ and indexMesh
+// otherwise), cooks it with cookMesh() and writes the cache for the next run.
+bool loadMesh(const char * path, MeshData & mesh);
+
+// What a cache holds: the model imported, optimized for the GPU and with its
+// LOD chain. Slow; the packer runs it ahead of time.
+bool cookMesh(const char * path, MeshData & mesh);
+
+#endif
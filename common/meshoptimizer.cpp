@@ -0,0 +1,387 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
+#include "assetid.hpp"
+#include "meshoptimizer.hpp"
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> & indices, size_t vertex_count,
+                                    size_t cache_size){
+	std::deque<unsigned int> cache;
+	std::vector<bool> cached(vertex_count, false);
+	size_t misses = 0;
+	for (unsigned int index : indices){
+		if (cached[index])
+			continue;
+		misses++;
+		cache.push_back(index);
+		cached[index] = true;
+		if (cache.size() > cache_size){
+			cached[cache.front()] = false;
+			cache.pop_front();
+		}
+	}
+	VertexCacheStats stats = { 0.0, 0.0 };
+	if (indices.size() >= 3 && vertex_count > 0){
+		stats.acmr = double(misses) / (indices.size() / 3);
+		stats.atvr = double(misses) / vertex_count;
+	}
+	return stats;
+}
+
+// Side of the square the overdraw is measured on, per view
+static const int OverdrawGrid = 256;
+
+double analyzeOverdraw(const std::vector<glm::vec3> & vertices, const std::vector<unsigned int> & indices){
+	if (vertices.empty() || indices.size() < 3)
+		return 0.0;
+
+	glm::vec3 low = vertices[0];
+	glm::vec3 high = vertices[0];
+	for (const glm::vec3 & vertex : vertices){
+		low = glm::min(low, vertex);
+		high = glm::max(high, vertex);
+	}
+	float extent = std::max(std::max(high.x - low.x, high.y - low.y), high.z - low.z);
+	float scale = extent > 0.0f ? (OverdrawGrid - 1) / extent : 0.0f;
+
+	std::vector<float> depth(OverdrawGrid * OverdrawGrid);
+	size_t covered = 0;
+	size_t shaded = 0;
+
+	for (int axis = 0; axis < 3; axis++){
+		for (int side = 0; side < 2; side++){
+			std::fill(depth.begin(), depth.end(), 1e30f);
+
+			for (size_t i = 0; i + 2 < indices.size(); i += 3){
+				// Screen x and y are the other two axes in cyclic order, so a
+				// counter-clockwise triangle faces a viewer on the positive side.
+				// From the negative side x is mirrored and depth reversed.
+				glm::vec3 p[3];
+				for (int corner = 0; corner < 3; corner++){
+					glm::vec3 v = (vertices[indices[i + corner]] - low) * scale;
+					float x = v[(axis + 1) % 3];
+					float y = v[(axis + 2) % 3];
+					float z = v[axis];
+					p[corner] = side == 0 ? glm::vec3(x, y, -z) : glm::vec3(OverdrawGrid - 1 - x, y, z);
+				}
+
+				float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+				if (area <= 0.0f)
+					continue;
+
+				int min_x = std::max(0, (int)floorf(std::min(std::min(p[0].x, p[1].x), p[2].x)));
+				int max_x = std::min(OverdrawGrid - 1, (int)ceilf(std::max(std::max(p[0].x, p[1].x), p[2].x)));
+				int min_y = std::max(0, (int)floorf(std::min(std::min(p[0].y, p[1].y), p[2].y)));
+				int max_y = std::min(OverdrawGrid - 1, (int)ceilf(std::max(std::max(p[0].y, p[1].y), p[2].y)));
+
+				for (int y = min_y; y <= max_y; y++){
+					for (int x = min_x; x <= max_x; x++){
+						// Barycentric weights of the pixel centre
+						float px = x + 0.5f;
+						float py = y + 0.5f;
+						float w0 = (p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x);
+						float w1 = (p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x);
+						float w2 = (p[1].x - p[0].x) * (py - p[0].y) - (p[1].y - p[0].y) * (px - p[0].x);
+						if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+							continue;
+
+						float z = (w0 * p[0].z + w1 * p[1].z + w2 * p[2].z) / area;
+						float & stored = depth[y * OverdrawGrid + x];
+						if (z >= stored)
+							continue;
+						if (stored == 1e30f)
+							covered++;
+						stored = z;
+						shaded++;
+					}
+				}
+			}
+		}
+	}
+	return covered > 0 ? double(shaded) / covered : 0.0;
+}
+
+void deduplicateVertices(MeshData & mesh){
+	struct Vertex {
+		glm::vec3 position;
+		glm::vec2 uv;
+		glm::vec3 normal;
+	};
+	struct VertexHash {
+		size_t operator()(const Vertex & vertex) const {
+			return (size_t)hashBytes(&vertex, sizeof(Vertex));
+		}
+	};
+	struct VertexEqual {
+		bool operator()(const Vertex & a, const Vertex & b) const {
+			return memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+	std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> known;
+
+	std::vector<unsigned int> remap(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); i++){
+		// Floats without padding, like the corners indexMesh merges
+		Vertex vertex = { mesh.vertices[i], glm::vec2(0.0f), glm::vec3(0.0f) };
+		if (!mesh.uvs.empty())
+			vertex.uv = mesh.uvs[i];
+		if (!mesh.normals.empty())
+			vertex.normal = mesh.normals[i];
+		remap[i] = known.insert(std::make_pair(vertex, (unsigned int)i)).first->second;
+	}
+	for (unsigned int & index : mesh.indices)
+		index = remap[index];
+	// The duplicates are now unused and optimizeVertexFetch drops them
+}
+
+void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertex_count, size_t cache_size,
+                         std::vector<size_t> * clusters){
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return;
+
+	// Triangles around each vertex, as offsets into one array
+	std::vector<unsigned int> live(vertex_count, 0);
+	for (size_t i = 0; i < triangle_count * 3; i++)
+		live[indices[i]]++;
+	std::vector<size_t> first_triangle(vertex_count + 1, 0);
+	for (size_t v = 0; v < vertex_count; v++)
+		first_triangle[v + 1] = first_triangle[v] + live[v];
+	std::vector<unsigned int> adjacency(triangle_count * 3);
+	std::vector<size_t> filled(first_triangle.begin(), first_triangle.end() - 1);
+	for (size_t i = 0; i < triangle_count * 3; i++)
+		adjacency[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<unsigned int> output;
+	output.reserve(triangle_count * 3);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<size_t> cache_time(vertex_count, 0);
+	std::vector<unsigned int> dead_ends;
+	std::vector<unsigned int> candidates;
+	size_t time = cache_size + 1;
+	size_t cursor = 0;
+
+	// From the first vertex that has triangles
+	auto next_by_cursor = [&]() -> long {
+		while (cursor < vertex_count){
+			if (live[cursor] > 0)
+				return (long)cursor;
+			cursor++;
+		}
+		return -1;
+	};
+
+	long fan = next_by_cursor();
+	bool missed = true;
+	while (fan >= 0){
+		if (missed && clusters)
+			clusters->push_back(output.size() / 3);
+
+		candidates.clear();
+		for (size_t a = first_triangle[fan]; a < first_triangle[fan + 1]; a++){
+			unsigned int triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = true;
+			for (int corner = 0; corner < 3; corner++){
+				unsigned int v = indices[triangle * 3 + corner];
+				output.push_back(v);
+				dead_ends.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cache_time[v] > cache_size){
+					cache_time[v] = time;
+					time++;
+				}
+			}
+		}
+
+		// The candidate still in the cache after its own fan that entered it
+		// the earliest, so its fan uses what would be evicted next
+		long next = -1;
+		long best = -1;
+		for (unsigned int v : candidates){
+			if (live[v] == 0)
+				continue;
+			long priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size)
+				priority = (long)(time - cache_time[v]);
+			if (priority > best){
+				best = priority;
+				next = v;
+			}
+		}
+
+		// Dead end: back to a recently used vertex, or on to the next unused one
+		missed = false;
+		while (next < 0 && !dead_ends.empty()){
+			unsigned int v = dead_ends.back();
+			dead_ends.pop_back();
+			if (live[v] > 0)
+				next = v;
+		}
+		if (next < 0){
+			next = next_by_cursor();
+			missed = true;
+		}
+		fan = next;
+	}
+
+	indices.swap(output);
+}
+
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices,
+                      const std::vector<size_t> & clusters, size_t cache_size, float threshold){
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0 || clusters.empty())
+		return;
+
+	// Soft boundaries: a cluster may end wherever its own ACMR, starting
+	// from a cold cache, is already as good as the mesh as a whole
+	double target_acmr = analyzeVertexCache(indices, vertices.size(), cache_size).acmr * threshold;
+	std::vector<size_t> starts;
+	std::deque<unsigned int> cache;
+	std::vector<bool> cached(vertices.size(), false);
+	size_t next_hard = 0;
+	size_t misses = 0;
+	size_t cluster_start = 0;
+	for (size_t t = 0; t < triangle_count; t++){
+		bool hard = next_hard < clusters.size() && clusters[next_hard] == t;
+		if (hard)
+			next_hard++;
+		bool soft = t > cluster_start && double(misses) / (t - cluster_start) <= target_acmr;
+		if (t == 0 || hard || soft){
+			starts.push_back(t);
+			cluster_start = t;
+			misses = 0;
+			for (unsigned int v : cache)
+				cached[v] = false;
+			cache.clear();
+		}
+		for (int corner = 0; corner < 3; corner++){
+			unsigned int v = indices[t * 3 + corner];
+			if (cached[v])
+				continue;
+			misses++;
+			cache.push_back(v);
+			cached[v] = true;
+			if (cache.size() > cache_size){
+				cached[cache.front()] = false;
+				cache.pop_front();
+			}
+		}
+	}
+	starts.push_back(triangle_count);
+
+	// Area weighted centroid and normal of every cluster and of the mesh
+	struct Cluster {
+		size_t first;
+		size_t last;
+		glm::vec3 centroid;
+		glm::vec3 normal;
+		float sort_key;
+	};
+	std::vector<Cluster> sorted(starts.size() - 1);
+	glm::vec3 mesh_centroid(0.0f);
+	float mesh_area = 0.0f;
+	for (size_t i = 0; i + 1 < starts.size(); i++){
+		Cluster & cluster = sorted[i];
+		cluster.first = starts[i];
+		cluster.last = starts[i + 1];
+		cluster.centroid = glm::vec3(0.0f);
+		cluster.normal = glm::vec3(0.0f);
+		float area = 0.0f;
+		for (size_t t = cluster.first; t < cluster.last; t++){
+			const glm::vec3 & a = vertices[indices[t * 3]];
+			const glm::vec3 & b = vertices[indices[t * 3 + 1]];
+			const glm::vec3 & c = vertices[indices[t * 3 + 2]];
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float triangle_area = glm::length(normal);
+			cluster.centroid += (a + b + c) * (triangle_area / 3.0f);
+			cluster.normal += normal;
+			area += triangle_area;
+		}
+		mesh_centroid += cluster.centroid;
+		mesh_area += area;
+		if (area > 0.0f)
+			cluster.centroid /= area;
+		float length = glm::length(cluster.normal);
+		if (length > 0.0f)
+			cluster.normal /= length;
+	}
+	if (mesh_area > 0.0f)
+		mesh_centroid /= mesh_area;
+
+	// Clusters far out along their normal occlude the rest from most viewpoints
+	for (Cluster & cluster : sorted)
+		cluster.sort_key = glm::dot(cluster.centroid - mesh_centroid, cluster.normal);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster & a, const Cluster & b){
+		return a.sort_key > b.sort_key;
+	});
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (const Cluster & cluster : sorted)
+		output.insert(output.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+	indices.swap(output);
+}
+
+void optimizeVertexFetch(MeshData & mesh){
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(mesh.vertices.size(), unused);
+	unsigned int vertex_count = 0;
+	for (unsigned int & index : mesh.indices){
+		if (remap[index] == unused)
+			remap[index] = vertex_count++;
+		index = remap[index];
+	}
+
+	MeshData fetched;
+	fetched.vertices.resize(vertex_count);
+	if (!mesh.uvs.empty())
+		fetched.uvs.resize(vertex_count);
+	if (!mesh.normals.empty())
+		fetched.normals.resize(vertex_count);
+	for (size_t i = 0; i < remap.size(); i++){
+		if (remap[i] == unused)
+			continue;
+		fetched.vertices[remap[i]] = mesh.vertices[i];
+		if (!mesh.uvs.empty())
+			fetched.uvs[remap[i]] = mesh.uvs[i];
+		if (!mesh.normals.empty())
+			fetched.normals[remap[i]] = mesh.normals[i];
+	}
+	mesh.vertices.swap(fetched.vertices);
+	mesh.uvs.swap(fetched.uvs);
+	mesh.normals.swap(fetched.normals);
+}
+
+void optimizeMesh(MeshData & mesh, const char * name){
+	VertexCacheStats cache_before = { 0.0, 0.0 };
+	double overdraw_before = 0.0;
+	size_t vertices_before = mesh.vertices.size();
+	if (name){
+		cache_before = analyzeVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE);
+		overdraw_before = analyzeOverdraw(mesh.vertices, mesh.indices);
+	}
+
+	deduplicateVertices(mesh);
+	std::vector<size_t> clusters;
+	optimizeVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE, &clusters);
+	optimizeOverdraw(mesh.indices, mesh.vertices, clusters, VERTEX_CACHE_SIZE, OVERDRAW_ACMR_THRESHOLD);
+	optimizeVertexFetch(mesh);
+
+	if (name){
+		VertexCacheStats cache_after = analyzeVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE);
+		double overdraw_after = analyzeOverdraw(mesh.vertices, mesh.indices);
+		printf("Optimized %s: %zu triangles, %zu -> %zu vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, "
+		       "overdraw %.3f -> %.3f\n", name, mesh.indices.size() / 3, vertices_before, mesh.vertices.size(),
+		       cache_before.acmr, cache_after.acmr, cache_before.atvr, cache_after.atvr,
+		       overdraw_before, overdraw_after);
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include <stddef.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "meshcache.hpp"
+
+// The post-transform cache size the optimizer orders triangles for. Most
+// GPUs behave like a FIFO of 16 to 32 entries; optimizing for the smaller
+// size costs little on the larger.
+#define VERTEX_CACHE_SIZE 16
+
+// Reordering triangles for overdraw may cost this much ACMR over the vertex
+// cache order, 1.05 meaning 5%
+#define OVERDRAW_ACMR_THRESHOLD 1.05f
+
+struct VertexCacheStats {
+	double acmr; // vertices transformed per triangle, 0.5 is ideal on large meshes and 3 is no reuse
+	double atvr; // vertices transformed per vertex, 1 is ideal
+};
+
+// Simulates a FIFO post-transform cache of cache_size vertices
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> & indices, size_t vertex_count,
+                                    size_t cache_size);
+
+// Pixels shaded per pixel covered, 1 is no overdraw. The mesh is rasterized
+// orthographically along the six axis directions with back faces culled and
+// an early depth test, in index order, the way the GPU would draw it.
+double analyzeOverdraw(const std::vector<glm::vec3> & vertices, const std::vector<unsigned int> & indices);
+
+// Merges vertices whose position, UV and normal are identical
+void deduplicateVertices(MeshData & mesh);
+
+// Tipsify (Sander, Nehab and Barczak 2007): fans around recently used
+// vertices so the triangles reuse the cache. Appends to clusters the first
+// triangle of every run that started from a cache miss, which is where the
+// order may be cut without hurting the cache.
+void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertex_count, size_t cache_size,
+                         std::vector<size_t> * clusters = NULL);
+
+// Splits the clusters further where the cache stays within threshold of the
+// whole mesh's ACMR, then draws the clusters that face away from the centre
+// first, so they occlude the rest. Expects the order optimizeVertexCache left.
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices,
+                      const std::vector<size_t> & clusters, size_t cache_size, float threshold);
+
+// Renumbers the vertices in the order the indices first use them, so
+// vertex fetch reads memory forwards; drops vertices nothing uses
+void optimizeVertexFetch(MeshData & mesh);
+
+// All of the above in order, printing the cache and overdraw statistics
+// before and after when name is given. Runs when a mesh is cooked.
+void optimizeMesh(MeshData & mesh, const char * name = NULL);
+
+#endif
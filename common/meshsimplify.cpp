@@ -0,0 +1,389 @@
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "assetid.hpp"
+#include "meshoptimizer.hpp"
+#include "meshsimplify.hpp"
+
+// Squared distance to a set of planes, weighted by the area they came from
+struct Quadric {
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double weight;
+};
+
+static void addPlane(Quadric & q, const glm::dvec3 & normal, double distance, double weight){
+	q.a00 += weight * normal.x * normal.x;
+	q.a01 += weight * normal.x * normal.y;
+	q.a02 += weight * normal.x * normal.z;
+	q.a11 += weight * normal.y * normal.y;
+	q.a12 += weight * normal.y * normal.z;
+	q.a22 += weight * normal.z * normal.z;
+	q.b0 += weight * normal.x * distance;
+	q.b1 += weight * normal.y * distance;
+	q.b2 += weight * normal.z * distance;
+	q.c += weight * distance * distance;
+	q.weight += weight;
+}
+
+static void addQuadric(Quadric & q, const Quadric & other){
+	q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02;
+	q.a11 += other.a11; q.a12 += other.a12; q.a22 += other.a22;
+	q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+	q.c += other.c;
+	q.weight += other.weight;
+}
+
+// Mean squared distance, so the error does not grow with the area merged
+static double quadricError(const Quadric & q, const glm::dvec3 & p){
+	double error = q.a00 * p.x * p.x + 2.0 * q.a01 * p.x * p.y + 2.0 * q.a02 * p.x * p.z +
+	               q.a11 * p.y * p.y + 2.0 * q.a12 * p.y * p.z + q.a22 * p.z * p.z +
+	               2.0 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+	return q.weight > 0.0 ? fabs(error) / q.weight : 0.0;
+}
+
+// What may collapse: interior vertices anywhere, border and seam vertices
+// only along their border or seam, locked vertices never
+enum VertexKind { VERTEX_MANIFOLD, VERTEX_BORDER, VERTEX_SEAM, VERTEX_LOCKED };
+
+// Borders and seams keep their shape by weighing this much more than surfaces
+static const double BoundaryWeight = 10.0;
+
+static const unsigned int NoEdge = ~0u;
+static const unsigned int ManyEdges = ~1u;
+
+// Outgoing half-edges of every vertex, as offsets into one array
+struct EdgeAdjacency {
+	std::vector<unsigned int> first;
+	std::vector<unsigned int> targets;
+
+	void build(const std::vector<unsigned int> & indices, size_t vertex_count){
+		first.assign(vertex_count + 1, 0);
+		for (size_t i = 0; i < indices.size(); i++)
+			first[indices[i] + 1]++;
+		for (size_t v = 0; v < vertex_count; v++)
+			first[v + 1] += first[v];
+		targets.resize(indices.size());
+		std::vector<unsigned int> filled(first.begin(), first.end() - 1);
+		for (size_t i = 0; i < indices.size(); i += 3){
+			for (int corner = 0; corner < 3; corner++){
+				unsigned int a = indices[i + corner];
+				unsigned int b = indices[i + (corner + 1) % 3];
+				targets[filled[a]++] = b;
+			}
+		}
+	}
+
+	bool has(unsigned int a, unsigned int b) const {
+		for (unsigned int e = first[a]; e < first[a + 1]; e++){
+			if (targets[e] == b)
+				return true;
+		}
+		return false;
+	}
+};
+
+float simplifyMesh(const MeshData & mesh, const std::vector<unsigned int> & indices, size_t target_index_count,
+                   float target_error, std::vector<unsigned int> & out_indices){
+	size_t vertex_count = mesh.vertices.size();
+	out_indices = indices;
+	if (vertex_count == 0 || indices.size() <= target_index_count)
+		return 0.0f;
+
+	// Positions scaled into the unit cube, so errors are relative to the extent
+	glm::vec3 low = mesh.vertices[0];
+	glm::vec3 high = mesh.vertices[0];
+	for (const glm::vec3 & vertex : mesh.vertices){
+		low = glm::min(low, vertex);
+		high = glm::max(high, vertex);
+	}
+	float extent = std::max(std::max(high.x - low.x, high.y - low.y), high.z - low.z);
+	double scale = extent > 0.0f ? 1.0 / extent : 1.0;
+	std::vector<glm::dvec3> positions(vertex_count);
+	for (size_t v = 0; v < vertex_count; v++)
+		positions[v] = glm::dvec3(mesh.vertices[v] - low) * scale;
+
+	// Vertices that only differ by UV or normal share a position: remap points
+	// at the first of them and wedge links them in a ring
+	struct PositionHash {
+		size_t operator()(const glm::vec3 & position) const {
+			return (size_t)hashBytes(&position, sizeof(position));
+		}
+	};
+	std::unordered_map<glm::vec3, unsigned int, PositionHash> first_at;
+	std::vector<unsigned int> remap(vertex_count);
+	std::vector<unsigned int> wedge(vertex_count);
+	for (unsigned int v = 0; v < vertex_count; v++){
+		unsigned int r = first_at.insert(std::make_pair(mesh.vertices[v], v)).first->second;
+		remap[v] = r;
+		wedge[v] = v;
+		if (r != v){
+			wedge[v] = wedge[r];
+			wedge[r] = v;
+		}
+	}
+
+	EdgeAdjacency adjacency;
+	adjacency.build(out_indices, vertex_count);
+
+	// The planes of the triangles around each position, and for edges on a
+	// border or a seam the plane through the edge at right angles to its triangle
+	std::vector<Quadric> quadrics(vertex_count);
+	memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+	for (size_t i = 0; i + 2 < out_indices.size(); i += 3){
+		const glm::dvec3 & p0 = positions[out_indices[i]];
+		const glm::dvec3 & p1 = positions[out_indices[i + 1]];
+		const glm::dvec3 & p2 = positions[out_indices[i + 2]];
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double area = glm::length(normal);
+		if (area == 0.0)
+			continue;
+		normal /= area;
+		Quadric plane;
+		memset(&plane, 0, sizeof(plane));
+		addPlane(plane, normal, -glm::dot(normal, p0), area);
+		for (int corner = 0; corner < 3; corner++)
+			addQuadric(quadrics[remap[out_indices[i + corner]]], plane);
+
+		for (int corner = 0; corner < 3; corner++){
+			unsigned int a = out_indices[i + corner];
+			unsigned int b = out_indices[i + (corner + 1) % 3];
+			if (adjacency.has(b, a))
+				continue;
+			glm::dvec3 edge = positions[b] - positions[a];
+			double length = glm::length(edge);
+			if (length == 0.0)
+				continue;
+			glm::dvec3 edge_normal = glm::normalize(glm::cross(edge, normal));
+			Quadric boundary;
+			memset(&boundary, 0, sizeof(boundary));
+			addPlane(boundary, edge_normal, -glm::dot(edge_normal, positions[a]), length * length * BoundaryWeight);
+			addQuadric(quadrics[remap[a]], boundary);
+			addQuadric(quadrics[remap[b]], boundary);
+		}
+	}
+
+	struct Collapse {
+		unsigned int source;
+		unsigned int target;
+		// The other side of a seam moves along, NoEdge otherwise
+		unsigned int twin_source;
+		unsigned int twin_target;
+		double error;
+	};
+
+	std::vector<unsigned char> kind(vertex_count);
+	std::vector<unsigned int> open_out(vertex_count);
+	std::vector<unsigned int> open_in(vertex_count);
+	std::vector<unsigned int> first_triangle(vertex_count + 1);
+	std::vector<unsigned int> triangles;
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> collapse_to(vertex_count);
+	std::vector<bool> locked(vertex_count);
+	double error_limit = (double)target_error * target_error;
+	double result_error = 0.0;
+
+	// Each pass collapses as many edges as it can without two collapses
+	// touching the same triangle, then rebuilds the adjacency
+	while (out_indices.size() > target_index_count){
+		adjacency.build(out_indices, vertex_count);
+
+		// Half-edges without a twin: a border, or a seam where the twin runs
+		// between the other wedges
+		std::fill(open_out.begin(), open_out.end(), NoEdge);
+		std::fill(open_in.begin(), open_in.end(), NoEdge);
+		for (unsigned int a = 0; a < vertex_count; a++){
+			for (unsigned int e = adjacency.first[a]; e < adjacency.first[a + 1]; e++){
+				unsigned int b = adjacency.targets[e];
+				if (adjacency.has(b, a))
+					continue;
+				open_out[a] = open_out[a] == NoEdge ? b : ManyEdges;
+				open_in[b] = open_in[b] == NoEdge ? a : ManyEdges;
+			}
+		}
+		auto unique = [](unsigned int edge){ return edge != NoEdge && edge != ManyEdges; };
+
+		for (unsigned int v = 0; v < vertex_count; v++){
+			if (remap[v] != v)
+				continue;
+			unsigned int w = wedge[v];
+			if (w == v){
+				if (open_out[v] == NoEdge && open_in[v] == NoEdge)
+					kind[v] = VERTEX_MANIFOLD;
+				else if (unique(open_out[v]) && unique(open_in[v]))
+					kind[v] = VERTEX_BORDER;
+				else
+					kind[v] = VERTEX_LOCKED;
+			} else if (wedge[w] == v && unique(open_out[v]) && unique(open_in[v]) &&
+			           unique(open_out[w]) && unique(open_in[w]) &&
+			           remap[open_out[v]] == remap[open_in[w]] && remap[open_in[v]] == remap[open_out[w]]){
+				// Two wedges whose open edges are each other's twins
+				kind[v] = VERTEX_SEAM;
+			} else {
+				kind[v] = VERTEX_LOCKED;
+			}
+		}
+		for (unsigned int v = 0; v < vertex_count; v++)
+			kind[v] = kind[remap[v]];
+
+		// Triangles around each position
+		std::fill(first_triangle.begin(), first_triangle.end(), 0);
+		for (unsigned int index : out_indices)
+			first_triangle[remap[index] + 1]++;
+		for (size_t v = 0; v < vertex_count; v++)
+			first_triangle[v + 1] += first_triangle[v];
+		triangles.resize(out_indices.size());
+		{
+			std::vector<unsigned int> filled(first_triangle.begin(), first_triangle.end() - 1);
+			for (size_t i = 0; i < out_indices.size(); i++)
+				triangles[filled[remap[out_indices[i]]]++] = (unsigned int)(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i + 2 < out_indices.size(); i += 3){
+			for (int corner = 0; corner < 3; corner++){
+				unsigned int ends[2] = { out_indices[i + corner], out_indices[i + (corner + 1) % 3] };
+				for (int direction = 0; direction < 2; direction++){
+					unsigned int source = ends[direction];
+					unsigned int target = ends[1 - direction];
+					if (remap[source] == remap[target])
+						continue;
+					Collapse collapse = { source, target, NoEdge, NoEdge, 0.0 };
+					if (kind[source] == VERTEX_MANIFOLD){
+						// Anywhere
+					} else if (kind[source] == VERTEX_BORDER){
+						if (kind[target] != VERTEX_BORDER && kind[target] != VERTEX_LOCKED)
+							continue;
+						if (open_out[source] != target && open_in[source] != target)
+							continue;
+					} else if (kind[source] == VERTEX_SEAM){
+						if (kind[target] != VERTEX_SEAM && kind[target] != VERTEX_LOCKED)
+							continue;
+						unsigned int twin = wedge[source];
+						unsigned int twin_target;
+						if (open_out[source] == target)
+							twin_target = open_in[twin];
+						else if (open_in[source] == target)
+							twin_target = open_out[twin];
+						else
+							continue;
+						if (remap[twin_target] != remap[target])
+							continue;
+						collapse.twin_source = twin;
+						collapse.twin_target = twin_target;
+					} else {
+						continue;
+					}
+					Quadric merged = quadrics[remap[source]];
+					addQuadric(merged, quadrics[remap[target]]);
+					collapse.error = quadricError(merged, positions[target]);
+					collapses.push_back(collapse);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse & a, const Collapse & b){
+			return a.error < b.error;
+		});
+
+		for (unsigned int v = 0; v < vertex_count; v++)
+			collapse_to[v] = v;
+		std::fill(locked.begin(), locked.end(), false);
+		size_t triangles_to_remove = (out_indices.size() - target_index_count) / 3;
+		size_t removed = 0;
+		size_t collapsed = 0;
+
+		// Collapses that do not conflict are not all cheap: a pass only takes
+		// those about as cheap as the ones it needs, the rest wait for the next
+		double pass_limit = error_limit;
+		if (!collapses.empty())
+			pass_limit = std::min(pass_limit,
+			                      collapses[std::min(collapses.size(), triangles_to_remove) - 1].error * 1.5);
+
+		for (const Collapse & collapse : collapses){
+			if (removed >= triangles_to_remove || (collapsed > 0 && collapse.error > pass_limit) ||
+			    collapse.error > error_limit)
+				break;
+			unsigned int source = remap[collapse.source];
+			unsigned int target = remap[collapse.target];
+			if (locked[source] || locked[target])
+				continue;
+
+			// No triangle that stays may turn by more than about 75 degrees
+			bool flips = false;
+			size_t dropped = 0;
+			for (unsigned int t = first_triangle[source]; t < first_triangle[source + 1] && !flips; t++){
+				const unsigned int * corners = &out_indices[triangles[t] * 3];
+				glm::dvec3 p[3];
+				bool has_target = false;
+				for (int corner = 0; corner < 3; corner++){
+					p[corner] = positions[corners[corner]];
+					has_target = has_target || remap[corners[corner]] == target;
+				}
+				if (has_target){
+					dropped++;
+					continue;
+				}
+				glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				for (int corner = 0; corner < 3; corner++){
+					if (remap[corners[corner]] == source)
+						p[corner] = positions[collapse.target];
+				}
+				glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+				flips = glm::dot(before, after) <= 0.25 * glm::length(before) * glm::length(after);
+			}
+			if (flips)
+				continue;
+
+			collapse_to[collapse.source] = collapse.target;
+			if (collapse.twin_source != NoEdge)
+				collapse_to[collapse.twin_source] = collapse.twin_target;
+			addQuadric(quadrics[target], quadrics[source]);
+
+			// Everything around the source changes this pass, so it is left alone
+			for (unsigned int t = first_triangle[source]; t < first_triangle[source + 1]; t++){
+				for (int corner = 0; corner < 3; corner++)
+					locked[remap[out_indices[triangles[t] * 3 + corner]]] = true;
+			}
+
+			result_error = std::max(result_error, collapse.error);
+			removed += dropped;
+			collapsed++;
+		}
+		if (collapsed == 0)
+			break;
+
+		size_t kept = 0;
+		for (size_t i = 0; i + 2 < out_indices.size(); i += 3){
+			unsigned int a = collapse_to[out_indices[i]];
+			unsigned int b = collapse_to[out_indices[i + 1]];
+			unsigned int c = collapse_to[out_indices[i + 2]];
+			if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+				continue;
+			out_indices[kept++] = a;
+			out_indices[kept++] = b;
+			out_indices[kept++] = c;
+		}
+		out_indices.resize(kept);
+	}
+
+	return (float)sqrt(result_error);
+}
+
+void buildMeshLods(MeshData & mesh, const std::vector<float> & ratios, float max_error){
+	mesh.lods.clear();
+	size_t previous = mesh.indices.size();
+	for (float ratio : ratios){
+		size_t target = (size_t)(mesh.indices.size() / 3 * ratio) * 3;
+		MeshLod lod;
+		lod.error = simplifyMesh(mesh, mesh.indices, target, max_error, lod.indices);
+		if (lod.indices.empty() || lod.indices.size() > previous * 9 / 10)
+			break;
+		optimizeVertexCache(lod.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE);
+		previous = lod.indices.size();
+		mesh.lods.push_back(lod);
+	}
+}
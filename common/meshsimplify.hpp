@@ -0,0 +1,30 @@
+#ifndef MESHSIMPLIFY_HPP
+#define MESHSIMPLIFY_HPP
+
+#include <float.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "meshcache.hpp"
+
+// Triangle ratios of the LODs cooked into every mesh, finest first
+#define MESH_LOD_RATIOS { 0.5f, 0.25f, 0.125f }
+
+// Simplifies the triangles in indices, which index mesh's vertices, by
+// collapsing edges in the order of least quadric error (Garland and
+// Heckbert 1997) until at most target_index_count indices are left or the
+// next collapse would exceed target_error. Vertices are never moved or
+// created: the result indexes the same vertex buffer, so every LOD of a mesh
+// shares it. Mesh borders and UV seams only collapse along themselves and
+// corners where they meet stay put. Errors are relative to the mesh's
+// extent; returns the largest one the result reached.
+float simplifyMesh(const MeshData & mesh, const std::vector<unsigned int> & indices, size_t target_index_count,
+                   float target_error, std::vector<unsigned int> & out_indices);
+
+// Replaces mesh.lods with one level per ratio of the full triangle count,
+// each simplified from the full mesh and ordered for the vertex cache. The
+// chain stops early once a level no longer removes a tenth of the previous.
+void buildMeshLods(MeshData & mesh, const std::vector<float> & ratios, float max_error = FLT_MAX);
+
+#endif
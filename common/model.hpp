@@ -0,0 +1,316 @@
+#ifndef MODEL_HPP
+#define MODEL_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "assetid.hpp"
+#include "gpuculling.hpp"
+#include "memoryreport.hpp"
+#include "memorytracker.hpp"
+#include "meshcache.hpp"
+#include "objloader.hpp"
+#include "texturestreamer.hpp"
+#include "vertexformat.hpp"
+
+// Whether a model keeps its geometry in system memory after uploading it.
+// Only consumers that read it back (collision hulls, picking, serialization)
+// need it; everyone else draws from the GPU copy.
+enum GeometryRetention {
+	GEOMETRY_RELEASE,
+	GEOMETRY_KEEP
+};
+
+class Model {
+public:
+	explicit Model(const std::string& mesh_name,
+	               TextureHandle texture,
+	               const std::vector<glm::vec3>& vertices,
+	               const std::vector<glm::vec2>& uvs,
+	               const std::vector<glm::vec3>& normals,
+	               unsigned int quantization = QUANTIZE_ALL):
+			name_(mesh_name),
+			mesh_id_(assetId(mesh_name.data())),
+			texture_(texture),
+			emissive_(0.0f),
+			gpu_mesh_(0) {
+		MeshData mesh;
+		indexMesh(vertices, uvs, normals, mesh.indices, mesh.vertices, mesh.uvs, mesh.normals);
+		Upload(mesh, quantization);
+	}
+
+	explicit Model(const std::string& obj_file,
+	               TextureHandle texture,
+	               GeometryRetention retention = GEOMETRY_RELEASE,
+	               unsigned int quantization = QUANTIZE_ALL):
+			name_(obj_file),
+			mesh_id_(assetId(obj_file.data())),
+			texture_(texture),
+			emissive_(0.0f),
+			gpu_mesh_(0) {
+		MeshData mesh;
+		loadMesh(obj_file.data(), mesh);
+		Upload(mesh, quantization);
+		Retain(std::move(mesh), retention);
+	}
+
+	// For meshes loaded elsewhere, e.g. by the AssetLoader's workers; move the mesh in
+	explicit Model(const std::string& mesh_name,
+	               TextureHandle texture,
+	               MeshData mesh,
+	               GeometryRetention retention = GEOMETRY_RELEASE,
+	               unsigned int quantization = QUANTIZE_ALL):
+			name_(mesh_name),
+			mesh_id_(assetId(mesh_name.data())),
+			texture_(texture),
+			emissive_(0.0f),
+			gpu_mesh_(0) {
+		Upload(mesh, quantization);
+		Retain(std::move(mesh), retention);
+	}
+
+	// Only what the simulation reads, the LOD ranges and the extent, without
+	// any GL object or texture: for running without a context. Such a model
+	// cannot be drawn.
+	static Model* CreateHeadless(const std::string& mesh_name, const MeshData& mesh) {
+		Model* model = new Model(mesh_name);
+		model->LayOutLods(mesh);
+		return model;
+	}
+
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
+	// The texture belongs to the TextureStreamer
+	virtual ~Model() {
+		if (vertex_array_ == 0) {
+			return;
+		}
+		MemoryTracker& tracker = MemoryTracker::Instance();
+		tracker.UntrackGpu(GPU_BUFFER, vertexbuffer_);
+		tracker.UntrackGpu(GPU_BUFFER, elementbuffer_);
+		tracker.UntrackGpu(GPU_BUFFER, instancebuffer_);
+		glDeleteBuffers(1, &vertexbuffer_);
+		glDeleteBuffers(1, &elementbuffer_);
+		glDeleteBuffers(1, &instancebuffer_);
+		glDeleteVertexArrays(1, &vertex_array_);
+	}
+
+	AssetId GetMeshId() const {
+		return mesh_id_;
+	}
+
+	// Null unless the model was created with GEOMETRY_KEEP
+	const MeshData* GetCpuGeometry() const {
+		return cpu_geometry_.get();
+	}
+
+	// The retained geometry, if any, and the vertex, element and instance buffers
+	void ReportMemory(MemoryReport& report) const {
+		size_t cpu_bytes = 0;
+		if (cpu_geometry_) {
+			cpu_bytes = cpu_geometry_->vertices.capacity() * sizeof(glm::vec3) +
+			            cpu_geometry_->uvs.capacity() * sizeof(glm::vec2) +
+			            cpu_geometry_->normals.capacity() * sizeof(glm::vec3) +
+			            cpu_geometry_->indices.capacity() * sizeof(unsigned int);
+			for (const MeshLod& lod : cpu_geometry_->lods) {
+				cpu_bytes += lod.indices.capacity() * sizeof(unsigned int);
+			}
+		}
+		report.Add(name_, cpu_bytes, vertex_bytes_ + index_bytes_ + instance_bytes_);
+	}
+
+	// 0 for a headless model
+	AssetId GetTextureId() const {
+		return texture_ != nullptr ? texture_->Id() : 0;
+	}
+
+	// How much the surface lights itself, on top of the point lights
+	GLfloat GetEmissive() const {
+		return emissive_;
+	}
+
+	void SetEmissive(GLfloat emissive) {
+		emissive_ = emissive;
+	}
+
+	// Hands a copy of the mesh to the GPU culling pass, after the emissive factor is set
+	void AddTo(GpuCuller& culler) {
+		gpu_mesh_ = culler.AddMesh(vertexbuffer_, elementbuffer_, layout_, vertex_count_, index_count_, texture_,
+		                           emissive_);
+	}
+
+	// Only valid after AddTo
+	GLuint GetGpuMesh() const {
+		return gpu_mesh_;
+	}
+
+	GLuint GetLodCount() const {
+		return lods_.size();
+	}
+
+	// The coarsest LOD whose error, seen from distance at this scale, stays
+	// under kMaxLodPixelError; pixels_per_unit is the size on screen of one
+	// unit at distance 1
+	GLuint SelectLod(GLfloat distance, GLfloat scale, GLfloat pixels_per_unit) const {
+		GLuint lod = 0;
+		while (lod + 1 < lods_.size() &&
+		       lods_[lod + 1].error * extent_ * scale * pixels_per_unit <= kMaxLodPixelError * distance) {
+			++lod;
+		}
+		return lod;
+	}
+
+	// Draws the mesh once per model matrix with a single instanced draw call
+	// The program's TextureSampler is expected to read from texture unit 0
+	void DrawInstances(const std::vector<glm::mat4>& model_matrices, GLuint lod = 0) {
+		if (model_matrices.empty()) {
+			return;
+		}
+
+		glBindVertexArray(vertex_array_);
+
+		// Orphan the previous frame's storage so the driver does not have to sync on it;
+		// the size only changes, and the tracker only hears of it, when the buffer grows
+		glBindBuffer(GL_ARRAY_BUFFER, instancebuffer_);
+		size_t bytes = model_matrices.size() * sizeof(glm::mat4);
+		if (bytes > instance_bytes_) {
+			instance_bytes_ = bytes + bytes / 2;
+			MemoryTracker::Instance().TrackGpu(GPU_BUFFER, instancebuffer_, instance_bytes_);
+		}
+		glBufferData(GL_ARRAY_BUFFER, instance_bytes_, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, model_matrices.size() * sizeof(glm::mat4), &model_matrices[0]);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texture_->Name());
+
+		glDrawElementsInstanced(GL_TRIANGLES, lods_[lod].index_count, GL_UNSIGNED_INT,
+		                        (void*)(lods_[lod].first_index * sizeof(unsigned int)), model_matrices.size());
+
+		glBindVertexArray(0);
+	}
+
+	// LODs further than this many pixels from the full mesh are not used
+	static constexpr GLfloat kMaxLodPixelError = 1.0f;
+
+protected:
+	explicit Model(const std::string& mesh_name):
+			name_(mesh_name),
+			mesh_id_(assetId(mesh_name.data())),
+			texture_(nullptr),
+			emissive_(0.0f),
+			vertex_array_(0),
+			vertexbuffer_(0),
+			elementbuffer_(0),
+			instancebuffer_(0),
+			gpu_mesh_(0),
+			vertex_bytes_(0),
+			index_bytes_(0),
+			instance_bytes_(0) {}
+
+	// A range of the element buffer; LOD 0 is the full mesh and comes first
+	struct LodRange {
+		GLsizei first_index;
+		GLsizei index_count;
+		GLfloat error;  // relative to extent_
+	};
+
+	// Fills in the LOD ranges and the extent; returns the element buffer's contents
+	std::vector<unsigned int> LayOutLods(const MeshData& mesh) {
+		vertex_count_ = mesh.vertices.size();
+		index_count_ = mesh.indices.size();
+
+		// Every LOD indexes the same vertices, so they share one element buffer
+		std::vector<unsigned int> indices = mesh.indices;
+		lods_.push_back({0, index_count_, 0.0f});
+		for (const MeshLod& lod : mesh.lods) {
+			lods_.push_back({GLsizei(indices.size()), GLsizei(lod.indices.size()), lod.error});
+			indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+		}
+		glm::vec3 low(0.0f);
+		glm::vec3 high(0.0f);
+		if (!mesh.vertices.empty()) {
+			low = high = mesh.vertices[0];
+		}
+		for (const glm::vec3& vertex : mesh.vertices) {
+			low = glm::min(low, vertex);
+			high = glm::max(high, vertex);
+		}
+		extent_ = glm::max(glm::max(high.x - low.x, high.y - low.y), high.z - low.z);
+		return indices;
+	}
+
+	// Geometry goes to the GPU once, interleaved and indexed; instances only send their model matrices
+	void Upload(const MeshData& mesh, unsigned int quantization) {
+		std::vector<unsigned int> indices = LayOutLods(mesh);
+
+		// A mesh whose attributes do not line up is still drawn, from its positions alone
+		std::vector<unsigned char> packed;
+		if (!packVertices(mesh.vertices, mesh.uvs, mesh.normals, quantization, packed, layout_)) {
+			packVertices(mesh.vertices, {}, {}, quantization, packed, layout_);
+		}
+
+		glGenVertexArrays(1, &vertex_array_);
+		glBindVertexArray(vertex_array_);
+
+		glGenBuffers(1, &vertexbuffer_);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
+		glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+		setVertexLayout(layout_);
+		vertex_bytes_ = packed.size();
+		MemoryTracker::Instance().TrackGpu(GPU_BUFFER, vertexbuffer_, vertex_bytes_);
+
+		// 32-bit indices, so meshes are not limited to 65536 vertices
+		glGenBuffers(1, &elementbuffer_);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer_);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(),
+		             GL_STATIC_DRAW);
+		index_bytes_ = indices.size() * sizeof(unsigned int);
+		MemoryTracker::Instance().TrackGpu(GPU_BUFFER, elementbuffer_, index_bytes_);
+
+		// A mat4 attribute takes four consecutive locations, one per column
+		glGenBuffers(1, &instancebuffer_);
+		glBindBuffer(GL_ARRAY_BUFFER, instancebuffer_);
+		instance_bytes_ = 0;
+		for (GLuint column = 0; column < 4; ++column) {
+			glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+			glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+			                      (void*)(column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+		}
+
+		glBindVertexArray(0);
+	}
+
+	// Everything the GPU needs is uploaded by then
+	void Retain(MeshData mesh, GeometryRetention retention) {
+		if (retention == GEOMETRY_KEEP) {
+			cpu_geometry_.reset(new MeshData(std::move(mesh)));
+		}
+	}
+
+	std::string name_;
+	AssetId mesh_id_;
+	TextureHandle texture_;
+	GLfloat emissive_;
+	GLuint vertex_array_;
+	GLuint vertexbuffer_;
+	GLuint elementbuffer_;
+	GLuint instancebuffer_;
+	GLsizei vertex_count_;
+	GLsizei index_count_;
+	std::vector<LodRange> lods_;
+	GLfloat extent_;
+	VertexLayout layout_;
+	GLuint gpu_mesh_;
+	size_t vertex_bytes_;
+	size_t index_bytes_;
+	size_t instance_bytes_;
+	std::unique_ptr<MeshData> cpu_geometry_;
+};
+
+#endif
@@ -2,9 +2,13 @@
 #include <stdio.h>
 #include <string>
 #include <cstring>
+#include <algorithm>
+#include <unordered_map>
 
 #include <glm/glm.hpp>
 
+#include "assetid.hpp"
+#include "assetpack.hpp"
 #include "objloader.hpp"
 
 // Very, VERY simple OBJ loader.
@@ -31,43 +35,50 @@ bool loadOBJ(
 	std::vector<glm::vec3> temp_normals;
 
 
-	FILE * file = fopen(path, "r");
-	if( file == NULL ){
-		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-		getchar();
+	AssetData file;
+	if (!AssetVfs::Instance().Open(path, file))
 		return false;
-	}
 
-	while( 1 ){
+	// The file is parsed in place, one line at a time
+	const char * cursor = (const char *)file.Data();
+	const char * end = cursor + file.Size();
+	while( cursor < end ){
+
+		const char * line_end = (const char *)memchr(cursor, '\n', end - cursor);
+		if (line_end == NULL)
+			line_end = end;
+		// sscanf needs a terminated string; longer lines are only comments and names
+		char line[1024];
+		size_t length = std::min<size_t>(line_end - cursor, sizeof(line) - 1);
+		memcpy(line, cursor, length);
+		line[length] = '\0';
+		cursor = line_end + 1;
 
-		char lineHeader[128];
 		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
+		char lineHeader[128];
+		if (sscanf(line, "%127s", lineHeader) != 1)
+			continue; // empty line
 
 		// else : parse lineHeader
 		
 		if ( strcmp( lineHeader, "v" ) == 0 ){
 			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
+			sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z );
 			temp_vertices.push_back(vertex);
 		}else if ( strcmp( lineHeader, "vt" ) == 0 ){
 			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y );
+			sscanf(line, "vt %f %f", &uv.x, &uv.y );
 			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
 			temp_uvs.push_back(uv);
 		}else if ( strcmp( lineHeader, "vn" ) == 0 ){
 			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
+			sscanf(line, "vn %f %f %f", &normal.x, &normal.y, &normal.z );
 			temp_normals.push_back(normal);
 		}else if ( strcmp( lineHeader, "f" ) == 0 ){
-			std::string vertex1, vertex2, vertex3;
 			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
+			int matches = sscanf(line, "f %u/%u/%u %u/%u/%u %u/%u/%u", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
 			if (matches != 9){
 				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				fclose(file);
 				return false;
 			}
 			vertexIndices.push_back(vertexIndex[0]);
@@ -79,11 +90,8 @@ bool loadOBJ(
 			normalIndices.push_back(normalIndex[0]);
 			normalIndices.push_back(normalIndex[1]);
 			normalIndices.push_back(normalIndex[2]);
-		}else{
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
 		}
+		// Anything else is probably a comment
 
 	}
 
@@ -106,12 +114,59 @@ bool loadOBJ(
 		out_normals .push_back(normal);
 	
 	}
-	fclose(file);
 	return true;
 }
 
 
-#ifdef USE_ASSIMP // don't use this #define, it's only for me (it AssImp fails to compile on your machine, at least all the other tutorials still work)
+// Merges corners with identical position, UV and normal, in the order they first appear
+void indexMesh(
+	const std::vector<glm::vec3> & in_vertices,
+	const std::vector<glm::vec2> & in_uvs,
+	const std::vector<glm::vec3> & in_normals,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	struct Corner {
+		glm::vec3 position;
+		glm::vec2 uv;
+		glm::vec3 normal;
+	};
+	struct CornerHash {
+		size_t operator()(const Corner & corner) const {
+			return (size_t)hashBytes(&corner, sizeof(Corner));
+		}
+	};
+	struct CornerEqual {
+		bool operator()(const Corner & a, const Corner & b) const {
+			return memcmp(&a, &b, sizeof(Corner)) == 0;
+		}
+	};
+	std::unordered_map<Corner, unsigned int, CornerHash, CornerEqual> known;
+
+	out_indices.reserve(in_vertices.size());
+	for (size_t i = 0; i < in_vertices.size(); i++){
+		// Three vectors of floats without padding, so hashing and comparing the bytes is safe
+		Corner corner = {in_vertices[i], glm::vec2(0.0f), glm::vec3(0.0f)};
+		if (i < in_uvs.size())
+			corner.uv = in_uvs[i];
+		if (i < in_normals.size())
+			corner.normal = in_normals[i];
+
+		auto inserted = known.insert(std::make_pair(corner, (unsigned int)out_vertices.size()));
+		if (inserted.second){
+			out_vertices.push_back(corner.position);
+			if (!in_uvs.empty())
+				out_uvs.push_back(corner.uv);
+			if (!in_normals.empty())
+				out_normals.push_back(corner.normal);
+		}
+		out_indices.push_back(inserted.first->second);
+	}
+}
+
+#ifdef USE_ASSIMP
 
 // Include AssImp
 #include <assimp/Importer.hpp>      // C++ importer interface
@@ -120,55 +175,67 @@ bool loadOBJ(
 
 bool loadAssImp(
 	const char * path, 
-	std::vector<unsigned short> & indices,
+	std::vector<unsigned int> & indices,
 	std::vector<glm::vec3> & vertices,
 	std::vector<glm::vec2> & uvs,
 	std::vector<glm::vec3> & normals
 ){
+	printf("Importing %s...\n", path);
+
+	AssetData file;
+	if (!AssetVfs::Instance().Open(path, file))
+		return false;
+
+	// The extension tells assimp the format of a file read from memory
+	const char * extension = strrchr(path, '.');
 
 	Assimp::Importer importer;
 
-	const aiScene* scene = importer.ReadFile(path, 0/*aiProcess_JoinIdenticalVertices | aiProcess_SortByPType*/);
+	// Shared vertices, reordered for the post-transform vertex cache, with
+	// as few meshes as the materials allow
+	const aiScene* scene = importer.ReadFileFromMemory(file.Data(), file.Size(),
+		aiProcess_Triangulate |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_SortByPType |
+		aiProcess_GenSmoothNormals |
+		aiProcess_ImproveCacheLocality |
+		aiProcess_OptimizeMeshes,
+		extension != NULL ? extension + 1 : "");
 	if( !scene) {
-		fprintf( stderr, importer.GetErrorString());
-		getchar();
+		printf("%s\n", importer.GetErrorString());
 		return false;
 	}
-	const aiMesh* mesh = scene->mMeshes[0]; // In this simple example code we always use the 1rst mesh (in OBJ files there is often only one anyway)
 
-	// Fill vertices positions
-	vertices.reserve(mesh->mNumVertices);
-	for(unsigned int i=0; i<mesh->mNumVertices; i++){
-		aiVector3D pos = mesh->mVertices[i];
-		vertices.push_back(glm::vec3(pos.x, pos.y, pos.z));
-	}
-
-	// Fill vertices texture coordinates
-	uvs.reserve(mesh->mNumVertices);
-	for(unsigned int i=0; i<mesh->mNumVertices; i++){
-		aiVector3D UVW = mesh->mTextureCoords[0][i]; // Assume only 1 set of UV coords; AssImp supports 8 UV sets.
-		uvs.push_back(glm::vec2(UVW.x, UVW.y));
-	}
+	// The meshes left after OptimizeMeshes are appended one after another
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++){
+		const aiMesh* mesh = scene->mMeshes[m];
+		// SortByPType splits off points and lines; only triangles are drawn
+		if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE)
+			continue;
+
+		unsigned int base = vertices.size();
+		for(unsigned int i=0; i<mesh->mNumVertices; i++){
+			aiVector3D pos = mesh->mVertices[i];
+			vertices.push_back(glm::vec3(pos.x, pos.y, pos.z));
+
+			// Assume only 1 set of UV coords; AssImp supports 8 UV sets.
+			// V is inverted the same way loadOBJ does it
+			aiVector3D UVW = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][i] : aiVector3D(0, 0, 0);
+			uvs.push_back(glm::vec2(UVW.x, -UVW.y));
+
+			aiVector3D n = mesh->mNormals[i];
+			normals.push_back(glm::vec3(n.x, n.y, n.z));
+		}
 
-	// Fill vertices normals
-	normals.reserve(mesh->mNumVertices);
-	for(unsigned int i=0; i<mesh->mNumVertices; i++){
-		aiVector3D n = mesh->mNormals[i];
-		normals.push_back(glm::vec3(n.x, n.y, n.z));
+		for (unsigned int i=0; i<mesh->mNumFaces; i++){
+			indices.push_back(base + mesh->mFaces[i].mIndices[0]);
+			indices.push_back(base + mesh->mFaces[i].mIndices[1]);
+			indices.push_back(base + mesh->mFaces[i].mIndices[2]);
+		}
 	}
 
-
-	// Fill face indices
-	indices.reserve(3*mesh->mNumFaces);
-	for (unsigned int i=0; i<mesh->mNumFaces; i++){
-		// Assume the model has only triangles.
-		indices.push_back(mesh->mFaces[i].mIndices[0]);
-		indices.push_back(mesh->mFaces[i].mIndices[1]);
-		indices.push_back(mesh->mFaces[i].mIndices[2]);
-	}
-	
 	// The "scene" pointer will be deleted automatically by "importer"
-	return true;
+	return !indices.empty();
 }
 
 #endif
\ No newline at end of file
@@ -10,9 +10,23 @@ bool loadOBJ(
 
 
 
+// Merges identical corners of an unindexed mesh such as loadOBJ returns.
+// uvs and normals may be empty.
+void indexMesh(
+	const std::vector<glm::vec3> & in_vertices,
+	const std::vector<glm::vec2> & in_uvs,
+	const std::vector<glm::vec3> & in_normals,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+// Only with USE_ASSIMP. Triangulates, joins identical vertices, merges the
+// meshes and orders the triangles for the vertex cache; appends to the output.
 bool loadAssImp(
 	const char * path, 
-	std::vector<unsigned short> & indices,
+	std::vector<unsigned int> & indices,
 	std::vector<glm::vec3> & vertices,
 	std::vector<glm::vec2> & uvs,
 	std::vector<glm::vec3> & normals
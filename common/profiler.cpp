@@ -0,0 +1,94 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "profiler.hpp"
+
+static double percentile(const std::vector<double> & sorted, double fraction){
+	size_t index = size_t(fraction * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+DurationStats durationStats(std::vector<double> durations){
+	DurationStats stats = {};
+	if (durations.empty())
+		return stats;
+
+	std::sort(durations.begin(), durations.end());
+	double total = 0.0;
+	for (double duration : durations)
+		total += duration;
+	stats.count = durations.size();
+	stats.mean = total / durations.size();
+
+	double total_squares = 0.0;
+	for (double duration : durations)
+		total_squares += (duration - stats.mean) * (duration - stats.mean);
+	stats.std_dev = sqrt(total_squares / durations.size());
+
+	stats.p50 = percentile(durations, 0.50);
+	stats.p90 = percentile(durations, 0.90);
+	stats.p95 = percentile(durations, 0.95);
+	stats.p99 = percentile(durations, 0.99);
+	stats.max = durations.back();
+	return stats;
+}
+
+double ProfileStat::Mean() const {
+	return count > 0 ? total / count : 0.0;
+}
+
+double ProfileStat::Variance() const {
+	if (count < 2)
+		return 0.0;
+	double mean = Mean();
+	double variance = total_squares / count - mean * mean;
+	return variance > 0.0 ? variance : 0.0;
+}
+
+Profiler & Profiler::Instance(){
+	static Profiler profiler;
+	return profiler;
+}
+
+void Profiler::Record(const char * name, double value){
+	std::lock_guard<std::mutex> lock(mutex_);
+	ProfileStat & stat = stats_[name];
+	if (stat.count == 0 || value < stat.min)
+		stat.min = value;
+	if (stat.count == 0 || value > stat.max)
+		stat.max = value;
+	stat.count++;
+	stat.last = value;
+	stat.total += value;
+	stat.total_squares += value * value;
+}
+
+ProfileStat Profiler::Get(const char * name){
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::map<std::string, ProfileStat>::const_iterator found = stats_.find(name);
+	if (found == stats_.end()){
+		ProfileStat empty = {};
+		return empty;
+	}
+	return found->second;
+}
+
+std::map<std::string, ProfileStat> Profiler::GetAll(){
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+void Profiler::Reset(){
+	std::lock_guard<std::mutex> lock(mutex_);
+	stats_.clear();
+}
+
+void Profiler::Report(FILE * out){
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (const auto & entry : stats_){
+		const ProfileStat & stat = entry.second;
+		fprintf(out, "%-32s count %8llu  last %12.3f  mean %12.3f  min %12.3f  max %12.3f\n",
+		        entry.first.c_str(), stat.count, stat.last, stat.Mean(), stat.min, stat.max);
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <stdio.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Running statistics of one named measurement
+struct ProfileStat {
+	unsigned long long count;
+	double last;
+	double min;
+	double max;
+	double total;
+	double total_squares;
+
+	double Mean() const;
+	double Variance() const;
+};
+
+// Of a set of durations, in milliseconds
+struct DurationStats {
+	size_t count;
+	double mean;
+	double std_dev;
+	double p50;
+	double p90;
+	double p95;
+	double p99;
+	double max;
+};
+
+DurationStats durationStats(std::vector<double> durations);
+
+// Named measurements (timings in milliseconds, byte counts, ...) that any
+// thread can record into. Report() prints one line per name.
+class Profiler {
+public:
+	static Profiler & Instance();
+
+	void Record(const char * name, double value);
+
+	// Zeroed statistics if nothing was recorded under that name
+	ProfileStat Get(const char * name);
+
+	// Everything recorded so far, by name
+	std::map<std::string, ProfileStat> GetAll();
+
+	void Reset();
+
+	void Report(FILE * out = stdout);
+
+private:
+	std::mutex mutex_;
+	std::map<std::string, ProfileStat> stats_;
+};
+
+// Records the lifetime of the scope in milliseconds
+class ScopedTimer {
+public:
+	explicit ScopedTimer(const char * name):
+		name_(name),
+		start_(std::chrono::steady_clock::now()) {}
+
+	~ScopedTimer(){
+		Profiler::Instance().Record(name_, ElapsedMilliseconds());
+	}
+
+	double ElapsedMilliseconds() const {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+	}
+
+private:
+	const char * name_;
+	std::chrono::steady_clock::time_point start_;
+};
+
+#endif
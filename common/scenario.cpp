@@ -0,0 +1,283 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+#include "mappedfile.hpp"
+#include "profiler.hpp"
+#include "scenario.hpp"
+#include "textcursor.hpp"
+
+// The player's default, which the scripted cursor movement is worked out for
+static const GLfloat kMouseSpeed = 0.005f;
+
+static void writeDurationStats(FILE * out, const DurationStats & stats){
+	fprintf(out, "{\"count\": %zu, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+	        stats.count, stats.mean, stats.p50, stats.p90, stats.p99, stats.max);
+}
+
+// Uniformly distributed over the unit sphere
+static glm::vec3 randomDirection(std::mt19937 & rng){
+	std::uniform_real_distribution<float> height(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 2.0f * PI);
+	float z = height(rng);
+	float phi = angle(rng);
+	float ring = sqrtf(std::max(0.0f, 1.0f - z * z));
+	return glm::vec3(ring * cosf(phi), ring * sinf(phi), z);
+}
+
+Scenario::Scenario():
+	duration_(10.0f),
+	seed_(1),
+	enemies_(0),
+	spawn_interval_(3.0f),
+	fire_interval_(0.2f),
+	swarm_(0),
+	swarm_radius_(0.0f),
+	sample_interval_(1.0f),
+	tick_rate_(60),
+	tick_(0),
+	sample_ticks_(60),
+	yaw_(0.0f),
+	pitch_(0.0f),
+	wall_seconds_(0.0),
+	start_allocations_(),
+	peak_objects_(0)
+{
+	spawn_radius_[0] = 5.0f;
+	spawn_radius_[1] = 50.0f;
+	enemy_size_[0] = 0.5f;
+	enemy_size_[1] = 4.0f;
+}
+
+bool Scenario::Load(const char * path){
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	std::string base(path);
+	size_t slash = base.find_last_of("/\\");
+	if (slash != std::string::npos)
+		base.erase(0, slash + 1);
+	size_t dot = base.rfind('.');
+	if (dot != std::string::npos && dot > 0)
+		base.resize(dot);
+	name_ = base;
+
+	TextCursor cursor((const char *)file.Data(), file.Size());
+	const char * token;
+	size_t length;
+	while (cursor.NextLine()){
+		cursor.NextToken(token, length);
+		bool valid;
+		if (tokenIs(token, length, "duration")){
+			valid = parseFloat(cursor, duration_) && duration_ > 0.0f;
+		}else if (tokenIs(token, length, "seed")){
+			valid = parseUint(cursor, seed_);
+		}else if (tokenIs(token, length, "enemies")){
+			valid = parseUint(cursor, enemies_);
+		}else if (tokenIs(token, length, "spawn_interval")){
+			valid = parseFloat(cursor, spawn_interval_) && spawn_interval_ > 0.0f;
+		}else if (tokenIs(token, length, "spawn_radius")){
+			valid = parseFloat(cursor, spawn_radius_[0]) && parseFloat(cursor, spawn_radius_[1]) &&
+			        spawn_radius_[0] >= 0.0f && spawn_radius_[0] <= spawn_radius_[1];
+		}else if (tokenIs(token, length, "enemy_size")){
+			valid = parseFloat(cursor, enemy_size_[0]) && parseFloat(cursor, enemy_size_[1]) &&
+			        enemy_size_[0] > 0.0f && enemy_size_[0] <= enemy_size_[1];
+		}else if (tokenIs(token, length, "fire_interval")){
+			valid = parseFloat(cursor, fire_interval_) && fire_interval_ >= 0.0f;
+		}else if (tokenIs(token, length, "swarm")){
+			valid = parseUint(cursor, swarm_) && parseFloat(cursor, swarm_radius_) && swarm_radius_ >= 0.0f;
+		}else if (tokenIs(token, length, "camera")){
+			CameraKey key;
+			valid = parseFloat(cursor, key.time) && parseFloat(cursor, key.yaw) && parseFloat(cursor, key.pitch) &&
+			        (camera_path_.empty() || key.time > camera_path_.back().time);
+			if (!valid)
+				return parseError(path, cursor, "expected camera <time> <yaw> <pitch>, times in increasing order");
+			key.yaw = glm::radians(key.yaw);
+			key.pitch = glm::radians(key.pitch);
+			camera_path_.push_back(key);
+		}else if (tokenIs(token, length, "sample_interval")){
+			valid = parseFloat(cursor, sample_interval_) && sample_interval_ > 0.0f;
+		}else{
+			return parseError(path, cursor, "unknown key");
+		}
+		if (!valid || !cursor.AtLineEnd())
+			return parseError(path, cursor, "invalid value");
+	}
+	return true;
+}
+
+Player Scenario::CreatePlayer(Model * snowball_model) const {
+	// Fire is held all along, so the interval alone sets the rate
+	GLfloat fire_interval = fire_interval_ > 0.0f ? fire_interval_ : 0.2f;
+	return Player(snowball_model, glm::vec3(0.0f), 1.0f, kMouseSpeed, fire_interval);
+}
+
+EnemyCreator Scenario::CreateSpawner(Model * enemy_model) const {
+	return EnemyCreator(enemy_model, seed_, spawn_interval_, spawn_radius_[0], spawn_radius_[1], enemy_size_[0],
+	                    enemy_size_[1]);
+}
+
+void Scenario::Start(int tick_rate, Model * enemy_model, Model * snowball_model, const glm::vec3 & center,
+                     std::vector<SceneObject*> & objects, Broadphase & broadphase){
+	tick_rate_ = tick_rate;
+	tick_ = 0;
+	sample_ticks_ = std::max<uint64_t>(1, uint64_t(sample_interval_ * tick_rate + 0.5f));
+	yaw_ = 0.0f;
+	pitch_ = 0.0f;
+
+	// Seeded apart from the spawner, whose sequence stays the game's
+	std::mt19937 rng(seed_ ^ 0x9e3779b9u);
+
+	// Without a delay between spawns, every call at a later time spawns one
+	EnemyCreator placer(enemy_model, rng(), 0.0f, spawn_radius_[0], spawn_radius_[1], enemy_size_[0],
+	                    enemy_size_[1]);
+	objects.reserve(objects.size() + enemies_ + swarm_);
+	for (uint32_t i = 0; i < enemies_; i++)
+		AddObject(placer.CreateEnemy(center, i + 1.0), objects, broadphase);
+
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (uint32_t i = 0; i < swarm_; i++){
+		glm::vec3 position = center + randomDirection(rng) * swarm_radius_ * cbrtf(unit(rng));
+		AddObject(new SnowBall(snowball_model, position, randomDirection(rng)), objects, broadphase);
+	}
+
+	// Reserved up front, so the run itself does not allocate for them
+	size_t ticks = size_t(duration_ * tick_rate + 0.5f);
+	tick_times_.clear();
+	tick_times_.reserve(ticks);
+	frame_times_.clear();
+	frame_times_.reserve(ticks * 2);
+	samples_.clear();
+	samples_.reserve(ticks / sample_ticks_ + 2);
+	peak_objects_ = objects.size();
+	CountEntities(objects);
+
+	for (int i = 0; i < MEMORY_TAG_COUNT; i++)
+		start_allocations_[i] = MemoryTracker::Instance().Stats((MemoryTag)i).allocations;
+	start_time_ = std::chrono::steady_clock::now();
+	wall_seconds_ = 0.0;
+}
+
+bool Scenario::Next(TickInput & input){
+	if (tick_ >= uint64_t(duration_ * tick_rate_ + 0.5f))
+		return false;
+
+	float time = float(tick_) / tick_rate_;
+	float yaw = yaw_;
+	float pitch = pitch_;
+	if (!camera_path_.empty()){
+		size_t next = 0;
+		while (next < camera_path_.size() && camera_path_[next].time <= time)
+			next++;
+		if (next == 0){
+			yaw = camera_path_.front().yaw;
+			pitch = camera_path_.front().pitch;
+		}else if (next == camera_path_.size()){
+			yaw = camera_path_.back().yaw;
+			pitch = camera_path_.back().pitch;
+		}else{
+			const CameraKey & a = camera_path_[next - 1];
+			const CameraKey & b = camera_path_[next];
+			float t = (time - a.time) / (b.time - a.time);
+			yaw = a.yaw + (b.yaw - a.yaw) * t;
+			pitch = a.pitch + (b.pitch - a.pitch) * t;
+		}
+	}
+
+	// The player turns by the cursor movement times its mouse speed; the
+	// angles are followed with the same float arithmetic, so they never drift
+	input.cursor_dx = (yaw - yaw_) / kMouseSpeed;
+	input.cursor_dy = (pitch - pitch_) / kMouseSpeed;
+	input.buttons = fire_interval_ > 0.0f ? INPUT_FIRE : 0;
+	yaw_ += kMouseSpeed * input.cursor_dx;
+	pitch_ += kMouseSpeed * input.cursor_dy;
+
+	tick_++;
+	return true;
+}
+
+void Scenario::RecordTick(const std::vector<SceneObject*> & objects, double milliseconds){
+	tick_times_.push_back(milliseconds);
+	peak_objects_ = std::max(peak_objects_, objects.size());
+	if (tick_ % sample_ticks_ == 0)
+		CountEntities(objects);
+	wall_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count();
+}
+
+void Scenario::RecordFrame(double milliseconds){
+	frame_times_.push_back(milliseconds);
+}
+
+void Scenario::CountEntities(const std::vector<SceneObject*> & objects){
+	EntitySample sample = { double(tick_) / tick_rate_, 0, 0 };
+	for (const SceneObject * obj : objects){
+		if (obj->IsSnowBall())
+			sample.snowballs++;
+		else
+			sample.enemies++;
+	}
+	samples_.push_back(sample);
+}
+
+bool Scenario::WriteReport(const char * path, const char * mode){
+	FILE * out = stdout;
+	if (path != NULL){
+		out = fopen(path, "w");
+		if (out == NULL){
+			printf("Impossible to open %s\n", path);
+			return false;
+		}
+	}
+
+	fprintf(out, "{\n  \"scenario\": \"%s\",\n  \"mode\": \"%s\",\n", name_.c_str(), mode);
+	fprintf(out, "  \"tick_rate\": %d,\n  \"ticks\": %llu,\n  \"duration_s\": %.3f,\n  \"wall_s\": %.3f,\n",
+	        tick_rate_, (unsigned long long)tick_times_.size(), double(tick_times_.size()) / tick_rate_,
+	        wall_seconds_);
+
+	fprintf(out, "  \"frame_ms\": ");
+	writeDurationStats(out, durationStats(frame_times_.empty() ? tick_times_ : frame_times_));
+	fprintf(out, ",\n  \"tick_ms\": ");
+	writeDurationStats(out, durationStats(tick_times_));
+
+	// Only the timings; the Profiler also holds counts and sizes
+	fprintf(out, ",\n  \"stages\": {");
+	const char * separator = "\n";
+	for (const auto & entry : Profiler::Instance().GetAll()){
+		const std::string & name = entry.first;
+		if (name.size() < 3 || name.compare(name.size() - 3, 3, "_ms") != 0)
+			continue;
+		const ProfileStat & stat = entry.second;
+		fprintf(out, "%s    \"%s\": {\"count\": %llu, \"mean\": %.4f, \"min\": %.4f, \"max\": %.4f}", separator,
+		        name.c_str(), stat.count, stat.Mean(), stat.min, stat.max);
+		separator = ",\n";
+	}
+	fprintf(out, "\n  },\n");
+
+	fprintf(out, "  \"entities\": {\n    \"peak\": %zu,\n    \"samples\": [", peak_objects_);
+	for (size_t i = 0; i < samples_.size(); i++)
+		fprintf(out, "%s\n      {\"time\": %.3f, \"enemies\": %zu, \"snowballs\": %zu}", i > 0 ? "," : "",
+		        samples_[i].time, samples_[i].enemies, samples_[i].snowballs);
+	fprintf(out, "\n    ]\n  },\n");
+
+	// Peaks are since startup, allocations since the scenario started
+	size_t allocations = 0;
+	fprintf(out, "  \"memory\": {\n    \"tags\": {");
+	for (int i = 0; i < MEMORY_TAG_COUNT; i++){
+		MemoryTagStats stats = MemoryTracker::Instance().Stats((MemoryTag)i);
+		size_t tag_allocations = stats.allocations - start_allocations_[i];
+		allocations += tag_allocations;
+		fprintf(out, "%s\n      \"%s\": {\"heap_peak_bytes\": %zu, \"gpu_peak_bytes\": %zu, \"allocations\": %zu}",
+		        i > 0 ? "," : "", memoryTagName((MemoryTag)i), stats.peak_bytes, stats.gpu_peak_bytes,
+		        tag_allocations);
+	}
+	fprintf(out, "\n    },\n    \"allocations\": %zu\n  }\n}\n", allocations);
+
+	if (out != stdout)
+		fclose(out);
+	return true;
+}
@@ -0,0 +1,124 @@
+#ifndef SCENARIO_HPP
+#define SCENARIO_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "broadphase.hpp"
+#include "inputjournal.hpp"
+#include "memorytracker.hpp"
+#include "model.hpp"
+#include "scene.hpp"
+
+// Stress scenarios script a session in place of the player: what the scene
+// starts with, how the camera turns and how fast snowballs are thrown. They
+// are text files of "<key> <values>" lines, '#' starts a comment line:
+//
+//   duration <seconds>           how long the scenario runs
+//   seed <n>                     of the spawner and of the starting scene
+//   enemies <count>              spawned around the player at the start
+//   spawn_interval <seconds>     between two enemy spawns after that
+//   spawn_radius <min> <max>     distance from the player enemies spawn at
+//   enemy_size <min> <max>
+//   fire_interval <seconds>      between two snowballs, fire is held all along; 0 never fires
+//   swarm <count> <radius>       snowballs already flying at the start, from
+//                                within radius of the player in random directions
+//   camera <time> <yaw> <pitch>  a point of the camera path, seconds and degrees;
+//                                the camera moves linearly between points and
+//                                holds the last one
+//   sample_interval <seconds>    between two entity counts of the report
+//
+// Keys left out keep the game's own settings. While it runs, the scenario
+// collects what its JSON report is made of.
+
+struct CameraKey {
+	float time;
+	float yaw;   // radians
+	float pitch;
+};
+
+class Scenario {
+public:
+	Scenario();
+
+	Scenario(const Scenario&) = delete;
+	Scenario& operator=(const Scenario&) = delete;
+
+	// Prints what is wrong with the file and returns false if anything is
+	bool Load(const char * path);
+
+	// The file's name without directory and extension
+	const std::string & Name() const {
+		return name_;
+	}
+
+	uint32_t Seed() const {
+		return seed_;
+	}
+
+	// With the fire rate and spawner settings of the scenario
+	Player CreatePlayer(Model * snowball_model) const;
+	EnemyCreator CreateSpawner(Model * enemy_model) const;
+
+	// Adds the starting enemies and swarm to an empty scene and starts the clock
+	void Start(int tick_rate, Model * enemy_model, Model * snowball_model, const glm::vec3 & center,
+	           std::vector<SceneObject*> & objects, Broadphase & broadphase);
+
+	// The next tick's input, false once the duration is over
+	bool Next(TickInput & input);
+
+	// By the simulation after every tick, with how long the tick and its
+	// frame packet took
+	void RecordTick(const std::vector<SceneObject*> & objects, double milliseconds);
+
+	// By the render thread after every frame
+	void RecordFrame(double milliseconds);
+
+	// Frame times, per-stage timings from the Profiler, entity counts over
+	// time and memory peaks, as JSON; to stdout if path is null. Without any
+	// frame rendered, as when headless, the ticks are the frames.
+	bool WriteReport(const char * path, const char * mode);
+
+private:
+	void CountEntities(const std::vector<SceneObject*> & objects);
+
+	std::string name_;
+	float duration_;
+	uint32_t seed_;
+	uint32_t enemies_;
+	float spawn_interval_;
+	float spawn_radius_[2];
+	float enemy_size_[2];
+	float fire_interval_;
+	uint32_t swarm_;
+	float swarm_radius_;
+	std::vector<CameraKey> camera_path_;
+	float sample_interval_;
+
+	// While running
+	int tick_rate_;
+	uint64_t tick_;
+	uint64_t sample_ticks_;
+	float yaw_;
+	float pitch_;
+	std::chrono::steady_clock::time_point start_time_;
+	double wall_seconds_;
+	size_t start_allocations_[MEMORY_TAG_COUNT];
+
+	struct EntitySample {
+		double time;
+		size_t enemies;
+		size_t snowballs;
+	};
+	std::vector<EntitySample> samples_;
+	size_t peak_objects_;
+	std::vector<double> tick_times_;
+	std::vector<double> frame_times_;
+};
+
+#endif
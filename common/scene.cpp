@@ -0,0 +1,291 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "assetid.hpp"
+#include "collision.hpp"
+#include "profiler.hpp"
+#include "scene.hpp"
+
+void createSphere(float radius, int sectorCount, int stackCount,
+                  std::vector<glm::vec3>& out_vertices,
+                  std::vector<glm::vec3>& out_normals,
+                  std::vector<glm::vec2>& out_uvs,
+                  glm::vec3 position) {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+
+	glm::mat4 translation_mat = glm::mat4(1.0f);
+	translation_mat = glm::translate(translation_mat, position);
+
+	float x, y, z, xy;                              // vertex position
+	float nx, ny, nz, lengthInv = 1.0f / radius;    // vertex normal
+	float s, t;                                     // vertex uv
+
+	float sectorStep = 2 * PI / sectorCount;
+	float stackStep = PI / stackCount;
+	float sectorAngle, stackAngle;
+
+	for (int i = 0; i <= stackCount; ++i) {
+		stackAngle = PI / 2 - i * stackStep;        // starting from pi/2 to -pi/2 (vertical angle)
+		xy = radius * cosf(stackAngle);          // r * cos(u)
+		z = radius * sinf(stackAngle);           // r * sin(u)
+
+		// the first and last vertices have same position and normal, but different tex coords
+		for (int j = 0; j <= sectorCount; ++j) {
+			sectorAngle = j * sectorStep;           // starting from 0 to 2pi (horizontal angle)
+
+			// vertex position (x, y, z)
+			x = xy * cosf(sectorAngle);          // r * cos(u) * cos(v)
+			y = xy * sinf(sectorAngle);          // r * cos(u) * sin(v)
+			glm::vec4 vertex = translation_mat * glm::vec4(x, y, z, 1.0f);
+			vertices.emplace_back(vertex);
+
+			// normalized vertex normal (nx, ny, nz)
+			nx = x * lengthInv;
+			ny = y * lengthInv;
+			nz = z * lengthInv;
+			glm::vec4 normal = translation_mat * glm::vec4(nx, ny, nz, 0.0f);
+			normals.emplace_back(normal);
+
+			// vertex uv coord (s, t) range between [0, 1]
+			s = (float) j / sectorCount;
+			t = (float) i / stackCount;
+			uvs.emplace_back(s, t);
+		}
+	}
+
+	for (int i = 0; i < stackCount; ++i) {
+		int k1 = i * (sectorCount + 1);     // beginning of current stack
+		int k2 = k1 + sectorCount + 1;      // beginning of next stack
+
+		for (int j = 0; j < sectorCount; ++j, ++k1, ++k2) {
+			// 2 triangles per sector excluding first and last stacks
+			// k1 => k2 => k1+1
+			if (i != 0) {
+				out_vertices.push_back(vertices[k1]);
+				out_vertices.push_back(vertices[k2]);
+				out_vertices.push_back(vertices[k1 + 1]);
+
+				out_normals.push_back(normals[k1]);
+				out_normals.push_back(normals[k2]);
+				out_normals.push_back(normals[k1 + 1]);
+
+				out_uvs.push_back(uvs[k1]);
+				out_uvs.push_back(uvs[k2]);
+				out_uvs.push_back(uvs[k1 + 1]);
+			}
+
+			// k1+1 => k2 => k2+1
+			if (i != (stackCount - 1)) {
+				out_vertices.push_back(vertices[k1 + 1]);
+				out_vertices.push_back(vertices[k2]);
+				out_vertices.push_back(vertices[k2 + 1]);
+
+				out_normals.push_back(normals[k1 + 1]);
+				out_normals.push_back(normals[k2]);
+				out_normals.push_back(normals[k2 + 1]);
+
+				out_uvs.push_back(uvs[k1 + 1]);
+				out_uvs.push_back(uvs[k2]);
+				out_uvs.push_back(uvs[k2 + 1]);
+			}
+		}
+	}
+}
+
+void CaptureScene(const std::vector<SceneObject*>& objects,
+                  const Player& player,
+                  const EnemyCreator& enemy_creator,
+                  double time,
+                  SceneSnapshot& snapshot) {
+	snapshot.player = player.SaveState(time);
+	snapshot.spawner = enemy_creator.SaveState(snapshot.rng_state, time);
+
+	snapshot.entities.resize(objects.size());
+	for (size_t i = 0; i < objects.size(); ++i) {
+		snapshot.entities[i] = objects[i]->ToRecord();
+	}
+}
+
+void AddObject(SceneObject* obj, std::vector<SceneObject*>& objects, Broadphase& broadphase) {
+	obj->SetProxy(broadphase.CreateProxy(obj->Bounds(), obj));
+	objects.push_back(obj);
+}
+
+void RestoreScene(const SceneSnapshot& snapshot,
+                  const std::vector<Model*>& models,
+                  std::vector<SceneObject*>& objects,
+                  Broadphase& broadphase,
+                  Player& player,
+                  EnemyCreator& enemy_creator,
+                  double time) {
+	for (SceneObject* obj : objects) {
+		delete obj;
+	}
+	objects.clear();
+	broadphase.Clear();
+	objects.reserve(snapshot.entities.size());
+
+	size_t dropped = 0;
+	for (const EntityRecord& record : snapshot.entities) {
+		Model* model = nullptr;
+		for (Model* candidate : models) {
+			if (candidate->GetMeshId() == record.mesh && candidate->GetTextureId() == record.texture) {
+				model = candidate;
+				break;
+			}
+		}
+
+		SceneObject* obj = model != nullptr ? SceneObject::FromRecord(record, model) : nullptr;
+		if (obj == nullptr) {
+			++dropped;
+			continue;
+		}
+		AddObject(obj, objects, broadphase);
+	}
+
+	if (dropped > 0) {
+		printf("Dropped %zu objects with unknown assets or kinds\n", dropped);
+	}
+
+	player.RestoreState(snapshot.player, time);
+	enemy_creator.RestoreState(snapshot.spawner, snapshot.rng_state, time);
+}
+
+uint32_t HashScene(const std::vector<SceneObject*>& objects,
+                   const Player& player,
+                   const EnemyCreator& enemy_creator,
+                   double time) {
+	SceneSnapshot snapshot;
+	CaptureScene(objects, player, enemy_creator, time, snapshot);
+	std::vector<unsigned char> serialized;
+	serializeSnapshot(snapshot, serialized);
+	return hashBytes(serialized.data(), serialized.size());
+}
+
+void CollideScene(GLfloat tick_seconds, std::vector<SceneObject*>& objects, Broadphase& broadphase) {
+	// Moving objects hand the box they sweep over the step to the broadphase
+	for (SceneObject* obj : objects) {
+		if (obj->GetSpeed() != 0.0f) {
+			glm::vec3 step = obj->Step(tick_seconds);
+			AABB swept = AABB::Union(obj->Bounds(), AABB::Sphere(obj->GetPosition() + step, obj->GetColliderRadius()));
+			broadphase.MoveProxy(obj->GetProxy(), swept, step);
+		}
+	}
+
+	// A snowball destroys the first enemy it touches, and itself with it.
+	// Snowballs are swept over the whole step rather than tested where they
+	// end up, so they cannot tunnel through small enemies at low tick rates
+	std::unordered_map<SceneObject*, std::pair<SceneObject*, float>> first_hits;
+	broadphase.UpdatePairs([&](int proxy_a, int proxy_b) {
+		auto a = static_cast<SceneObject*>(broadphase.GetUserData(proxy_a));
+		auto b = static_cast<SceneObject*>(broadphase.GetUserData(proxy_b));
+		if (a->IsSnowBall() == b->IsSnowBall()) {
+			return;
+		}
+		SceneObject* snowball = a->IsSnowBall() ? a : b;
+		SceneObject* enemy = a->IsSnowBall() ? b : a;
+
+		float time;
+		if (!sweepSpheres(snowball->GetPosition(), snowball->GetColliderRadius(), snowball->Step(tick_seconds),
+		                  enemy->GetPosition(), enemy->GetColliderRadius(), enemy->Step(tick_seconds), time)) {
+			return;
+		}
+		auto hit = first_hits.emplace(snowball, std::make_pair(enemy, time));
+		if (!hit.second && time < hit.first->second.second) {
+			hit.first->second = std::make_pair(enemy, time);
+		}
+	});
+
+	// An enemy dies once: hits are resolved earliest first, ties in scene
+	// order so replays agree, and a snowball whose enemy another snowball
+	// already destroyed flies on. The list keeps its capacity from tick to
+	// tick, so resolving allocates nothing once it has grown
+	struct Hit {
+		float time;
+		size_t order; // of the snowball in the scene
+		SceneObject* snowball;
+		SceneObject* enemy;
+	};
+	static thread_local std::vector<Hit> hits;
+	hits.clear();
+	if (first_hits.empty()) {
+		return;
+	}
+	for (size_t i = 0; i < objects.size(); ++i) {
+		auto hit = first_hits.find(objects[i]);
+		if (hit != first_hits.end()) {
+			hits.push_back({hit->second.second, i, objects[i], hit->second.first});
+		}
+	}
+	// Sorted in place; stable_sort would allocate a scratch buffer every tick
+	std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) {
+		return a.time < b.time || (a.time == b.time && a.order < b.order);
+	});
+	for (const Hit& hit : hits) {
+		if (hit.enemy->IsDestroyed()) {
+			continue;
+		}
+		hit.snowball->Destroy();
+		hit.enemy->Destroy();
+	}
+}
+
+void CompactScene(std::vector<SceneObject*>& objects, Broadphase& broadphase) {
+	std::vector<SceneObject*> alive_objects;
+
+	for (SceneObject* obj : objects) {
+		if (!obj->IsDestroyed()) {
+			alive_objects.push_back(obj);
+		} else {
+			broadphase.DestroyProxy(obj->GetProxy());
+			delete obj;
+		}
+	}
+
+	objects = alive_objects;
+}
+
+void SimulateTick(const TickInput& input,
+                  double time,
+                  GLfloat tick_seconds,
+                  std::vector<SceneObject*>& objects,
+                  Broadphase& broadphase,
+                  Player& player,
+                  EnemyCreator& enemy_creator) {
+	{
+		ScopedTimer timer("sim.collide_ms");
+		CollideScene(tick_seconds, objects, broadphase);
+	}
+
+	{
+		ScopedTimer timer("sim.move_ms");
+		for (SceneObject* obj : objects) {
+			if (obj->GetSpeed() != 0.0f && !obj->IsDestroyed()) {
+				obj->Shift(obj->Step(tick_seconds));
+				// A snowball that missed would otherwise fly on, and stay in the scene, forever
+				if (obj->IsSnowBall() && glm::length(obj->GetPosition() - player.GetPosition()) > SnowBall::kRange) {
+					obj->Destroy();
+				}
+			}
+		}
+	}
+
+	{
+		ScopedTimer timer("sim.compact_ms");
+		CompactScene(objects, broadphase);
+	}
+
+	SnowBall* new_snowball = player.CreateSnowBall(input, time);
+	if (new_snowball != nullptr) {
+		AddObject(new_snowball, objects, broadphase);
+	}
+
+	SceneObject* new_enemy = enemy_creator.CreateEnemy(player.GetPosition(), time);
+	if (new_enemy != nullptr) {
+		AddObject(new_enemy, objects, broadphase);
+	}
+}
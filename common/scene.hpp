@@ -0,0 +1,445 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include <stdint.h>
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "aabbtree.hpp"
+#include "broadphase.hpp"
+#include "inputjournal.hpp"
+#include "model.hpp"
+#include "snapshot.hpp"
+
+const float PI = 3.1416;
+
+// Appends an unindexed UV sphere of sectorCount by stackCount quads, centered on position
+void createSphere(float radius, int sectorCount, int stackCount,
+                  std::vector<glm::vec3>& out_vertices,
+                  std::vector<glm::vec3>& out_normals,
+                  std::vector<glm::vec2>& out_uvs,
+                  glm::vec3 position = glm::vec3(0, 0, 0));
+
+class Camera {
+public:
+	static constexpr double PI = 3.1416;
+
+	explicit Camera(GLfloat horizontal_angle = 0.0f,
+	                GLfloat vertical_angle = 0.0f,
+	                GLfloat fov = 45.0f):
+			horizontal_angle_(horizontal_angle),
+			vertical_angle_(vertical_angle),
+			fov_(fov) {}
+
+	virtual ~Camera() = default;
+
+	virtual glm::vec3 CameraDirection() {
+		return {
+				cos(vertical_angle_) * sin(horizontal_angle_),
+				sin(vertical_angle_),
+				cos(vertical_angle_) * cos(horizontal_angle_)
+		};
+	}
+
+	virtual glm::vec3 CameraRight() {
+		return {
+				sin(horizontal_angle_ - Camera::PI / 2),
+				0,
+				cos(horizontal_angle_ - Camera::PI / 2)
+		};
+	}
+
+	virtual glm::vec3 CameraUp() {
+		return glm::cross(CameraRight(), CameraDirection());
+	}
+
+	virtual GLfloat FOV() {
+		return fov_;
+	}
+
+protected:
+	GLfloat horizontal_angle_;
+	GLfloat vertical_angle_;
+	GLfloat fov_;
+};
+
+struct Transform {
+	glm::vec3 position;
+	glm::quat rotation;
+	GLfloat scale;
+
+	glm::mat4 Matrix() const {
+		glm::mat4 matrix = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation);
+		return glm::scale(matrix, glm::vec3(scale));
+	}
+};
+
+class SceneObject {
+public:
+	explicit SceneObject(EntityKind kind,
+	                     Model* model,
+	                     const Transform& transform,
+	                     const glm::vec3& direction,
+	                     GLfloat speed,
+	                     GLfloat collider_radius):
+			kind_(kind),
+			model_(model),
+			transform_(transform),
+			direction_(direction),
+			speed_(speed),
+			collider_radius_(collider_radius) {}
+
+	virtual ~SceneObject() = default;
+
+	bool IsIntersected(SceneObject* other) {
+		return glm::length(transform_.position - other->GetPosition()) < (collider_radius_ +
+		                                                                  other->GetColliderRadius());
+	}
+
+	Model* GetModel() const {
+		return model_;
+	}
+
+	const Transform& GetTransform() const {
+		return transform_;
+	}
+
+	glm::vec3 GetPosition() const {
+		return transform_.position;
+	}
+
+	GLfloat GetColliderRadius() const {
+		return collider_radius_;
+	}
+
+	glm::vec3 GetDirection() const {
+		return direction_;
+	};
+
+	float GetSpeed() const {
+		return speed_;
+	}
+
+	EntityKind GetKind() const {
+		return kind_;
+	}
+
+	bool IsSnowBall() const {
+		return kind_ == ENTITY_SNOWBALL;
+	}
+
+	// Box around the collider, which also encloses the mesh
+	AABB Bounds() const {
+		return AABB::Sphere(transform_.position, collider_radius_);
+	}
+
+	// Where the object is in the scene's Broadphase
+	int GetProxy() const {
+		return proxy_;
+	}
+
+	void SetProxy(int proxy) {
+		proxy_ = proxy;
+	}
+
+	// Destroyed objects are removed from the scene at the end of the tick
+	bool IsDestroyed() const {
+		return destroyed_;
+	}
+
+	void Destroy() {
+		destroyed_ = true;
+	}
+
+	// How far the object moves in the given time
+	glm::vec3 Step(GLfloat seconds) const {
+		return direction_ * speed_ * seconds;
+	}
+
+	void Shift(const glm::vec3& step) {
+		transform_.position += step;
+	}
+
+	void Rotate(GLfloat angle, const glm::vec3& axis) {
+		transform_.rotation = glm::angleAxis(angle, glm::normalize(axis)) * transform_.rotation;
+	}
+
+	EntityRecord ToRecord() const {
+		EntityRecord record = {
+				kind_,
+				model_->GetMeshId(),
+				model_->GetTextureId(),
+				{transform_.position.x, transform_.position.y, transform_.position.z},
+				{transform_.rotation.x, transform_.rotation.y, transform_.rotation.z, transform_.rotation.w},
+				transform_.scale,
+				{direction_.x, direction_.y, direction_.z},
+				speed_,
+				collider_radius_
+		};
+		return record;
+	}
+
+	// Null for kinds this build does not know
+	static SceneObject* FromRecord(const EntityRecord& record, Model* model) {
+		if (record.kind >= ENTITY_KIND_COUNT) {
+			return nullptr;
+		}
+		Transform transform = {
+				glm::make_vec3(record.position),
+				glm::quat(record.rotation[3], record.rotation[0], record.rotation[1], record.rotation[2]),
+				record.scale
+		};
+		return new SceneObject(EntityKind(record.kind), model, transform,
+		                       glm::make_vec3(record.direction), record.speed, record.collider_radius);
+	}
+
+protected:
+	EntityKind kind_;
+	Model* model_;
+	Transform transform_;
+	glm::vec3 direction_;
+	GLfloat speed_;
+	GLfloat collider_radius_;
+	int proxy_ = -1;
+	bool destroyed_ = false;
+};
+
+class CubeEnemy : public SceneObject {
+public:
+	explicit CubeEnemy(Model* model,
+	                   const glm::vec3& position,
+	                   glm::vec3 rotation = glm::vec3(1, 0, 0),
+	                   float angle = 0.0,
+	                   float scale_coef = 1.0f):
+			SceneObject(ENTITY_ENEMY,
+			            model,
+			            {position, glm::angleAxis(angle, glm::normalize(rotation)), scale_coef},
+			            glm::vec3(0.0f),
+			            0.0,
+			            2 * scale_coef) {}
+};
+
+class SnowBall : public SceneObject {
+public:
+	// Every snowball is a point light, the only light sources in the scene
+	static constexpr GLfloat kLightRadius = 20.0f;
+	static constexpr GLfloat kLightIntensity = 1.5f;
+	// Beyond the far plane a snowball can neither be seen nor hit anything the player sees
+	static constexpr GLfloat kRange = 300.0f;
+
+	// The shared sphere mesh has unit radius, so the collider radius doubles as the scale
+	explicit SnowBall(Model* model,
+	                  const glm::vec3& position,
+	                  const glm::vec3& direction,
+	                  GLfloat exclusion_radius = 0.75f,
+	                  GLfloat speed = 13.0f):
+			SceneObject(ENTITY_SNOWBALL,
+			            model,
+			            {position, glm::quat(), exclusion_radius},
+			            direction,
+			            speed,
+			            exclusion_radius) {}
+};
+
+class Player : public Camera {
+public:
+	explicit Player(Model* snowball_model,
+	                const glm::vec3& position = glm::vec3(0.0f),
+	                GLfloat collider_radius = 1.0f,
+	                GLfloat mouse_speed = 0.005f,
+	                GLfloat timedelay = 0.2f):
+			snowball_model_(snowball_model),
+			position_(position),
+			collider_radius_(collider_radius),
+			mouse_speed_(mouse_speed),
+			timedelay_(timedelay) {}
+
+	glm::vec3 GetPosition() const {
+		return position_;
+	}
+
+	GLfloat GetColliderRadius() const {
+		return collider_radius_;
+	}
+
+	// Turns the camera by the tick's cursor movement and throws a snowball if fire is held
+	SnowBall* CreateSnowBall(const TickInput& input, double time) {
+		horizontal_angle_ += mouse_speed_ * input.cursor_dx;
+		vertical_angle_ += mouse_speed_ * input.cursor_dy;
+
+		glm::vec3 camera_direction = CameraDirection();
+
+		if (input.buttons & INPUT_FIRE) {
+			if (time > next_creation_time_) {
+				next_creation_time_ = time + timedelay_;
+				auto* snowball = new SnowBall(snowball_model_,
+				                              position_ + camera_direction * 1.5f,
+				                              camera_direction);
+				return snowball;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Timers are saved relative to now, so a snapshot can be restored at any time
+	PlayerRecord SaveState(double time) const {
+		PlayerRecord record = {
+				{position_.x, position_.y, position_.z},
+				horizontal_angle_,
+				vertical_angle_,
+				GLfloat(glm::max(next_creation_time_ - time, 0.0))
+		};
+		return record;
+	}
+
+	void RestoreState(const PlayerRecord& record, double time) {
+		position_ = glm::make_vec3(record.position);
+		horizontal_angle_ = record.horizontal_angle;
+		vertical_angle_ = record.vertical_angle;
+		next_creation_time_ = time + record.fire_cooldown;
+	}
+
+protected:
+	Model* snowball_model_;
+	glm::vec3 position_;
+	GLfloat collider_radius_;
+	GLfloat mouse_speed_;
+	GLfloat timedelay_;
+	double next_creation_time_ = 0.0;
+};
+
+class EnemyCreator {
+public:
+	// The seed is the only source of randomness, so it is all a replay needs to spawn the same enemies
+	explicit EnemyCreator(Model* enemy_model,
+	                      uint32_t seed,
+	                      GLfloat timedelay = 3.0f,
+	                      GLfloat min_radius = 5.0f,
+	                      GLfloat max_radius = 50.0f,
+	                      GLfloat min_size = 0.5f,
+	                      GLfloat max_size = 4.0f):
+			enemy_model_(enemy_model),
+			timedelay_(timedelay),
+			rng_(seed),
+			angle_(0, 2*PI),
+			radius_(min_radius, max_radius),
+			size_(min_size, max_size) {}
+
+	SceneObject* CreateEnemy(const glm::vec3& position, double time) {
+		if (time <= next_creation_time_) {
+			return nullptr;
+		}
+
+		next_creation_time_ = time + timedelay_;
+
+		GLfloat angle_rotation = angle_(rng_);
+		GLfloat phi = angle_(rng_);
+		GLfloat theta = angle_(rng_);
+
+		glm::vec3 rotation_axis(
+		        cos(phi) * sin(theta),
+		        sin(phi),
+		        cos(phi) * cos(theta)
+		);
+
+		GLfloat angle_position = angle_(rng_);
+		glm::vec3 direction(
+		        sin(angle_position),
+		        0.0f,
+		        cos(angle_position)
+		);
+
+		GLfloat radius = radius_(rng_);
+		glm::vec3 new_position = position + radius * direction;
+
+		GLfloat size = size_(rng_);
+		SceneObject* new_obj = new CubeEnemy(enemy_model_,
+		                                     new_position,
+		                                     rotation_axis,
+		                                     angle_rotation,
+		                                     size);
+
+		return new_obj;
+	}
+
+	SpawnerRecord SaveState(std::string& rng_state, double time) const {
+		std::ostringstream stream;
+		stream << rng_;
+		rng_state = stream.str();
+
+		SpawnerRecord record = {GLfloat(glm::max(next_creation_time_ - time, 0.0))};
+		return record;
+	}
+
+	void RestoreState(const SpawnerRecord& record, const std::string& rng_state, double time) {
+		std::istringstream stream(rng_state);
+		stream >> rng_;
+		next_creation_time_ = time + record.spawn_cooldown;
+	}
+
+private:
+	Model* enemy_model_;
+	GLfloat timedelay_;
+	double next_creation_time_ = 0.0;
+	std::mt19937 rng_;
+	std::uniform_real_distribution<> angle_;
+	std::uniform_real_distribution<> radius_;
+	std::uniform_real_distribution<> size_;
+};
+
+// Only copies records, so it is cheap enough to run on the render thread; reusing
+// the snapshot keeps the entity array's capacity from the previous save
+void CaptureScene(const std::vector<SceneObject*>& objects,
+                  const Player& player,
+                  const EnemyCreator& enemy_creator,
+                  double time,
+                  SceneSnapshot& snapshot);
+
+// Every object in the scene is also in the broadphase
+void AddObject(SceneObject* obj, std::vector<SceneObject*>& objects, Broadphase& broadphase);
+
+// Replaces the scene; records whose mesh and texture match none of the models, or
+// whose kind is unknown, are dropped
+void RestoreScene(const SceneSnapshot& snapshot,
+                  const std::vector<Model*>& models,
+                  std::vector<SceneObject*>& objects,
+                  Broadphase& broadphase,
+                  Player& player,
+                  EnemyCreator& enemy_creator,
+                  double time);
+
+// Identifies a scene state; replays compare it with the one the recording ended with
+uint32_t HashScene(const std::vector<SceneObject*>& objects,
+                   const Player& player,
+                   const EnemyCreator& enemy_creator,
+                   double time);
+
+// The collision pass of a tick: hands every moving object's swept box to the
+// broadphase, then destroys each snowball together with the first enemy it
+// touches during the step. Nothing is moved or removed yet.
+void CollideScene(GLfloat tick_seconds, std::vector<SceneObject*>& objects, Broadphase& broadphase);
+
+// Takes the destroyed objects out of the scene and the broadphase and deletes them
+void CompactScene(std::vector<SceneObject*>& objects, Broadphase& broadphase);
+
+// Advances the scene by one fixed tick. The tick reads nothing but its
+// arguments, so the same inputs from the same state always give the same scene
+void SimulateTick(const TickInput& input,
+                  double time,
+                  GLfloat tick_seconds,
+                  std::vector<SceneObject*>& objects,
+                  Broadphase& broadphase,
+                  Player& player,
+                  EnemyCreator& enemy_creator);
+
+#endif
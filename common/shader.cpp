@@ -5,6 +5,8 @@
 #include <fstream>
 #include <algorithm>
 #include <sstream>
+#include <map>
+#include <set>
 using namespace std;
 
 #include <stdlib.h>
@@ -12,37 +14,128 @@ using namespace std;
 
 #include <GL/glew.h>
 
+#include "assetpack.hpp"
+#include "memorytracker.hpp"
 #include "shader.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+// Active uniform locations of every program, filled once right after linking
+static std::map<GLuint, std::map<std::string, GLint> > UniformLocations;
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+static void ReflectProgram(GLuint ProgramID){
+
+	std::map<std::string, GLint> & Locations = UniformLocations[ProgramID];
+
+	GLint UniformCount = 0;
+	GLint MaxNameLength = 0;
+	glGetProgramiv(ProgramID, GL_ACTIVE_UNIFORMS, &UniformCount);
+	glGetProgramiv(ProgramID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &MaxNameLength);
+
+	std::vector<char> Name(MaxNameLength + 1);
+	for (GLint i = 0; i < UniformCount; i++){
+		GLint Size;
+		GLenum Type;
+		glGetActiveUniform(ProgramID, i, Name.size(), NULL, &Size, &Type, &Name[0]);
+
+		// Members of uniform blocks have no location, they are set through the buffer
+		GLint Location = glGetUniformLocation(ProgramID, &Name[0]);
+		if (Location == -1)
+			continue;
+
+		// Arrays are reported as "name[0]", accept the plain name as well
+		std::string UniformName(&Name[0]);
+		size_t Bracket = UniformName.find("[0]");
+		if (Bracket != std::string::npos)
+			UniformName.erase(Bracket);
+		Locations[UniformName] = Location;
+	}
+
+	GLuint BlockIndex = glGetUniformBlockIndex(ProgramID, "FrameUniforms");
+	if (BlockIndex != GL_INVALID_INDEX){
+		GLint BlockSize = 0;
+		glGetActiveUniformBlockiv(ProgramID, BlockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &BlockSize);
+		if (BlockSize != (GLint)sizeof(FrameUniforms))
+			printf("FrameUniforms is %d bytes in the shader but %d bytes in C++\n", BlockSize, (int)sizeof(FrameUniforms));
+		glUniformBlockBinding(ProgramID, BlockIndex, FRAME_UNIFORMS_BINDING);
+	}
+}
+
+// The driver's binary of the program is the closest to its size it reports
+static void TrackProgram(GLuint ProgramID){
+
+	GLint BinaryLength = 0;
+	if (GLEW_ARB_get_program_binary)
+		glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &BinaryLength);
+	MemoryTracker::Instance().TrackGpu(GPU_PROGRAM, ProgramID, BinaryLength);
+}
+
+GLint GetUniformLocation(GLuint programID, const char * name){
+
+	std::map<std::string, GLint> & Locations = UniformLocations[programID];
+	std::map<std::string, GLint>::const_iterator Found = Locations.find(name);
+	if (Found != Locations.end())
+		return Found->second;
+
+	// Unknown or optimized out; remember it so we only complain once
+	printf("Program %u has no active uniform %s\n", programID, name);
+	Locations[name] = -1;
+	return -1;
+}
+
+void DeleteProgram(GLuint programID){
+
+	UniformLocations.erase(programID);
+	MemoryTracker::Instance().UntrackGpu(GPU_PROGRAM, programID);
+	glDeleteProgram(programID);
+}
+
+GLuint CreateFrameUniformBuffer(){
+
+	GLuint BufferID;
+	glGenBuffers(1, &BufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, BufferID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+	MemoryTracker::Instance().TrackGpu(GPU_BUFFER, BufferID, sizeof(FrameUniforms));
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, BufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return BufferID;
+}
+
+void UpdateFrameUniformBuffer(GLuint bufferID, const FrameUniforms & uniforms){
+
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferID);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &uniforms);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+bool ReadShaderSource(const char * file_path, std::string & code){
+	AssetData file;
+	if (!AssetVfs::Instance().Open(file_path, file))
+		return false;
+	code.assign((const char *)file.Data(), file.Size());
+	return true;
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
 
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
+	if(!ReadShaderSource(vertex_file_path, VertexShaderCode))
 		return 0;
-	}
 
 	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
-	}
+	if(!ReadShaderSource(fragment_file_path, FragmentShaderCode))
+		return 0;
+
+	return CompileShaders(vertex_file_path, VertexShaderCode, fragment_file_path, FragmentShaderCode);
+}
+
+GLuint CompileShaders(const char * vertex_file_path, const std::string & VertexShaderCode,
+                      const char * fragment_file_path, const std::string & FragmentShaderCode){
+
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
@@ -105,7 +198,67 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	ReflectProgram(ProgramID);
+	TrackProgram(ProgramID);
+
 	return ProgramID;
 }
 
+GLuint LoadComputeShader(const char * compute_file_path){
+
+	std::string ComputeShaderCode;
+	if(!ReadShaderSource(compute_file_path, ComputeShaderCode))
+		return 0;
+
+	return CompileComputeShader(compute_file_path, ComputeShaderCode);
+}
+
+GLuint CompileComputeShader(const char * compute_file_path, const std::string & ComputeShaderCode){
+
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+
+	// Compile Compute Shader
+	printf("Compiling shader : %s\n", compute_file_path);
+	GLuint ComputeShaderID = glCreateShader(GL_COMPUTE_SHADER);
+	char const * ComputeSourcePointer = ComputeShaderCode.c_str();
+	glShaderSource(ComputeShaderID, 1, &ComputeSourcePointer , NULL);
+	glCompileShader(ComputeShaderID);
+
+	// Check Compute Shader
+	glGetShaderiv(ComputeShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ComputeShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ComputeShaderID, InfoLogLength, NULL, &ComputeShaderErrorMessage[0]);
+		printf("%s\n", &ComputeShaderErrorMessage[0]);
+	}
+
+	// Link the program
+	printf("Linking program\n");
+	GLuint ProgramID = glCreateProgram();
+	glAttachShader(ProgramID, ComputeShaderID);
+	glLinkProgram(ProgramID);
+
+	// Check the program
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
+		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		printf("%s\n", &ProgramErrorMessage[0]);
+	}
+
+	glDetachShader(ProgramID, ComputeShaderID);
+	glDeleteShader(ComputeShaderID);
 
+	// Unlike LoadShaders, callers have a fallback, so a failed build is reported
+	if (Result != GL_TRUE){
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+
+	ReflectProgram(ProgramID);
+	TrackProgram(ProgramID);
+
+	return ProgramID;
+}
@@ -1,6 +1,51 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+#include <string>
+
+#include <glm/glm.hpp>
+
+// Binding point of the FrameUniforms block, the same for every program
+#define FRAME_UNIFORMS_BINDING 0
+
+// Per-frame camera data, laid out like the std140 FrameUniforms block in the shaders
+struct FrameUniforms {
+	glm::mat4 View;
+	glm::mat4 Projection;
+	glm::mat4 ViewProjection;
+	glm::vec4 CameraPosition;
+	glm::vec2 ViewportSize;
+	float NearPlane;
+	float FarPlane;
+	float Time;
+	float Padding[3];
+};
+
+// Reads a shader source through the AssetVfs; safe to call from any thread
+bool ReadShaderSource(const char * file_path, std::string & code);
+
+// Compiles and links the program, binds its FrameUniforms block and caches its uniform locations
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
 
+// The GL half of LoadShaders, for sources read elsewhere; the paths only name them in messages
+GLuint CompileShaders(const char * vertex_file_path, const std::string & VertexShaderCode,
+                      const char * fragment_file_path, const std::string & FragmentShaderCode);
+
+// Same for a compute program; 0 if the file is missing or the program does not link
+GLuint LoadComputeShader(const char * compute_file_path);
+GLuint CompileComputeShader(const char * compute_file_path, const std::string & ComputeShaderCode);
+
+// Cached location of an active uniform; complains once and returns -1 for unknown names
+GLint GetUniformLocation(GLuint programID, const char * name);
+
+// Deletes the program and forgets its uniform locations, which a later
+// program given the same name must not inherit
+void DeleteProgram(GLuint programID);
+
+// Creates the FrameUniforms buffer and binds it to FRAME_UNIFORMS_BINDING
+GLuint CreateFrameUniformBuffer();
+
+// One upload per frame, shared by every program
+void UpdateFrameUniformBuffer(GLuint bufferID, const FrameUniforms & uniforms);
+
 #endif
@@ -0,0 +1,273 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <zlib.h>
+
+#include "mappedfile.hpp"
+#include "snapshot.hpp"
+
+struct SnapshotHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t entity_record_size;
+	uint32_t entity_count;
+	uint32_t rng_state_size;  // padded to 4 bytes in the file
+	PlayerRecord player;
+	SpawnerRecord spawner;
+};
+
+// The file layout depends on these, bump SNAPSHOT_VERSION when they change
+static_assert(sizeof(EntityRecord) == 64, "EntityRecord layout changed");
+static_assert(sizeof(SnapshotHeader) == 52, "SnapshotHeader layout changed");
+
+static const char SnapshotMagic[4] = { 'S', 'H', 'S', 'N' };
+
+// A compressed snapshot is this header followed by a zlib stream of the plain file
+struct CompressedHeader {
+	char magic[4];
+	uint32_t uncompressed_size;
+};
+
+static const char CompressedMagic[4] = { 'S', 'H', 'S', 'Z' };
+static const uint32_t MaxDeflateRatio = 1032;
+static const uint32_t MaxUncompressedSnapshotSize = 256u << 20;
+
+static bool hostIsLittleEndian(){
+	const uint32_t probe = 1;
+	return *(const unsigned char *)&probe == 1;
+}
+
+static void swapWords(void * data, size_t size){
+	uint32_t * words = (uint32_t *)data;
+	for (size_t i = 0; i < size / 4; i++){
+		uint32_t w = words[i];
+		words[i] = (w >> 24) | ((w >> 8) & 0xFF00u) | ((w << 8) & 0xFF0000u) | (w << 24);
+	}
+}
+
+static size_t padded(size_t size){
+	return (size + 3) & ~(size_t)3;
+}
+
+void serializeSnapshot(const SceneSnapshot & snapshot, std::vector<unsigned char> & out){
+
+	SnapshotHeader header;
+	memcpy(header.magic, SnapshotMagic, 4);
+	header.version = SNAPSHOT_VERSION;
+	header.header_size = sizeof(SnapshotHeader);
+	header.entity_record_size = sizeof(EntityRecord);
+	header.entity_count = snapshot.entities.size();
+	header.rng_state_size = snapshot.rng_state.size();
+	header.player = snapshot.player;
+	header.spawner = snapshot.spawner;
+
+	size_t rng_offset = sizeof(SnapshotHeader);
+	size_t entities_offset = rng_offset + padded(snapshot.rng_state.size());
+	size_t entities_size = snapshot.entities.size() * sizeof(EntityRecord);
+
+	out.assign(entities_offset + entities_size, 0);
+	memcpy(&out[0], &header, sizeof(header));
+	memcpy(&out[rng_offset], snapshot.rng_state.data(), snapshot.rng_state.size());
+	if (entities_size > 0)
+		memcpy(&out[entities_offset], snapshot.entities.data(), entities_size);
+
+	if (!hostIsLittleEndian()){
+		// The magic and the RNG text are bytes, everything else is 32-bit words
+		swapWords(&out[4], sizeof(SnapshotHeader) - 4);
+		swapWords(&out[entities_offset], entities_size);
+	}
+}
+
+bool compressSnapshot(const std::vector<unsigned char> & serialized, std::vector<unsigned char> & out){
+
+	CompressedHeader header;
+	memcpy(header.magic, CompressedMagic, 4);
+	header.uncompressed_size = serialized.size();
+
+	uLongf compressed_size = compressBound(serialized.size());
+	out.resize(sizeof(CompressedHeader) + compressed_size);
+	int result = compress2(&out[sizeof(CompressedHeader)], &compressed_size,
+	                       serialized.data(), serialized.size(), Z_BEST_SPEED);
+	if (result != Z_OK){
+		printf("Could not compress the snapshot (zlib error %d)\n", result);
+		return false;
+	}
+	out.resize(sizeof(CompressedHeader) + compressed_size);
+
+	if (!hostIsLittleEndian())
+		swapWords(&header.uncompressed_size, sizeof(header.uncompressed_size));
+	memcpy(&out[0], &header, sizeof(header));
+	return true;
+}
+
+bool writeFileAtomically(const char * path, const void * data, size_t size){
+
+	// Write a temporary file next to the target and rename it over the target once it is on disk,
+	// so a crash in the middle of a save leaves the previous file intact
+	std::string temporary_path = std::string(path) + ".tmp";
+	FILE * file = fopen(temporary_path.c_str(), "wb");
+	if (file == NULL){
+		printf("Impossible to open %s for writing\n", temporary_path.c_str());
+		return false;
+	}
+	bool ok = fwrite(data, 1, size, file) == size && fflush(file) == 0;
+#ifdef _WIN32
+	ok = ok && _commit(_fileno(file)) == 0;
+#else
+	ok = ok && fsync(fileno(file)) == 0;
+#endif
+	ok = (fclose(file) == 0) && ok;
+
+#ifdef _WIN32
+	// rename() does not replace existing files on Windows
+	ok = ok && (remove(path) == 0 || errno == ENOENT);
+#endif
+	ok = ok && rename(temporary_path.c_str(), path) == 0;
+	if (!ok){
+		printf("Could not write %s\n", path);
+		remove(temporary_path.c_str());
+		return false;
+	}
+
+#ifndef _WIN32
+	// Make the rename itself durable
+	std::string directory(path);
+	size_t slash = directory.find_last_of('/');
+	directory = slash == std::string::npos ? "." : directory.substr(0, slash + 1);
+	int directory_fd = open(directory.c_str(), O_RDONLY);
+	if (directory_fd >= 0){
+		fsync(directory_fd);
+		close(directory_fd);
+	}
+#endif
+	return true;
+}
+
+bool saveSnapshot(const char * path, const SceneSnapshot & snapshot, SnapshotFormat format){
+
+	std::vector<unsigned char> serialized;
+	if (format == SNAPSHOT_TEXT)
+		serializeTextSnapshot(snapshot, serialized);
+	else
+		serializeSnapshot(snapshot, serialized);
+	if (format != SNAPSHOT_COMPRESSED)
+		return writeFileAtomically(path, serialized.data(), serialized.size());
+
+	std::vector<unsigned char> compressed;
+	return compressSnapshot(serialized, compressed) &&
+	       writeFileAtomically(path, compressed.data(), compressed.size());
+}
+
+static bool parsePlainSnapshot(const unsigned char * data, size_t size, const char * path, SceneSnapshot & snapshot);
+
+bool parseSnapshot(const unsigned char * data, size_t size, const char * path, SceneSnapshot & snapshot){
+
+	if (size < sizeof(CompressedHeader) || memcmp(data, CompressedMagic, 4) != 0)
+		return parsePlainSnapshot(data, size, path, snapshot);
+
+	CompressedHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (!hostIsLittleEndian())
+		swapWords(&header.uncompressed_size, sizeof(header.uncompressed_size));
+
+	// The size comes from the file, so check it before allocating: deflate cannot do better than
+	// about 1032:1, and no scene comes anywhere near the absolute cap
+	size_t compressed_size = size - sizeof(header);
+	if (header.uncompressed_size > MaxUncompressedSnapshotSize ||
+	    header.uncompressed_size / MaxDeflateRatio > compressed_size){
+		printf("%s is truncated or corrupt\n", path);
+		return false;
+	}
+
+	// The vendored zlib has no uncompress(), inflate in one call instead
+	std::vector<unsigned char> plain(header.uncompressed_size);
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit(&stream) != Z_OK){
+		printf("Could not inflate %s\n", path);
+		return false;
+	}
+	stream.next_in = (Bytef *)(data + sizeof(header));
+	stream.avail_in = compressed_size;
+	stream.next_out = plain.data();
+	stream.avail_out = plain.size();
+	int result = inflate(&stream, Z_FINISH);
+	uLong plain_size = stream.total_out;
+	inflateEnd(&stream);
+	if (result != Z_STREAM_END || plain_size != plain.size()){
+		printf("%s is truncated or corrupt\n", path);
+		return false;
+	}
+	return parsePlainSnapshot(plain.data(), plain.size(), path, snapshot);
+}
+
+static bool parsePlainSnapshot(const unsigned char * data, size_t size, const char * path, SceneSnapshot & snapshot){
+
+	SnapshotHeader header;
+	if (size < sizeof(SnapshotHeader) || memcmp(data, SnapshotMagic, 4) != 0){
+		printf("%s is not a scene snapshot\n", path);
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (!hostIsLittleEndian())
+		swapWords((unsigned char *)&header + 4, sizeof(SnapshotHeader) - 4);
+
+	if (header.version != SNAPSHOT_VERSION){
+		printf("%s has snapshot version %u, expected %u\n", path, header.version, SNAPSHOT_VERSION);
+		return false;
+	}
+
+	// Newer writers may append fields to the header or the records, older ones may not
+	size_t rng_offset = header.header_size;
+	size_t entities_offset = rng_offset + padded(header.rng_state_size);
+	size_t record_size = header.entity_record_size;
+	if (header.header_size < sizeof(SnapshotHeader) || record_size < sizeof(EntityRecord) ||
+	    entities_offset > size || (size - entities_offset) / record_size < header.entity_count){
+		printf("%s is truncated or corrupt\n", path);
+		return false;
+	}
+
+	snapshot.player = header.player;
+	snapshot.spawner = header.spawner;
+	snapshot.rng_state.assign((const char *)data + rng_offset, header.rng_state_size);
+
+	snapshot.entities.resize(header.entity_count);
+	const unsigned char * records = data + entities_offset;
+	if (record_size == sizeof(EntityRecord)){
+		if (header.entity_count > 0)
+			memcpy(snapshot.entities.data(), records, header.entity_count * sizeof(EntityRecord));
+	}else{
+		for (size_t i = 0; i < header.entity_count; i++)
+			memcpy(&snapshot.entities[i], records + i * record_size, sizeof(EntityRecord));
+	}
+	if (!hostIsLittleEndian() && header.entity_count > 0)
+		swapWords(snapshot.entities.data(), header.entity_count * sizeof(EntityRecord));
+
+	for (const EntityRecord & record : snapshot.entities){
+		if (record.kind >= ENTITY_KIND_COUNT){
+			printf("%s has an object of unknown kind %u\n", path, record.kind);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool loadSnapshot(const char * path, SceneSnapshot & snapshot){
+
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	if (isTextSnapshot((const char *)file.Data(), file.Size()))
+		return parseTextSnapshot((const char *)file.Data(), file.Size(), path, snapshot);
+	return parseSnapshot(file.Data(), file.Size(), path, snapshot);
+}
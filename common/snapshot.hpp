@@ -0,0 +1,80 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "assetid.hpp"
+
+// Binary scene snapshots. A file is a SnapshotHeader, the enemy spawner's
+// RNG state and then one EntityRecord per scene object, all little-endian
+// and 4-byte aligned. Every field is 32 bits wide so that byte swapping on
+// big-endian hosts is a plain word swap.
+
+#define SNAPSHOT_VERSION 1
+
+enum EntityKind : uint32_t {
+	ENTITY_ENEMY = 0,
+	ENTITY_SNOWBALL = 1,
+	ENTITY_KIND_COUNT
+};
+
+struct EntityRecord {
+	uint32_t kind;     // EntityKind; the loaders reject files with any other value
+	AssetId mesh;
+	AssetId texture;
+	float position[3];
+	float rotation[4]; // quaternion, x y z w
+	float scale;
+	float direction[3];
+	float speed;
+	float collider_radius;
+};
+
+struct PlayerRecord {
+	float position[3];
+	float horizontal_angle;
+	float vertical_angle;
+	float fire_cooldown;  // seconds until the next snowball may be thrown
+};
+
+struct SpawnerRecord {
+	float spawn_cooldown; // seconds until the next enemy spawns
+};
+
+struct SceneSnapshot {
+	PlayerRecord player;
+	SpawnerRecord spawner;
+	std::string rng_state; // std::mt19937 as written by operator<<
+	std::vector<EntityRecord> entities;
+};
+
+enum SnapshotFormat {
+	SNAPSHOT_BINARY,
+	SNAPSHOT_COMPRESSED, // binary, zlib-compressed
+	SNAPSHOT_TEXT,       // line-oriented and human-readable, see snapshottext.cpp
+};
+
+// Serializes into one buffer and writes it with a single fwrite
+bool saveSnapshot(const char * path, const SceneSnapshot & snapshot, SnapshotFormat format = SNAPSHOT_BINARY);
+
+// Maps the file and reads any of the formats; compressed files are inflated first
+bool loadSnapshot(const char * path, SceneSnapshot & snapshot);
+
+// loadSnapshot for a snapshot already in memory, binary or compressed
+bool parseSnapshot(const unsigned char * data, size_t size, const char * path, SceneSnapshot & snapshot);
+
+// The steps of saveSnapshot, for writers that want to time or thread them separately
+void serializeSnapshot(const SceneSnapshot & snapshot, std::vector<unsigned char> & out);
+bool compressSnapshot(const std::vector<unsigned char> & serialized, std::vector<unsigned char> & out);
+void serializeTextSnapshot(const SceneSnapshot & snapshot, std::vector<unsigned char> & out);
+
+bool isTextSnapshot(const char * data, size_t size);
+bool parseTextSnapshot(const char * data, size_t size, const char * path, SceneSnapshot & snapshot);
+
+// Writes path.tmp, flushes it to disk and renames it over path
+bool writeFileAtomically(const char * path, const void * data, size_t size);
+
+#endif
@@ -0,0 +1,281 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <charconv>
+
+#include "snapshot.hpp"
+#include "textcursor.hpp"
+
+// Text snapshots, one item per line, '#' starts a comment line:
+//
+//   shooter-scene 1
+//   player <x> <y> <z> <horizontal angle> <vertical angle> <fire cooldown>
+//   spawner <spawn cooldown>
+//   rng <std::mt19937 state>
+//   entities <count>
+//   schema <column> <column> ...
+//   <one line per entity, values in schema order>
+//
+// The schema line names the EntityRecord fields the entity lines contain, so
+// columns can be reordered, unknown ones are skipped and missing ones stay 0.
+// Floats are written with std::to_chars, whose shortest representation reads
+// back to the exact same value. Asset IDs are hexadecimal.
+
+#define TEXT_SNAPSHOT_MAGIC "shooter-scene"
+#define TEXT_SNAPSHOT_VERSION 1
+
+enum ColumnType { COLUMN_UINT, COLUMN_HEX, COLUMN_FLOAT };
+
+struct TextColumn {
+	const char * name;
+	size_t offset;
+	ColumnType type;
+};
+
+#define FLOAT_COLUMN(name, field, index) { name, offsetof(EntityRecord, field) + (index) * sizeof(float), COLUMN_FLOAT }
+
+static const TextColumn EntityColumns[] = {
+	{ "kind", offsetof(EntityRecord, kind), COLUMN_UINT },
+	{ "mesh", offsetof(EntityRecord, mesh), COLUMN_HEX },
+	{ "texture", offsetof(EntityRecord, texture), COLUMN_HEX },
+	FLOAT_COLUMN("position.x", position, 0),
+	FLOAT_COLUMN("position.y", position, 1),
+	FLOAT_COLUMN("position.z", position, 2),
+	FLOAT_COLUMN("rotation.x", rotation, 0),
+	FLOAT_COLUMN("rotation.y", rotation, 1),
+	FLOAT_COLUMN("rotation.z", rotation, 2),
+	FLOAT_COLUMN("rotation.w", rotation, 3),
+	FLOAT_COLUMN("scale", scale, 0),
+	FLOAT_COLUMN("direction.x", direction, 0),
+	FLOAT_COLUMN("direction.y", direction, 1),
+	FLOAT_COLUMN("direction.z", direction, 2),
+	FLOAT_COLUMN("speed", speed, 0),
+	FLOAT_COLUMN("collider_radius", collider_radius, 0),
+};
+
+static const size_t EntityColumnCount = sizeof(EntityColumns) / sizeof(EntityColumns[0]);
+
+// Longest possible entity line: every value at its widest plus separators
+static const size_t MaxEntityLine = EntityColumnCount * 24 + 2;
+
+bool isTextSnapshot(const char * data, size_t size){
+	size_t length = strlen(TEXT_SNAPSHOT_MAGIC);
+	return size > length && memcmp(data, TEXT_SNAPSHOT_MAGIC, length) == 0 && data[length] == ' ';
+}
+
+// Appends to a buffer that grows in large steps, so the writer never reallocates per value
+class TextBuffer {
+public:
+	explicit TextBuffer(std::vector<unsigned char> & out):
+		out_(out),
+		used_(0) {}
+
+	~TextBuffer(){
+		out_.resize(used_);
+	}
+
+	void Reserve(size_t size){
+		if (out_.size() - used_ < size)
+			out_.resize(std::max(out_.size() * 2, used_ + size));
+	}
+
+	void Write(const char * text){
+		size_t length = strlen(text);
+		Reserve(length);
+		memcpy(&out_[used_], text, length);
+		used_ += length;
+	}
+
+	void Write(const std::string & text){
+		Reserve(text.size());
+		memcpy(&out_[used_], text.data(), text.size());
+		used_ += text.size();
+	}
+
+	// The caller reserves space for the values of a line up front
+	void Put(char c){
+		out_[used_++] = c;
+	}
+
+	void Put(float value){
+		used_ = std::to_chars(Begin() + used_, Begin() + out_.size(), value).ptr - Begin();
+	}
+
+	void Put(uint32_t value, int base = 10){
+		used_ = std::to_chars(Begin() + used_, Begin() + out_.size(), value, base).ptr - Begin();
+	}
+
+private:
+	char * Begin(){
+		return (char *)out_.data();
+	}
+
+	std::vector<unsigned char> & out_;
+	size_t used_;
+};
+
+void serializeTextSnapshot(const SceneSnapshot & snapshot, std::vector<unsigned char> & out){
+
+	out.resize(MaxEntityLine * (snapshot.entities.size() + 16) + snapshot.rng_state.size());
+	TextBuffer buffer(out);
+
+	buffer.Reserve(MaxEntityLine);
+	buffer.Write(TEXT_SNAPSHOT_MAGIC " ");
+	buffer.Put((uint32_t)TEXT_SNAPSHOT_VERSION);
+	buffer.Put('\n');
+
+	const PlayerRecord & player = snapshot.player;
+	const float player_values[6] = { player.position[0], player.position[1], player.position[2],
+	                                  player.horizontal_angle, player.vertical_angle, player.fire_cooldown };
+	buffer.Reserve(MaxEntityLine);
+	buffer.Write("player");
+	for (float value : player_values){
+		buffer.Put(' ');
+		buffer.Put(value);
+	}
+	buffer.Put('\n');
+
+	buffer.Reserve(MaxEntityLine);
+	buffer.Write("spawner ");
+	buffer.Put(snapshot.spawner.spawn_cooldown);
+	buffer.Put('\n');
+
+	buffer.Write("rng ");
+	buffer.Write(snapshot.rng_state);
+	buffer.Write("\n");
+
+	buffer.Reserve(MaxEntityLine);
+	buffer.Write("entities ");
+	buffer.Put((uint32_t)snapshot.entities.size());
+	buffer.Put('\n');
+
+	buffer.Write("schema");
+	for (const TextColumn & column : EntityColumns){
+		buffer.Write(" ");
+		buffer.Write(column.name);
+	}
+	buffer.Write("\n");
+
+	for (const EntityRecord & record : snapshot.entities){
+		buffer.Reserve(MaxEntityLine);
+		const unsigned char * base = (const unsigned char *)&record;
+		for (size_t i = 0; i < EntityColumnCount; i++){
+			if (i > 0)
+				buffer.Put(' ');
+			const TextColumn & column = EntityColumns[i];
+			if (column.type == COLUMN_FLOAT){
+				float value;
+				memcpy(&value, base + column.offset, sizeof(value));
+				buffer.Put(value);
+			}else{
+				uint32_t value;
+				memcpy(&value, base + column.offset, sizeof(value));
+				buffer.Put(value, column.type == COLUMN_HEX ? 16 : 10);
+			}
+		}
+		buffer.Put('\n');
+	}
+}
+
+bool parseTextSnapshot(const char * data, size_t size, const char * path, SceneSnapshot & snapshot){
+
+	TextCursor cursor(data, size);
+	const char * token;
+	size_t length;
+
+	uint32_t version = 0;
+	if (!cursor.NextLine() || !cursor.NextToken(token, length) || !tokenIs(token, length, TEXT_SNAPSHOT_MAGIC) ||
+	    !parseUint(cursor, version))
+		return parseError(path, cursor, "not a text scene snapshot");
+	if (version != TEXT_SNAPSHOT_VERSION)
+		return parseError(path, cursor, "unsupported text snapshot version");
+
+	snapshot.player = PlayerRecord();
+	snapshot.spawner = SpawnerRecord();
+	snapshot.rng_state.clear();
+	snapshot.entities.clear();
+
+	// Header lines come in any order, the schema line ends the header
+	uint32_t entity_count = 0;
+	const TextColumn * columns[64];
+	size_t column_count = 0;
+	while (true){
+		if (!cursor.NextLine())
+			return parseError(path, cursor, "missing schema line");
+		cursor.NextToken(token, length);
+
+		bool ok = true;
+		if (tokenIs(token, length, "player")){
+			PlayerRecord & player = snapshot.player;
+			ok = parseFloat(cursor, player.position[0]) && parseFloat(cursor, player.position[1]) &&
+			     parseFloat(cursor, player.position[2]) && parseFloat(cursor, player.horizontal_angle) &&
+			     parseFloat(cursor, player.vertical_angle) && parseFloat(cursor, player.fire_cooldown);
+		}else if (tokenIs(token, length, "spawner")){
+			ok = parseFloat(cursor, snapshot.spawner.spawn_cooldown);
+		}else if (tokenIs(token, length, "rng")){
+			cursor.Rest(token, length);
+			snapshot.rng_state.assign(token, length);
+		}else if (tokenIs(token, length, "entities")){
+			ok = parseUint(cursor, entity_count);
+		}else if (!tokenIs(token, length, "schema")){
+			// Unknown header lines are ignored so newer files stay readable
+			cursor.Rest(token, length);
+		}else{
+			while (cursor.NextToken(token, length)){
+				if (column_count == sizeof(columns) / sizeof(columns[0]))
+					return parseError(path, cursor, "too many schema columns");
+				// Unknown columns map to NULL and are skipped
+				const TextColumn * column = NULL;
+				for (const TextColumn & candidate : EntityColumns){
+					if (tokenIs(token, length, candidate.name))
+						column = &candidate;
+				}
+				columns[column_count++] = column;
+			}
+			break;
+		}
+
+		if (!ok || !cursor.AtLineEnd())
+			return parseError(path, cursor, "malformed header line");
+	}
+
+	// Every entity takes a line of its own, so a count beyond the bytes left is
+	// corrupt and must not size the allocation
+	if (entity_count > cursor.Remaining())
+		return parseError(path, cursor, "fewer entity lines than announced");
+
+	snapshot.entities.resize(entity_count);
+	for (uint32_t i = 0; i < entity_count; i++){
+		if (!cursor.NextLine())
+			return parseError(path, cursor, "fewer entity lines than announced");
+
+		EntityRecord & record = snapshot.entities[i];
+		memset(&record, 0, sizeof(record));
+		unsigned char * base = (unsigned char *)&record;
+		for (size_t c = 0; c < column_count; c++){
+			const TextColumn * column = columns[c];
+			bool ok;
+			if (column == NULL){
+				ok = cursor.NextToken(token, length);
+			}else if (column->type == COLUMN_FLOAT){
+				float value;
+				ok = parseFloat(cursor, value);
+				memcpy(base + column->offset, &value, sizeof(value));
+			}else{
+				uint32_t value;
+				ok = parseUint(cursor, value, column->type == COLUMN_HEX ? 16 : 10);
+				memcpy(base + column->offset, &value, sizeof(value));
+			}
+			if (!ok)
+				return parseError(path, cursor, "malformed entity line");
+		}
+		if (!cursor.AtLineEnd())
+			return parseError(path, cursor, "more values than schema columns");
+		if (record.kind >= ENTITY_KIND_COUNT)
+			return parseError(path, cursor, "unknown object kind");
+	}
+
+	return true;
+}
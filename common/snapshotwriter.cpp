@@ -0,0 +1,105 @@
+#include <stdio.h>
+
+#include <vector>
+
+#include "profiler.hpp"
+#include "snapshotwriter.hpp"
+
+SnapshotWriter::SnapshotWriter():
+	stopping_(false)
+{
+	in_use_[0] = in_use_[1] = false;
+	worker_ = std::thread(&SnapshotWriter::WorkerLoop, this);
+}
+
+SnapshotWriter::~SnapshotWriter(){
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	submitted_.notify_all();
+	worker_.join();
+}
+
+SceneSnapshot * SnapshotWriter::AcquireBuffer(){
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (int i = 0; i < 2; i++){
+		if (!in_use_[i]){
+			in_use_[i] = true;
+			return &buffers_[i];
+		}
+	}
+	return NULL;
+}
+
+void SnapshotWriter::Submit(SceneSnapshot * snapshot, const std::string & path, SnapshotFormat format,
+                            std::chrono::steady_clock::time_point requested){
+	Job job = { snapshot, path, format, requested };
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		jobs_.push_back(job);
+	}
+	submitted_.notify_one();
+}
+
+bool SnapshotWriter::IsBusy(){
+	std::lock_guard<std::mutex> lock(mutex_);
+	return in_use_[0] || in_use_[1];
+}
+
+void SnapshotWriter::WorkerLoop(){
+	while (true){
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			submitted_.wait(lock, [this]{ return stopping_ || !jobs_.empty(); });
+			// Pending saves are still written when stopping, nobody wants to lose the last one
+			if (jobs_.empty())
+				return;
+			job = jobs_.front();
+			jobs_.pop_front();
+		}
+
+		Save(job);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		in_use_[job.snapshot - buffers_] = false;
+	}
+}
+
+void SnapshotWriter::Save(const Job & job){
+	Profiler & profiler = Profiler::Instance();
+
+	std::vector<unsigned char> serialized;
+	{
+		ScopedTimer timer("save.serialize_ms");
+		if (job.format == SNAPSHOT_TEXT)
+			serializeTextSnapshot(*job.snapshot, serialized);
+		else
+			serializeSnapshot(*job.snapshot, serialized);
+	}
+	profiler.Record("save.bytes_serialized", serialized.size());
+
+	std::vector<unsigned char> compressed;
+	const std::vector<unsigned char> * contents = &serialized;
+	if (job.format == SNAPSHOT_COMPRESSED){
+		ScopedTimer timer("save.compress_ms");
+		if (compressSnapshot(serialized, compressed))
+			contents = &compressed;
+	}
+
+	bool ok;
+	{
+		ScopedTimer timer("save.commit_ms");
+		ok = writeFileAtomically(job.path.c_str(), contents->data(), contents->size());
+	}
+	if (!ok)
+		return;
+
+	double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.requested).count();
+	profiler.Record("save.latency_ms", latency);
+	profiler.Record("save.bytes_written", contents->size());
+
+	printf("Saved %zu objects to %s: %zu bytes in %.1f ms\n",
+	       job.snapshot->entities.size(), job.path.c_str(), contents->size(), latency);
+}
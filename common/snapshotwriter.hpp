@@ -0,0 +1,58 @@
+#ifndef SNAPSHOTWRITER_HPP
+#define SNAPSHOTWRITER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "snapshot.hpp"
+
+// Saves snapshots on a background thread. The game captures into one of two
+// buffers, which only copies the entity records, and submits it; serializing,
+// compressing and committing the file happen on the writer thread while the
+// next capture can already use the other buffer. Timings and sizes are
+// recorded in the Profiler under "save.*".
+class SnapshotWriter {
+public:
+	SnapshotWriter();
+
+	// Finishes the saves already submitted
+	~SnapshotWriter();
+
+	SnapshotWriter(const SnapshotWriter&) = delete;
+	SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+	// A buffer to capture into, or NULL while both buffers are being saved
+	SceneSnapshot * AcquireBuffer();
+
+	// Hands a captured buffer to the writer thread; requested is when the save was asked for
+	void Submit(SceneSnapshot * snapshot, const std::string & path, SnapshotFormat format,
+	            std::chrono::steady_clock::time_point requested);
+
+	bool IsBusy();
+
+private:
+	struct Job {
+		SceneSnapshot * snapshot;
+		std::string path;
+		SnapshotFormat format;
+		std::chrono::steady_clock::time_point requested;
+	};
+
+	void WorkerLoop();
+	void Save(const Job & job);
+
+	SceneSnapshot buffers_[2];
+	bool in_use_[2];
+
+	std::mutex mutex_;
+	std::condition_variable submitted_;
+	std::deque<Job> jobs_;
+	bool stopping_;
+	std::thread worker_;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include <algorithm>
+
+#include "sweepandprune.hpp"
+
+SweepAndPrune::SweepAndPrune():
+	free_list_(-1),
+	appended_(0),
+	sorted_(true),
+	max_width_(0.0f) {}
+
+int SweepAndPrune::CreateProxy(const AABB & box, void * user_data){
+	int proxy;
+	if (free_list_ >= 0){
+		proxy = free_list_;
+		free_list_ = proxies_[proxy].entry;
+	}else{
+		proxy = int(proxies_.size());
+		proxies_.emplace_back();
+	}
+	proxies_[proxy].user_data = user_data;
+	proxies_[proxy].entry = int(entries_.size());
+
+	Entry entry = { box, proxy, true };
+	entries_.push_back(entry);
+	appended_++;
+	sorted_ = false;
+	return proxy;
+}
+
+void SweepAndPrune::DestroyProxy(int proxy){
+	entries_[proxies_[proxy].entry].proxy = -1;
+	proxies_[proxy].user_data = NULL;
+	proxies_[proxy].entry = free_list_;
+	free_list_ = proxy;
+	sorted_ = false;
+}
+
+void SweepAndPrune::MoveProxy(int proxy, const AABB & box, const glm::vec3 & /* displacement */){
+	Entry & entry = entries_[proxies_[proxy].entry];
+	entry.box = box;
+	entry.moved = true;
+	sorted_ = false;
+}
+
+void SweepAndPrune::Clear(){
+	entries_.clear();
+	proxies_.clear();
+	free_list_ = -1;
+	appended_ = 0;
+	sorted_ = true;
+	max_width_ = 0.0f;
+}
+
+void SweepAndPrune::Sort(){
+	if (sorted_)
+		return;
+
+	entries_.erase(std::remove_if(entries_.begin(), entries_.end(), [](const Entry & entry){
+		return entry.proxy < 0;
+	}), entries_.end());
+
+	// Inserting many new boxes one by one would be quadratic
+	if (appended_ > 64 && appended_ * 8 > entries_.size()){
+		std::sort(entries_.begin(), entries_.end(), Before);
+	}else{
+		for (size_t i = 1; i < entries_.size(); i++){
+			if (!Before(entries_[i], entries_[i - 1]))
+				continue;
+			Entry entry = entries_[i];
+			size_t j = i;
+			for (; j > 0 && Before(entry, entries_[j - 1]); j--)
+				entries_[j] = entries_[j - 1];
+			entries_[j] = entry;
+		}
+	}
+
+	max_width_ = 0.0f;
+	for (size_t i = 0; i < entries_.size(); i++){
+		proxies_[entries_[i].proxy].entry = int(i);
+		max_width_ = std::max(max_width_, entries_[i].box.upper.x - entries_[i].box.lower.x);
+	}
+	appended_ = 0;
+	sorted_ = true;
+}
+
+void SweepAndPrune::UpdatePairs(const PairCallback & callback){
+	Sort();
+
+	// Only the neighbourhood of moved boxes is swept. Boxes after a moved one
+	// are candidates until one starts past its end; boxes before it until one
+	// starts more than the widest box earlier. A pair of moved boxes is
+	// reported from the first one only.
+	size_t count = entries_.size();
+	for (size_t i = 0; i < count; i++){
+		const Entry & a = entries_[i];
+		if (!a.moved)
+			continue;
+		for (size_t j = i + 1; j < count && entries_[j].box.lower.x <= a.box.upper.x; j++){
+			if (a.box.Overlaps(entries_[j].box))
+				callback(a.proxy, entries_[j].proxy);
+		}
+		float reach = a.box.lower.x - max_width_;
+		for (size_t j = i; j > 0 && entries_[j - 1].box.lower.x >= reach; j--){
+			const Entry & b = entries_[j - 1];
+			if (!b.moved && a.box.Overlaps(b.box))
+				callback(b.proxy, a.proxy);
+		}
+	}
+
+	for (Entry & entry : entries_)
+		entry.moved = false;
+}
+
+void SweepAndPrune::QueryAABB(const AABB & box, const QueryCallback & callback) const {
+	size_t begin = 0;
+	if (sorted_){
+		// Boxes starting before this can't reach the query box
+		float start = box.lower.x - max_width_;
+		begin = std::lower_bound(entries_.begin(), entries_.end(), start, [](const Entry & entry, float x){
+			return entry.box.lower.x < x;
+		}) - entries_.begin();
+	}
+
+	for (size_t i = begin; i < entries_.size(); i++){
+		const Entry & entry = entries_[i];
+		if (sorted_ && entry.box.lower.x > box.upper.x)
+			break;
+		if (entry.proxy >= 0 && entry.box.Overlaps(box) && !callback(entry.proxy))
+			return;
+	}
+}
+
+void SweepAndPrune::QueryFrustum(const Frustum & frustum, const QueryCallback & callback) const {
+	// Nothing to prune with along a single axis, every box is tested
+	for (const Entry & entry : entries_){
+		if (entry.proxy >= 0 && frustum.Classify(entry.box) >= 0 && !callback(entry.proxy))
+			return;
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef SWEEPANDPRUNE_HPP
+#define SWEEPANDPRUNE_HPP
+
+#include <vector>
+
+#include "broadphase.hpp"
+
+// Sort and sweep along x. Boxes stay sorted by their lower x across updates;
+// since most objects barely move between two updates, an insertion sort puts
+// them back in order in close to linear time. Pairs come from sweeping the
+// sorted list around the boxes that moved, so boxes that stand still cost
+// next to nothing. Suits scenes where most objects stand still.
+class SweepAndPrune : public Broadphase {
+public:
+	SweepAndPrune();
+
+	const char * Name() const override {
+		return "sweep-and-prune";
+	}
+
+	int CreateProxy(const AABB & box, void * user_data) override;
+	void DestroyProxy(int proxy) override;
+	void MoveProxy(int proxy, const AABB & box, const glm::vec3 & displacement) override;
+	void Clear() override;
+
+	void * GetUserData(int proxy) const override {
+		return proxies_[proxy].user_data;
+	}
+
+	void QueryAABB(const AABB & box, const QueryCallback & callback) const override;
+	void QueryFrustum(const Frustum & frustum, const QueryCallback & callback) const override;
+
+	void UpdatePairs(const PairCallback & callback) override;
+
+private:
+	// One per proxy in sweep order; the box is stored here so the sweep reads memory linearly
+	struct Entry {
+		AABB box;
+		int proxy;   // -1 once destroyed, until the next Sort
+		bool moved;
+	};
+
+	struct Proxy {
+		void * user_data;
+		int entry;   // index into entries_, or the next free proxy
+	};
+
+	// Restores the order, dropping destroyed entries
+	void Sort();
+
+	static bool Before(const Entry & a, const Entry & b){
+		return a.box.lower.x < b.box.lower.x || (a.box.lower.x == b.box.lower.x && a.proxy < b.proxy);
+	}
+
+	std::vector<Entry> entries_;
+	std::vector<Proxy> proxies_;
+	int free_list_;
+	size_t appended_; // entries added at the end since the last Sort
+	bool sorted_;     // no box changed since the last Sort
+	float max_width_; // widest box along x, bounds how far back a sorted query has to look
+};
+
+#endif
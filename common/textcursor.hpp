@@ -0,0 +1,119 @@
+#ifndef TEXTCURSOR_HPP
+#define TEXTCURSOR_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <charconv>
+
+// Splits the input into lines and whitespace-separated tokens without copying anything
+class TextCursor {
+public:
+	TextCursor(const char * data, size_t size):
+		next_line_(data),
+		end_(data + size),
+		position_(data),
+		line_end_(data),
+		line_number_(0) {}
+
+	// Moves to the next line that is neither blank nor a comment
+	bool NextLine(){
+		while (next_line_ < end_){
+			position_ = next_line_;
+			line_end_ = (const char *)memchr(position_, '\n', end_ - position_);
+			if (line_end_ == NULL)
+				line_end_ = end_;
+			next_line_ = line_end_ + 1;
+			line_number_++;
+
+			SkipSpaces();
+			if (position_ < line_end_ && *position_ != '#')
+				return true;
+		}
+		return false;
+	}
+
+	// Next token of the current line, false at the end of the line
+	bool NextToken(const char * & token, size_t & length){
+		SkipSpaces();
+		if (position_ >= line_end_)
+			return false;
+		token = position_;
+		while (position_ < line_end_ && !isSpace(*position_))
+			position_++;
+		length = position_ - token;
+		return true;
+	}
+
+	// Everything left on the current line, without the trailing whitespace
+	void Rest(const char * & text, size_t & length){
+		SkipSpaces();
+		const char * end = line_end_;
+		while (end > position_ && isSpace(end[-1]))
+			end--;
+		text = position_;
+		length = end - position_;
+		position_ = line_end_;
+	}
+
+	bool AtLineEnd(){
+		SkipSpaces();
+		return position_ >= line_end_;
+	}
+
+	int LineNumber() const {
+		return line_number_;
+	}
+
+	// Bytes after the current line
+	size_t Remaining() const {
+		return next_line_ < end_ ? size_t(end_ - next_line_) : 0;
+	}
+
+private:
+	static bool isSpace(char c){
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	void SkipSpaces(){
+		while (position_ < line_end_ && isSpace(*position_))
+			position_++;
+	}
+
+	const char * next_line_;
+	const char * end_;
+	const char * position_;
+	const char * line_end_;
+	int line_number_;
+};
+
+inline bool tokenIs(const char * token, size_t length, const char * word){
+	return length == strlen(word) && memcmp(token, word, length) == 0;
+}
+
+inline bool parseFloat(TextCursor & cursor, float & value){
+	const char * token;
+	size_t length;
+	if (!cursor.NextToken(token, length))
+		return false;
+	std::from_chars_result result = std::from_chars(token, token + length, value);
+	return result.ec == std::errc() && result.ptr == token + length;
+}
+
+inline bool parseUint(TextCursor & cursor, uint32_t & value, int base = 10){
+	const char * token;
+	size_t length;
+	if (!cursor.NextToken(token, length))
+		return false;
+	std::from_chars_result result = std::from_chars(token, token + length, value, base);
+	return result.ec == std::errc() && result.ptr == token + length;
+}
+
+inline bool parseError(const char * path, const TextCursor & cursor, const char * message){
+	printf("%s:%d: %s\n", path, cursor.LineNumber(), message);
+	return false;
+}
+
+#endif
@@ -6,63 +6,93 @@
 
 #include <GLFW/glfw3.h>
 
+#include <vector>
 
-GLuint loadBMP_custom(const char * imagepath){
+#include "assetpack.hpp"
+#include "texture.hpp"
 
-	printf("Reading image %s\n", imagepath);
+
+bool parseBMP(const unsigned char * file, size_t size, unsigned int & width, unsigned int & height,
+              const unsigned char *& pixels){
 
 	// Data read from the header of the BMP file
 	unsigned char header[54];
 	unsigned int dataPos;
-	unsigned int imageSize;
-	unsigned int width, height;
-	// Actual RGB data
-	unsigned char * data;
-
-	// Open the file
-	FILE * file = fopen(imagepath,"rb");
-	if (!file){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
-		getchar();
-		return 0;
-	}
+	uint64_t imageSize;
+	int signedWidth, signedHeight;
 
 	// Read the header, i.e. the 54 first bytes
 
 	// If less than 54 bytes are read, problem
-	if ( fread(header, 1, 54, file)!=54 ){ 
+	if ( size < 54 ){ 
 		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
+		return false;
 	}
+	memcpy(header, file, 54);
 	// A BMP files always begins with "BM"
 	if ( header[0]!='B' || header[1]!='M' ){
 		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
+		return false;
 	}
 	// Make sure this is a 24bpp file
-	if ( *(int*)&(header[0x1E])!=0  )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
-	if ( *(int*)&(header[0x1C])!=24 )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
+	if ( *(int*)&(header[0x1E])!=0  )         {printf("Not a correct BMP file\n");    return false;}
+	if ( *(int*)&(header[0x1C])!=24 )         {printf("Not a correct BMP file\n");    return false;}
 
 	// Read the information about the image
 	dataPos    = *(int*)&(header[0x0A]);
-	imageSize  = *(int*)&(header[0x22]);
-	width      = *(int*)&(header[0x12]);
-	height     = *(int*)&(header[0x16]);
+	imageSize  = *(unsigned int*)&(header[0x22]);
+	signedWidth  = *(int*)&(header[0x12]);
+	signedHeight = *(int*)&(header[0x16]);
+
+	// A negative height marks a top-down file, whose rows the loaders would upload upside down
+	if ( signedHeight < 0 ){
+		printf("Top-down BMP files are not supported\n");
+		return false;
+	}
+	if ( signedWidth <= 0 || signedHeight == 0 || signedWidth > MAX_BMP_DIMENSION || signedHeight > MAX_BMP_DIMENSION ){
+		printf("Not a correct BMP file\n");
+		return false;
+	}
+	width  = signedWidth;
+	height = signedHeight;
 
 	// Some BMP files are misformatted, guess missing information
-	if (imageSize==0)    imageSize=width*height*3; // 3 : one byte for each Red, Green and Blue component
+	if (imageSize==0)    imageSize=bmpRowSize(width)*height; // rows of one byte for each Red, Green and Blue component, padded to 4 bytes
 	if (dataPos==0)      dataPos=54; // The BMP header is done that way
 
-	// Create a buffer
-	data = new unsigned char [imageSize];
+	// The pixels are used where they are, they must all be in the file
+	if (dataPos > size || imageSize > size - dataPos || imageSize < bmpRowSize(width) * height){
+		printf("Not a correct BMP file\n");
+		return false;
+	}
+	pixels = file + dataPos;
+
+	return true;
+}
+
+bool readBMP_custom(const char * imagepath, unsigned int & width, unsigned int & height, std::vector<unsigned char> & data){
+
+	printf("Reading image %s\n", imagepath);
 
-	// Read the actual data from the file into the buffer
-	fread(data,1,imageSize,file);
+	AssetData file;
+	if (!AssetVfs::Instance().Open(imagepath, file))
+		return false;
+
+	const unsigned char * pixels;
+	if (!parseBMP(file.Data(), file.Size(), width, height, pixels))
+		return false;
+	data.assign(pixels, pixels + bmpRowSize(width) * height);
+	return true;
+}
 
-	// Everything is in memory now, the file can be closed.
-	fclose (file);
+GLuint loadBMP_custom(const char * imagepath){
+
+	unsigned int width, height;
+	// Actual RGB data
+	std::vector<unsigned char> data;
+
+	if (!readBMP_custom(imagepath, width, height, data))
+		return 0;
 
 	// Create one OpenGL texture
 	GLuint textureID;
@@ -72,10 +102,7 @@ GLuint loadBMP_custom(const char * imagepath){
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
 	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-	// OpenGL has now copied the data. Free our own version
-	delete [] data;
+	glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data.data());
 
 	// Poor filtering, or ...
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -128,25 +155,18 @@ GLuint loadDDS(const char * imagepath){
 
 	unsigned char header[124];
 
-	FILE *fp; 
- 
 	/* try to open the file */ 
-	fp = fopen(imagepath, "rb"); 
-	if (fp == NULL){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
+	AssetData file;
+	if (!AssetVfs::Instance().Open(imagepath, file))
 		return 0;
-	}
    
 	/* verify the type of file */ 
-	char filecode[4]; 
-	fread(filecode, 1, 4, fp); 
-	if (strncmp(filecode, "DDS ", 4) != 0) { 
-		fclose(fp); 
+	if (file.Size() < 4 + 124 || strncmp((const char *)file.Data(), "DDS ", 4) != 0) { 
 		return 0; 
 	}
 	
 	/* get the surface desc */ 
-	fread(&header, 124, 1, fp); 
+	memcpy(header, file.Data() + 4, 124);
 
 	unsigned int height      = *(unsigned int*)&(header[8 ]);
 	unsigned int width	     = *(unsigned int*)&(header[12]);
@@ -155,14 +175,13 @@ GLuint loadDDS(const char * imagepath){
 	unsigned int fourCC      = *(unsigned int*)&(header[80]);
 
  
-	unsigned char * buffer;
-	unsigned int bufsize;
 	/* how big is it going to be including all mipmaps? */ 
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char)); 
-	fread(buffer, 1, bufsize, fp); 
-	/* close the file pointer */ 
-	fclose(fp);
+	unsigned int bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
+	if (bufsize > file.Size() - 4 - 124) {
+		return 0;
+	}
+	/* the mipmaps are uploaded straight from the file */
+	const unsigned char * buffer = file.Data() + 4 + 124;
 
 	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
 	unsigned int format;
@@ -178,7 +197,6 @@ GLuint loadDDS(const char * imagepath){
 		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
 		break; 
 	default: 
-		free(buffer); 
 		return 0; 
 	}
 
@@ -210,8 +228,6 @@ GLuint loadDDS(const char * imagepath){
 
 	} 
 
-	free(buffer); 
-
 	return textureID;
 
 
@@ -1,6 +1,25 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Size of one 24bpp BMP row, rows are padded to 4 bytes (the default GL_UNPACK_ALIGNMENT);
+// 64-bit so that no width from a file can wrap it
+inline uint64_t bmpRowSize(unsigned int width){ return ((uint64_t)width * 3 + 3) & ~(uint64_t)3; }
+
+// Larger images are rejected, no texture of the game comes close
+#define MAX_BMP_DIMENSION 16384
+
+// Finds the BGR pixels inside the bytes of a .BMP file, without copying them
+bool parseBMP(const unsigned char * file, size_t size, unsigned int & width, unsigned int & height,
+              const unsigned char *& pixels);
+
+// Read the BGR pixels of a .BMP file without touching OpenGL, safe to call from any thread
+bool readBMP_custom(const char * imagepath, unsigned int & width, unsigned int & height, std::vector<unsigned char> & data);
+
 // Load a .BMP file using our custom loader
 GLuint loadBMP_custom(const char * imagepath);
 
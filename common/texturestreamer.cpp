@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "memorytracker.hpp"
+#include "texturestreamer.hpp"
+#include "texture.hpp"
+
+// RGB texels and the mipmap chain, which adds a third
+static size_t textureBytes(unsigned int width, unsigned int height){
+	return (size_t)width * height * 3 * 4 / 3;
+}
+
+TextureStreamer::TextureStreamer(unsigned int worker_count,
+                                 size_t upload_budget,
+                                 unsigned int unpack_buffer_count):
+	upload_budget_(upload_budget),
+	unpack_buffers_(unpack_buffer_count),
+	unpack_buffer_sizes_(unpack_buffer_count, 0),
+	next_unpack_buffer_(0),
+	in_flight_(0),
+	stopping_(false)
+{
+	MemoryScope scope(MEMORY_ASSETS, "texture streamer");
+
+	// Mid grey, so unloaded objects are visible but obviously untextured
+	const unsigned char grey[4] = { 128, 128, 128, 0 };
+	glGenTextures(1, &placeholder_);
+	glBindTexture(GL_TEXTURE_2D, placeholder_);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_BGR, GL_UNSIGNED_BYTE, grey);
+	MemoryTracker::Instance().TrackGpu(GPU_TEXTURE, placeholder_, 3);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	glGenBuffers(unpack_buffer_count, unpack_buffers_.data());
+
+	for (unsigned int i = 0; i < worker_count; i++)
+		workers_.emplace_back(&TextureStreamer::WorkerLoop, this);
+}
+
+TextureStreamer::~TextureStreamer(){
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	requested_.notify_all();
+	for (std::thread & worker : workers_)
+		worker.join();
+
+	MemoryTracker & tracker = MemoryTracker::Instance();
+	for (Upload & upload : uploads_){
+		tracker.UntrackGpu(GPU_TEXTURE, upload.name);
+		glDeleteTextures(1, &upload.name);
+	}
+	for (auto & texture : textures_){
+		GLuint name = texture.second->Name();
+		if (name != placeholder_){
+			tracker.UntrackGpu(GPU_TEXTURE, name);
+			glDeleteTextures(1, &name);
+		}
+	}
+	tracker.UntrackGpu(GPU_TEXTURE, placeholder_);
+	glDeleteTextures(1, &placeholder_);
+	for (GLuint buffer : unpack_buffers_)
+		tracker.UntrackGpu(GPU_BUFFER, buffer);
+	glDeleteBuffers(unpack_buffers_.size(), unpack_buffers_.data());
+}
+
+TextureHandle TextureStreamer::Request(const std::string & imagepath){
+	MemoryScope scope(MEMORY_ASSETS, "texture streamer");
+	auto found = textures_.find(imagepath);
+	if (found != textures_.end())
+		return found->second.get();
+
+	StreamedTexture * texture = new StreamedTexture();
+	texture->id_ = assetId(imagepath.c_str());
+	texture->gpu_bytes_ = 0;
+	texture->name_.store(placeholder_, std::memory_order_release);
+	texture->resident_.store(false, std::memory_order_release);
+	textures_[imagepath].reset(texture);
+
+	std::unique_ptr<DecodedImage> request(new DecodedImage());
+	request->texture = texture;
+	request->imagepath = imagepath;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		requests_.push_back(std::move(request));
+		in_flight_++;
+	}
+	requested_.notify_one();
+
+	return texture;
+}
+
+TextureHandle TextureStreamer::AddResident(const std::string & imagepath, unsigned int width, unsigned int height,
+                                          const unsigned char * pixels){
+	MemoryScope scope(MEMORY_ASSETS, "texture streamer");
+	auto found = textures_.find(imagepath);
+	if (found != textures_.end())
+		return found->second.get();
+
+	GLuint name;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glGenTextures(1, &name);
+	glBindTexture(GL_TEXTURE_2D, name);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, pixels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	MemoryTracker::Instance().TrackGpu(GPU_TEXTURE, name, textureBytes(width, height));
+
+	StreamedTexture * texture = new StreamedTexture();
+	texture->id_ = assetId(imagepath.c_str());
+	texture->gpu_bytes_ = textureBytes(width, height);
+	texture->name_.store(name, std::memory_order_release);
+	texture->resident_.store(true, std::memory_order_release);
+	textures_[imagepath].reset(texture);
+	return texture;
+}
+
+void TextureStreamer::WorkerLoop(){
+	MemoryScope scope(MEMORY_ASSETS, "texture streamer");
+	while (true){
+		std::unique_ptr<DecodedImage> image;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			requested_.wait(lock, [this]{ return stopping_ || !requests_.empty(); });
+			if (stopping_)
+				return;
+			image = std::move(requests_.front());
+			requests_.pop_front();
+		}
+
+		image->valid = AssetVfs::Instance().Open(image->imagepath.c_str(), image->file) &&
+		               parseBMP(image->file.Data(), image->file.Size(), image->width, image->height, image->pixels);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		decoded_.push_back(std::move(image));
+	}
+}
+
+void TextureStreamer::Update(){
+	MemoryScope scope(MEMORY_ASSETS, "texture streamer");
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		while (!decoded_.empty()){
+			std::unique_ptr<DecodedImage> image = std::move(decoded_.front());
+			decoded_.pop_front();
+			if (!image->valid){
+				printf("Keeping the placeholder for %s\n", image->imagepath.c_str());
+				in_flight_--;
+				continue;
+			}
+			Upload upload = { std::move(image), 0, 0 };
+			uploads_.push_back(std::move(upload));
+		}
+	}
+
+	size_t budget = upload_budget_;
+	while (!uploads_.empty() && budget > 0){
+		if (!UploadRows(uploads_.front(), budget))
+			break;
+
+		Upload & upload = uploads_.front();
+		StreamedTexture * texture = upload.image->texture;
+		texture->gpu_bytes_ = textureBytes(upload.image->width, upload.image->height);
+		texture->name_.store(upload.name, std::memory_order_release);
+		texture->resident_.store(true, std::memory_order_release);
+		uploads_.pop_front();
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		in_flight_--;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// Returns true once the whole image is on the GPU
+bool TextureStreamer::UploadRows(Upload & upload, size_t & budget){
+	DecodedImage & image = *upload.image;
+	size_t row_size = bmpRowSize(image.width);
+
+	if (upload.name == 0){
+		// No unpack buffer may be bound here, or NULL would be read as an offset into it
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glGenTextures(1, &upload.name);
+		glBindTexture(GL_TEXTURE_2D, upload.name);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_BGR, GL_UNSIGNED_BYTE, NULL);
+		MemoryTracker::Instance().TrackGpu(GPU_TEXTURE, upload.name, textureBytes(image.width, image.height));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	}
+
+	// Always make progress, even when a single row is larger than the budget
+	size_t rows = std::max<size_t>(1, budget / row_size);
+	rows = std::min<size_t>(rows, image.height - upload.next_row);
+	size_t size = rows * row_size;
+	budget -= std::min(budget, size);
+
+	// Cycle through the ring so we never write into a buffer the GPU may still be reading
+	unsigned int index = next_unpack_buffer_;
+	next_unpack_buffer_ = (next_unpack_buffer_ + 1) % unpack_buffers_.size();
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffers_[index]);
+	if (unpack_buffer_sizes_[index] < size){
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		unpack_buffer_sizes_[index] = size;
+		MemoryTracker::Instance().TrackGpu(GPU_BUFFER, unpack_buffers_[index], size);
+	}
+	void * mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+	                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped){
+		memcpy(mapped, image.pixels + upload.next_row * row_size, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, upload.name);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, upload.next_row, image.width, rows, GL_BGR, GL_UNSIGNED_BYTE, (void*)0);
+	upload.next_row += rows;
+
+	if (upload.next_row < image.height)
+		return false;
+
+	glGenerateMipmap(GL_TEXTURE_2D);
+	return true;
+}
+
+bool TextureStreamer::IsIdle(){
+	std::lock_guard<std::mutex> lock(mutex_);
+	return in_flight_ == 0;
+}
+
+void TextureStreamer::ReportMemory(MemoryReport & report) const {
+	report.Add("texture placeholder", 0, 3);
+	for (const auto & texture : textures_){
+		size_t cpu_bytes = 0;
+		for (const Upload & upload : uploads_){
+			if (upload.image->texture == texture.second.get())
+				cpu_bytes += upload.image->file.Size();
+		}
+		report.Add(texture.first, cpu_bytes, texture.second->gpu_bytes_);
+	}
+}
@@ -0,0 +1,122 @@
+#ifndef TEXTURESTREAMER_HPP
+#define TEXTURESTREAMER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "assetid.hpp"
+#include "assetpack.hpp"
+#include "memoryreport.hpp"
+
+// A texture that may still be on its way. Until the image is uploaded Name()
+// returns the streamer's 1x1 placeholder, then it switches to the real texture.
+class StreamedTexture {
+public:
+	GLuint Name() const {
+		return name_.load(std::memory_order_acquire);
+	}
+
+	bool IsResident() const {
+		return resident_.load(std::memory_order_acquire);
+	}
+
+	// assetId() of the requested path
+	AssetId Id() const {
+		return id_;
+	}
+
+private:
+	friend class TextureStreamer;
+
+	AssetId id_;
+	// With the mipmaps, once resident; only touched on the GL thread
+	size_t gpu_bytes_;
+
+	std::atomic<GLuint> name_;
+	std::atomic<bool> resident_;
+};
+
+// Handles stay valid for the lifetime of the streamer that returned them
+typedef const StreamedTexture * TextureHandle;
+
+// Loads BMP textures in the background. Worker threads read and decode the
+// files; Update(), called once per frame on the GL thread, streams the pixels
+// through a ring of pixel unpack buffers without exceeding a byte budget.
+class TextureStreamer {
+public:
+	explicit TextureStreamer(unsigned int worker_count = 2,
+	                         size_t upload_budget = 1 << 20,
+	                         unsigned int unpack_buffer_count = 3);
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// Returns immediately; requesting the same file twice returns the same handle
+	TextureHandle Request(const std::string & imagepath);
+
+	// For images decoded elsewhere, e.g. by the AssetLoader at startup: uploads
+	// the whole image at once on the calling (GL) thread and registers it as
+	// resident, so later Request()s of the same path return this handle
+	TextureHandle AddResident(const std::string & imagepath, unsigned int width, unsigned int height,
+	                          const unsigned char * pixels);
+
+	// Uploads decoded images, at most upload_budget bytes per call (and at least one row)
+	void Update();
+
+	// True once every requested texture is resident or has failed to load
+	bool IsIdle();
+
+	// One entry per texture: its size on the GPU, and the file it is being
+	// uploaded from while the upload lasts
+	void ReportMemory(MemoryReport & report) const;
+
+private:
+	struct DecodedImage {
+		StreamedTexture * texture;
+		std::string imagepath;
+		unsigned int width;
+		unsigned int height;
+		// The rows are uploaded straight out of the file
+		AssetData file;
+		const unsigned char * pixels;
+		bool valid;
+	};
+
+	struct Upload {
+		std::unique_ptr<DecodedImage> image;
+		GLuint name;
+		unsigned int next_row;
+	};
+
+	void WorkerLoop();
+	bool UploadRows(Upload & upload, size_t & budget);
+
+	size_t upload_budget_;
+	GLuint placeholder_;
+	std::vector<GLuint> unpack_buffers_;
+	std::vector<size_t> unpack_buffer_sizes_;
+	unsigned int next_unpack_buffer_;
+
+	std::unordered_map<std::string, std::unique_ptr<StreamedTexture>> textures_;
+	std::deque<Upload> uploads_;
+
+	std::mutex mutex_;
+	std::condition_variable requested_;
+	std::deque<std::unique_ptr<DecodedImage>> requests_;
+	std::deque<std::unique_ptr<DecodedImage>> decoded_;
+	size_t in_flight_;
+	bool stopping_;
+	std::vector<std::thread> workers_;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <atomic>
+#include <stddef.h>
+
+// Hands the latest of a stream of values from one producer thread to one
+// consumer thread without locks or waiting. The producer fills Back() and
+// publishes it; the consumer takes whatever was published last, skipping
+// anything older. Each side owns one buffer and the third one is in flight.
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer():
+		back_(0),
+		ready_(1),
+		front_(2) {}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// Producer side: the buffer to fill next
+	T & Back(){
+		return buffers_[back_];
+	}
+
+	// Producer side: makes Back() the latest value and gets a new Back()
+	void Publish(){
+		back_ = ready_.exchange(back_ | Fresh) & Index;
+	}
+
+	// Consumer side: the latest published value, or NULL if nothing was
+	// published since the previous call. It stays valid until the next call.
+	T * Acquire(){
+		if ((ready_.load() & Fresh) == 0)
+			return NULL;
+		front_ = ready_.exchange(front_) & Index;
+		return &buffers_[front_];
+	}
+
+private:
+	static const int Index = 3;
+	static const int Fresh = 4;
+
+	T buffers_[3];
+	int back_;
+	std::atomic<int> ready_; // index of the buffer in flight, with Fresh once published
+	int front_;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <glm/gtc/packing.hpp>
+
+#include "vertexformat.hpp"
+
+glm::vec2 encodeOctahedral(glm::vec3 normal){
+	// Project on the octahedron |x| + |y| + |z| = 1, then fold the lower half over the upper one
+	float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+	if (!(length > 0.0f))
+		return glm::vec2(0.0f);
+	normal /= length;
+	glm::vec2 encoded(normal.x, normal.y);
+	if (normal.z < 0.0f){
+		encoded = glm::vec2(
+			(1.0f - std::fabs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::fabs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f)
+		);
+	}
+	return encoded;
+}
+
+glm::vec3 decodeOctahedral(glm::vec2 encoded){
+	glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+	float t = glm::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -t : t;
+	normal.y += normal.y >= 0.0f ? -t : t;
+	return glm::normalize(normal);
+}
+
+static bool inRange(const std::vector<glm::vec2> & values, float low, float high){
+	for (const glm::vec2 & value : values){
+		if (value.x < low || value.x > high || value.y < low || value.y > high)
+			return false;
+	}
+	return true;
+}
+
+static bool inRange(const std::vector<glm::vec3> & values, float bound){
+	for (const glm::vec3 & value : values){
+		if (std::fabs(value.x) > bound || std::fabs(value.y) > bound || std::fabs(value.z) > bound)
+			return false;
+	}
+	return true;
+}
+
+static void addAttribute(VertexLayout & layout, GLuint location, GLint components, GLenum type, GLboolean normalized, GLuint size){
+	VertexAttribute attribute = { location, components, type, normalized, (GLuint)layout.stride };
+	layout.attributes.push_back(attribute);
+	layout.stride += size;
+}
+
+bool packVertices(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	unsigned int quantization,
+	std::vector<unsigned char> & out_data,
+	VertexLayout & out_layout
+){
+	out_layout.attributes.clear();
+	out_layout.stride = 0;
+	out_data.clear();
+	if ((!uvs.empty() && uvs.size() != vertices.size()) || (!normals.empty() && normals.size() != vertices.size())){
+		printf("Cannot pack %zu vertices with %zu UVs and %zu normals\n", vertices.size(), uvs.size(), normals.size());
+		return false;
+	}
+
+	// Largest finite half is 65504; attributes are kept 4-byte aligned, hence the padded half4
+	bool half_positions = (quantization & QUANTIZE_POSITIONS) && inRange(vertices, 65504.0f);
+	if (half_positions)
+		addAttribute(out_layout, VERTEX_POSITION_LOCATION, 4, GL_HALF_FLOAT, GL_FALSE, 4 * sizeof(GLushort));
+	else
+		addAttribute(out_layout, VERTEX_POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+
+	bool has_uvs = !uvs.empty();
+	bool unorm_uvs = has_uvs && (quantization & QUANTIZE_UVS) && inRange(uvs, 0.0f, 1.0f);
+	bool snorm_uvs = has_uvs && (quantization & QUANTIZE_UVS) && !unorm_uvs && inRange(uvs, -1.0f, 1.0f);
+	if (unorm_uvs)
+		addAttribute(out_layout, VERTEX_UV_LOCATION, 2, GL_UNSIGNED_SHORT, GL_TRUE, 2 * sizeof(GLushort));
+	else if (snorm_uvs)
+		addAttribute(out_layout, VERTEX_UV_LOCATION, 2, GL_SHORT, GL_TRUE, 2 * sizeof(GLshort));
+	else if (has_uvs)
+		addAttribute(out_layout, VERTEX_UV_LOCATION, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat));
+
+	// Normals are always octahedral so the shader input does not depend on the quantization
+	bool has_normals = !normals.empty();
+	bool snorm_normals = has_normals && (quantization & QUANTIZE_NORMALS);
+	if (snorm_normals)
+		addAttribute(out_layout, VERTEX_NORMAL_LOCATION, 2, GL_SHORT, GL_TRUE, 2 * sizeof(GLshort));
+	else if (has_normals)
+		addAttribute(out_layout, VERTEX_NORMAL_LOCATION, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat));
+
+	out_data.assign(vertices.size() * out_layout.stride, 0);
+
+	for (size_t i = 0; i < vertices.size(); i++){
+		unsigned char * vertex = &out_data[i * out_layout.stride];
+		size_t attribute = 0;
+
+		unsigned char * position = vertex + out_layout.attributes[attribute++].offset;
+		if (half_positions){
+			GLushort packed[4] = {
+				glm::packHalf1x16(vertices[i].x),
+				glm::packHalf1x16(vertices[i].y),
+				glm::packHalf1x16(vertices[i].z),
+				glm::packHalf1x16(1.0f)
+			};
+			memcpy(position, packed, sizeof(packed));
+		}else{
+			memcpy(position, &vertices[i], sizeof(glm::vec3));
+		}
+
+		if (has_uvs){
+			unsigned char * uv = vertex + out_layout.attributes[attribute++].offset;
+			if (unorm_uvs){
+				GLushort packed[2] = { glm::packUnorm1x16(uvs[i].x), glm::packUnorm1x16(uvs[i].y) };
+				memcpy(uv, packed, sizeof(packed));
+			}else if (snorm_uvs){
+				GLushort packed[2] = { glm::packSnorm1x16(uvs[i].x), glm::packSnorm1x16(uvs[i].y) };
+				memcpy(uv, packed, sizeof(packed));
+			}else{
+				memcpy(uv, &uvs[i], sizeof(glm::vec2));
+			}
+		}
+
+		if (has_normals){
+			unsigned char * normal = vertex + out_layout.attributes[attribute++].offset;
+			glm::vec2 encoded = encodeOctahedral(normals[i]);
+			if (snorm_normals){
+				GLushort packed[2] = { glm::packSnorm1x16(encoded.x), glm::packSnorm1x16(encoded.y) };
+				memcpy(normal, packed, sizeof(packed));
+			}else{
+				memcpy(normal, &encoded, sizeof(glm::vec2));
+			}
+		}
+	}
+	return true;
+}
+
+void setVertexLayout(const VertexLayout & layout){
+	for (const VertexAttribute & attribute : layout.attributes){
+		glEnableVertexAttribArray(attribute.location);
+		glVertexAttribPointer(
+			attribute.location,
+			attribute.components,
+			attribute.type,
+			attribute.normalized,
+			layout.stride,
+			(void*)(size_t)attribute.offset
+		);
+	}
+}
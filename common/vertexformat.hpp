@@ -0,0 +1,60 @@
+#ifndef VERTEXFORMAT_HPP
+#define VERTEXFORMAT_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Attribute locations shared by every mesh and SimpleVertexShader
+#define VERTEX_POSITION_LOCATION 0
+#define VERTEX_UV_LOCATION       1
+#define VERTEX_NORMAL_LOCATION   2
+#define INSTANCE_MODEL_LOCATION  3 // mat4, takes locations 3 to 6
+
+// Optional quantization of the packed attributes, combine with |
+enum VertexQuantization {
+	QUANTIZE_NONE      = 0,
+	QUANTIZE_POSITIONS = 1 << 0, // half-float positions
+	QUANTIZE_NORMALS   = 1 << 1, // snorm16 octahedral normals (float octahedral otherwise)
+	QUANTIZE_UVS       = 1 << 2, // unorm16 UVs, or snorm16 if they are in [-1, 1]
+	QUANTIZE_ALL       = QUANTIZE_POSITIONS | QUANTIZE_NORMALS | QUANTIZE_UVS
+};
+
+// One attribute of an interleaved vertex, in glVertexAttribPointer terms
+struct VertexAttribute {
+	GLuint location;
+	GLint components;
+	GLenum type;
+	GLboolean normalized;
+	GLuint offset;
+};
+
+// Describes an interleaved vertex buffer; the VAO setup only needs this
+struct VertexLayout {
+	std::vector<VertexAttribute> attributes;
+	GLsizei stride;
+};
+
+// Interleaves positions, UVs and normals into one buffer.
+// uvs and normals may be empty; quantization falls back to floats for
+// attributes whose values do not fit the requested format. False, with
+// nothing packed, if uvs or normals are neither empty nor one per vertex.
+bool packVertices(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	unsigned int quantization,
+	std::vector<unsigned char> & out_data,
+	VertexLayout & out_layout
+);
+
+// Points the attributes of the bound VAO at the bound GL_ARRAY_BUFFER
+void setVertexLayout(const VertexLayout & layout);
+
+// Octahedral normal encoding, the inverse lives in SimpleVertexShader; a zero
+// normal, from a degenerate face, encodes as (0, 0)
+glm::vec2 encodeOctahedral(glm::vec3 normal);
+glm::vec3 decodeOctahedral(glm::vec2 encoded);
+
+#endif
@@ -1,5 +1,7 @@
 // Include standard headers
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -12,418 +14,613 @@ GLFWwindow* window;
 #include <vector>
 #include <iostream>
 #include <random>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 // Include GLM
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
 using namespace glm;
 
 #include "common/shader.hpp"
+#include "common/assetloader.hpp"
+#include "common/assetpack.hpp"
+#include "common/clusteredlights.hpp"
+#include "common/broadphase.hpp"
+#include "common/collision.hpp"
+#include "common/framepacer.hpp"
+#include "common/gpuculling.hpp"
 #include "common/texture.hpp"
+#include "common/texturestreamer.hpp"
 #include "common/objloader.hpp"
-
-const float PI = 3.1416;
-
-void createSphere(float radius, int sectorCount, int stackCount,
-                  std::vector<glm::vec3>& out_vertices,
-                  std::vector<glm::vec3>& out_normals,
-                  std::vector<glm::vec2>& out_uvs,
-                  glm::vec3 position = glm::vec3(0, 0, 0)) {
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> uvs;
-
-    glm::mat4 translation_mat = glm::mat4(1.0f);
-    translation_mat = glm::translate(translation_mat, position);
-
-    float x, y, z, xy;                              // vertex position
-    float nx, ny, nz, lengthInv = 1.0f / radius;    // vertex normal
-    float s, t;                                     // vertex uv
-
-    float sectorStep = 2 * PI / sectorCount;
-    float stackStep = PI / stackCount;
-    float sectorAngle, stackAngle;
-
-    for (int i = 0; i <= stackCount; ++i) {
-        stackAngle = PI / 2 - i * stackStep;        // starting from pi/2 to -pi/2 (vertical angle)
-        xy = radius * cosf(stackAngle);          // r * cos(u)
-        z = radius * sinf(stackAngle);           // r * sin(u)
-
-        // the first and last vertices have same position and normal, but different tex coords
-        for (int j = 0; j <= sectorCount; ++j) {
-            sectorAngle = j * sectorStep;           // starting from 0 to 2pi (horizontal angle)
-
-            // vertex position (x, y, z)
-            x = xy * cosf(sectorAngle);          // r * cos(u) * cos(v)
-            y = xy * sinf(sectorAngle);          // r * cos(u) * sin(v)
-            glm::vec4 vertex = translation_mat * glm::vec4(x, y, z, 1.0f);
-            vertices.emplace_back(vertex);
-
-            // normalized vertex normal (nx, ny, nz)
-            nx = x * lengthInv;
-            ny = y * lengthInv;
-            nz = z * lengthInv;
-            glm::vec4 normal = translation_mat * glm::vec4(nx, ny, nz, 0.0f);
-            normals.emplace_back(normal);
-
-            // vertex uv coord (s, t) range between [0, 1]
-            s = (float) j / sectorCount;
-            t = (float) i / stackCount;
-            uvs.emplace_back(s, t);
-        }
+#include "common/meshcache.hpp"
+#include "common/meshoptimizer.hpp"
+#include "common/meshsimplify.hpp"
+#include "common/memoryreport.hpp"
+#include "common/memorytracker.hpp"
+#include "common/model.hpp"
+#include "common/scene.hpp"
+#include "common/vertexformat.hpp"
+#include "common/snapshot.hpp"
+#include "common/snapshotwriter.hpp"
+#include "common/inputjournal.hpp"
+#include "common/profiler.hpp"
+#include "common/scenario.hpp"
+#include "common/triplebuffer.hpp"
+
+// Reads the devices; the cursor is recentred every time, so its position is the movement since the last call
+TickInput SampleInput(GLFWwindow* window) {
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    glfwSetCursorPos(window, width / 2, height / 2);
+
+    TickInput input = {GLfloat(width / 2 - xpos), GLfloat(height / 2 - ypos), 0};
+    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+        input.buttons |= INPUT_FIRE;
     }
+    if (glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS) {
+        input.buttons |= INPUT_SAVE;
+    }
+    if (glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS) {
+        input.buttons |= INPUT_LOAD;
+    }
+    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ||
+        glfwGetKey(window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS) {
+        input.buttons |= INPUT_TEXT_FORMAT;
+    }
+    return input;
+}
 
-    for (int i = 0; i < stackCount; ++i) {
-        int k1 = i * (sectorCount + 1);     // beginning of current stack
-        int k2 = k1 + sectorCount + 1;      // beginning of next stack
-
-        for (int j = 0; j < sectorCount; ++j, ++k1, ++k2) {
-            // 2 triangles per sector excluding first and last stacks
-            // k1 => k2 => k1+1
-            if (i != 0) {
-                out_vertices.push_back(vertices[k1]);
-                out_vertices.push_back(vertices[k2]);
-                out_vertices.push_back(vertices[k1 + 1]);
-
-                out_normals.push_back(normals[k1]);
-                out_normals.push_back(normals[k2]);
-                out_normals.push_back(normals[k1 + 1]);
-
-                out_uvs.push_back(uvs[k1]);
-                out_uvs.push_back(uvs[k2]);
-                out_uvs.push_back(uvs[k1 + 1]);
-            }
-
-            // k1+1 => k2 => k2+1
-            if (i != (stackCount - 1)) {
-                out_vertices.push_back(vertices[k1 + 1]);
-                out_vertices.push_back(vertices[k2]);
-                out_vertices.push_back(vertices[k2 + 1]);
+// The snowballs' shared sphere, cooked like the models loadMesh reads
+void BuildSnowballMesh(MeshData& mesh) {
+    std::vector<glm::vec3> sphere_vertices;
+    std::vector<glm::vec3> sphere_normals;
+    std::vector<glm::vec2> sphere_uvs;
+    createSphere(1.0f, 15, 15, sphere_vertices, sphere_normals, sphere_uvs);
+    indexMesh(sphere_vertices, sphere_uvs, sphere_normals, mesh.indices, mesh.vertices, mesh.uvs, mesh.normals);
+    optimizeMesh(mesh);
+    const float ratios[] = MESH_LOD_RATIOS;
+    buildMeshLods(mesh, std::vector<float>(ratios, ratios + sizeof(ratios) / sizeof(ratios[0])));
+}
 
-                out_normals.push_back(normals[k1 + 1]);
-                out_normals.push_back(normals[k2]);
-                out_normals.push_back(normals[k2 + 1]);
+// Ticks per second of the simulation, unless --tick-rate says otherwise
+const int kTickRate = 60;
+// Size the window opens with
+const int kWindowWidth = 1024;
+const int kWindowHeight = 768;
+// Beyond this many ticks behind, the game slows down instead of trying to catch up
+const int kMaxCatchUpTicks = 8;
+
+// Everything the render thread needs to draw one frame. The simulation thread
+// fills it in, so the render thread never touches the scene itself
+struct FramePacket {
+    FrameUniforms uniforms;  // the render thread fills in the viewport and time
+    // Model matrices of the visible objects grouped by mesh, then by LOD; the vectors keep their capacity
+    std::unordered_map<Model*, std::vector<std::vector<glm::mat4>>> batches;
+    // With GPU culling every object instead, the GPU finds the visible ones
+    std::vector<GpuInstance> instances;
+    std::vector<PointLight> lights;
+    // When the newest input the packet reflects was sampled, zero if none
+    std::chrono::steady_clock::time_point input_time;
+};
 
-                out_uvs.push_back(uvs[k1 + 1]);
-                out_uvs.push_back(uvs[k2]);
-                out_uvs.push_back(uvs[k2 + 1]);
-            }
+// Owns the scene and runs the fixed ticks on its own thread, so a stall in
+// GL submission or vsync does not hold the simulation back. Input arrives
+// through SubmitInput, or from a replay or scenario; after every tick the
+// camera, visible instances and lights go into a FramePacket for the render
+// thread.
+class Simulation {
+public:
+    // A scenario also sets up the player, spawner and starting scene; a
+    // free-running simulation does not keep to the tick rate
+    Simulation(Model* enemy_model,
+               Model* snowball_model,
+               BroadphaseType broadphase_type,
+               uint32_t seed,
+               int tick_rate,
+               bool gpu_culling,
+               InputRecorder* recorder,
+               InputReplay* replay,
+               Scenario* scenario,
+               bool free_running):
+            enemy_model_(enemy_model),
+            snowball_model_(snowball_model),
+            broadphase_(Broadphase::Create(broadphase_type)),
+            player_(scenario != nullptr ? scenario->CreatePlayer(snowball_model) : Player(snowball_model)),
+            enemy_creator_(scenario != nullptr ? scenario->CreateSpawner(enemy_model) : EnemyCreator(enemy_model, seed)),
+            tick_seconds_(1.0 / tick_rate),
+            gpu_culling_(gpu_culling),
+            recorder_(recorder),
+            replay_(replay),
+            scenario_(scenario),
+            free_running_(free_running || replay != nullptr) {
+        if (scenario_ != nullptr) {
+            scenario_->Start(tick_rate, enemy_model, snowball_model, player_.GetPosition(), objects_, *broadphase_);
         }
     }
-}
-
-class Camera {
-public:
-    static constexpr double PI = 3.1416;
 
-    explicit Camera(GLfloat horizontal_angle = 0.0f,
-                    GLfloat vertical_angle = 0.0f,
-                    GLfloat fov = 45.0f):
-            horizontal_angle_(horizontal_angle),
-            vertical_angle_(vertical_angle),
-            fov_(fov) {}
+    // Also finishes the saves still being written
+    ~Simulation() {
+        Stop();
+        for (SceneObject* obj : objects_) {
+            delete obj;
+        }
+        delete broadphase_;
+    }
 
-    virtual ~Camera() = default;
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
 
-    virtual glm::vec3 CameraDirection() {
-        return {
-                cos(vertical_angle_) * sin(horizontal_angle_),
-                sin(vertical_angle_),
-                cos(vertical_angle_) * cos(horizontal_angle_)
-        };
+    void Start() {
+        thread_ = std::thread(&Simulation::Run, this);
     }
 
-    virtual glm::vec3 CameraRight() {
-        return {
-                sin(horizontal_angle_ - Camera::PI / 2),
-                0,
-                cos(horizontal_angle_ - Camera::PI / 2)
-        };
+    void Stop() {
+        stopping_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
     }
 
-    virtual glm::vec3 CameraUp() {
-        return glm::cross(CameraRight(), CameraDirection());
+    // Cursor movement adds up until the next tick takes it, and a button
+    // pressed in between counts even if it is released before that tick
+    void SubmitInput(const TickInput& sampled) {
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        pending_input_.cursor_dx += sampled.cursor_dx;
+        pending_input_.cursor_dy += sampled.cursor_dy;
+        pending_input_.buttons |= sampled.buttons;
+        held_buttons_ = sampled.buttons;
+        pending_time_ = std::chrono::steady_clock::now();
     }
 
-    virtual GLfloat FOV() {
-        return fov_;
+    // The render thread's framebuffer, which the camera and the LOD selection
+    // are fitted to; a minimized window reports zero and is ignored
+    void SetFramebufferSize(int width, int height) {
+        if (width <= 0 || height <= 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        framebuffer_size_ = glm::ivec2(width, height);
     }
 
-protected:
-    GLfloat horizontal_angle_;
-    GLfloat vertical_angle_;
-    GLfloat fov_;
-};
-
-class Model {
-public:
-    explicit Model(const std::string& texture_file,
-                   const std::vector<glm::vec3>& vertices,
-                   const std::vector<glm::vec2>& uvs) {
-        texture_ = loadBMP_custom(texture_file.data());
-        vertices_ = vertices;
-        uvs_ = uvs;
+    TripleBuffer<FramePacket>& Packets() {
+        return packets_;
     }
 
-    explicit Model(const std::string& obj_file,
-                   const std::string& texture_file) {
-        texture_ = loadBMP_custom(texture_file.data());
-        std::vector<glm::vec3> temp_normals;
-        loadOBJ(obj_file.data(), vertices_, uvs_, temp_normals);
+    // The replay ran out of input or the scenario is over
+    bool IsFinished() const {
+        return finished_;
     }
 
-    virtual ~Model() {
-        glDeleteTextures(1, &texture_);
+    // Only once the thread is stopped
+    uint64_t GetTick() const {
+        return tick_;
     }
 
-    void Draw(GLuint texture_id, GLuint vertexbuffer, GLuint uvbuffer) {
-        glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-        glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(glm::vec3), &vertices_[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-        glBufferData(GL_ARRAY_BUFFER, uvs_.size() * sizeof(glm::vec3), &uvs_[0], GL_STATIC_DRAW);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture_);
-        glUniform1i(texture_id, 0);
+    // Only once the thread is stopped
+    uint32_t StateHash() const {
+        return HashScene(objects_, player_, enemy_creator_, tick_ * tick_seconds_);
+    }
 
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+private:
+    void Run() {
+        MemoryScope scope(MEMORY_SIMULATION, "simulation thread");
+        typedef std::chrono::steady_clock clock;
+        auto tick_duration = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(tick_seconds_));
+        auto next_tick = clock::now();
+
+        // A replay or headless scenario runs as fast as it can, the game keeps to the tick rate
+        while (!stopping_) {
+            if (!free_running_) {
+                auto now = clock::now();
+                if (now < next_tick) {
+                    std::this_thread::sleep_until(next_tick);
+                    continue;
+                }
+                if (now - next_tick > kMaxCatchUpTicks * tick_duration) {
+                    next_tick = now;
+                }
+            }
+            next_tick += tick_duration;
+
+            TickInput input;
+            clock::time_point input_time;
+            glm::ivec2 framebuffer_size;
+            {
+                std::lock_guard<std::mutex> lock(input_mutex_);
+                input = pending_input_;
+                input_time = pending_time_;
+                framebuffer_size = framebuffer_size_;
+                pending_input_ = {0.0f, 0.0f, held_buttons_};
+            }
+            if ((replay_ != nullptr && !replay_->Next(input)) || (scenario_ != nullptr && !scenario_->Next(input))) {
+                finished_ = true;
+                break;
+            }
+            if (recorder_ != nullptr) {
+                recorder_->Write(input);
+            }
 
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+            auto tick_start = clock::now();
+            Step(input);
 
-        glDrawArrays(GL_TRIANGLES, 0, vertices_.size());
+            // While catching up only the last of the ticks is worth drawing
+            if (free_running_ || clock::now() < next_tick) {
+                Publish(packets_.Back(), input_time, framebuffer_size);
+                packets_.Publish();
+            }
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
+            if (scenario_ != nullptr) {
+                scenario_->RecordTick(objects_, std::chrono::duration<double, std::milli>(
+                        clock::now() - tick_start).count());
+            }
+        }
     }
 
-protected:
-    GLuint texture_;
-    std::vector<glm::vec3> vertices_;
-    std::vector<glm::vec2> uvs_;
-};
-
-class SceneObject : public Model {
-public:
-    explicit SceneObject(const glm::vec3& position,
-                         const glm::vec3& direction,
-                         GLfloat speed,
-                         GLfloat collider_radius,
-                         const std::string& texture_file,
-                         const std::vector<glm::vec3>& vertices,
-                         const std::vector<glm::vec2>& uvs):
-            position_(position),
-            direction_(direction),
-            speed_(speed),
-            collider_radius_(collider_radius),
-            Model(texture_file, vertices, uvs) {}
-
-    explicit SceneObject(const glm::vec3& position,
-                         const glm::vec3& direction,
-                         GLfloat speed,
-                         GLfloat collider_radius,
-                         const std::string& obj_file,
-                         const std::string& texture_file):
-            position_(position),
-            direction_(direction),
-            speed_(speed),
-            collider_radius_(collider_radius),
-            Model(obj_file, texture_file) {}
-
-    bool IsIntersected(SceneObject* other) {
-        return glm::length(position_ - other->GetPosition()) < (collider_radius_ +
-                                                                other->GetColliderRadius());
-    }
-
-    glm::vec3 GetPosition() const {
-        return position_;
-    }
-
-    GLfloat GetColliderRadius() const {
-        return collider_radius_;
-    }
-
-    glm::vec3 GetDirection() const {
-        return direction_;
-    };
+    void Step(const TickInput& input) {
+        {
+            ScopedTimer timer("sim.tick_ms");
+            SimulateTick(input, tick_ * tick_seconds_, GLfloat(tick_seconds_), objects_, *broadphase_, player_,
+                         enemy_creator_);
+        }
+        ++tick_;
+        double time = tick_ * tick_seconds_;
+
+        uint32_t pressed = input.buttons & ~previous_buttons_;
+        previous_buttons_ = input.buttons;
+
+        // F5 saves the scene in the background, F9 restores it; with Shift held
+        // both use the human-readable text file instead
+        bool text_format = (input.buttons & INPUT_TEXT_FORMAT) != 0;
+        const char* save_path = text_format ? "scene.txt" : "scene.snapshot";
+
+        // A replay only reproduces the session, the saves on disk are left alone
+        if ((pressed & INPUT_SAVE) && replay_ == nullptr) {
+            SceneSnapshot* snapshot = snapshot_writer_.AcquireBuffer();
+            if (snapshot != nullptr) {
+                auto requested = std::chrono::steady_clock::now();
+                {
+                    ScopedTimer timer("save.capture_ms");
+                    CaptureScene(objects_, player_, enemy_creator_, time, *snapshot);
+                }
+                snapshot_writer_.Submit(snapshot, save_path,
+                                        text_format ? SNAPSHOT_TEXT : SNAPSHOT_COMPRESSED, requested);
+            } else {
+                printf("Still writing the previous saves, try again later\n");
+            }
+        }
 
-    float GetSpeed() const {
-        return speed_;
+        if (pressed & INPUT_LOAD) {
+            SceneSnapshot snapshot;
+            if (LoadSnapshot(save_path, snapshot)) {
+                RestoreScene(snapshot, {enemy_model_, snowball_model_}, objects_, *broadphase_, player_,
+                             enemy_creator_, time);
+                printf("Loaded %zu objects from %s\n", objects_.size(), save_path);
+            }
+        }
     }
 
-    virtual bool IsSnowBall() const {
-        return false;
-    }
+    // The file is only read while playing or recording; the recorder journals
+    // what was read and a replay restores that, whatever is on disk by then
+    bool LoadSnapshot(const char* path, SceneSnapshot& snapshot) {
+        if (replay_ != nullptr) {
+            std::vector<unsigned char> serialized;
+            if (!replay_->NextSnapshot(serialized)) {
+                printf("The journal has no snapshot for the load at tick %llu\n", (unsigned long long)tick_);
+                return false;
+            }
+            return !serialized.empty() &&
+                   parseSnapshot(serialized.data(), serialized.size(), "the journaled snapshot", snapshot);
+        }
 
-    void Shift(const glm::vec3& step) {
-        position_ += step;
+        bool loaded = loadSnapshot(path, snapshot);
+        if (recorder_ != nullptr) {
+            std::vector<unsigned char> serialized;
+            if (loaded) {
+                serializeSnapshot(snapshot, serialized);
+            }
+            recorder_->WriteSnapshot(serialized);
+        }
+        return loaded;
     }
 
-protected:
-    glm::vec3 position_;
-    glm::vec3 direction_;
-    GLfloat speed_;
-    GLfloat collider_radius_;
-};
+    void Publish(FramePacket& packet, std::chrono::steady_clock::time_point input_time, glm::ivec2 framebuffer_size) {
+        ScopedTimer timer("sim.publish_ms");
+
+        FrameUniforms& uniforms = packet.uniforms;
+        uniforms.NearPlane = player_.GetColliderRadius();
+        uniforms.FarPlane = 300.0f;
+        uniforms.Projection = glm::perspective(glm::radians(player_.FOV()),
+                                               GLfloat(framebuffer_size.x) / GLfloat(framebuffer_size.y),
+                                               uniforms.NearPlane,
+                                               uniforms.FarPlane);
+        uniforms.View = glm::lookAt(
+                player_.GetPosition(),
+                player_.GetPosition() + player_.CameraDirection(),
+                player_.CameraUp()
+        );
+        uniforms.ViewProjection = uniforms.Projection * uniforms.View;
+        uniforms.CameraPosition = glm::vec4(player_.GetPosition(), 1.0f);
+
+        packet.lights.clear();
+        for (SceneObject* obj : objects_) {
+            if (obj->IsSnowBall()) {
+                packet.lights.push_back({obj->GetPosition(), SnowBall::kLightRadius,
+                                         glm::vec3(0.8f, 0.9f, 1.0f), SnowBall::kLightIntensity});
+            }
+        }
 
-class CubeEnemy : public SceneObject {
-public:
-    explicit CubeEnemy(const glm::vec3& position,
-                       glm::vec3 rotation = glm::vec3(1, 0, 0),
-                       float angle = 0.0,
-                       float scale_coef = 1.0f):
-            SceneObject(position,
-                        glm::vec3(0.0f),
-                        0.0,
-                        2,
-                        "cube.obj",
-                        "enemy_texture.bmp") {
-        glm::mat4 transform_mat = glm::mat4(1.0f);
-        glm::vec3 scale_vec = glm::vec3(scale_coef);
-
-        transform_mat = glm::scale(transform_mat, scale_vec);
-        transform_mat = glm::rotate(transform_mat, angle, rotation);
-        // transform_mat = glm::translate(transform_mat, position);
-
-        for (auto& vertex: vertices_) {
-            vertex = glm::vec3(transform_mat * glm::vec4(vertex, 1.0f));
+        for (auto& batch : packet.batches) {
+            for (auto& lod : batch.second) {
+                lod.clear();
+            }
+        }
+        packet.instances.clear();
+
+        if (gpu_culling_) {
+            for (SceneObject* obj : objects_) {
+                GpuInstance instance = {obj->GetTransform().Matrix(),
+                                        glm::vec4(obj->GetPosition(), obj->GetColliderRadius()),
+                                        obj->GetModel()->GetGpuMesh(), {0, 0, 0}};
+                packet.instances.push_back(instance);
+            }
+            packet.input_time = input_time;
+            return;
         }
 
-        collider_radius_ *= scale_coef;
-    }
-};
+        // LODs are picked for the framebuffer the render thread last reported
+        GLfloat pixels_per_unit = GLfloat(framebuffer_size.y) / (2.0f * tanf(glm::radians(player_.FOV()) / 2.0f));
+
+        // Only objects whose bounds reach into the view frustum are drawn
+        broadphase_->QueryFrustum(Frustum::FromMatrix(uniforms.ViewProjection), [&](int proxy) {
+            auto obj = static_cast<const SceneObject*>(broadphase_->GetUserData(proxy));
+            Model* model = obj->GetModel();
+            GLfloat distance = glm::length(obj->GetPosition() - player_.GetPosition());
+            GLuint lod = model->SelectLod(distance, obj->GetTransform().scale, pixels_per_unit);
+            auto& lods = packet.batches[model];
+            if (lods.size() < model->GetLodCount()) {
+                lods.resize(model->GetLodCount());
+            }
+            lods[lod].push_back(obj->GetTransform().Matrix());
+            return true;
+        });
 
-class SnowBall : public SceneObject {
-public:
-    explicit SnowBall(const glm::vec3& position,
-                      const glm::vec3& direction,
-                      GLfloat exclusion_radius = 0.75f,
-                      int sectorCount = 15,
-                      int stackCount = 15,
-                      GLfloat speed = 13.0f):
-            SceneObject(position, direction, speed, exclusion_radius, "ice_texture.bmp", {}, {}) {
-        std::vector<glm::vec3> temp_normals;
-        createSphere(exclusion_radius, sectorCount, stackCount, vertices_, temp_normals, uvs_,
-                     position);
-    }
-
-    bool IsSnowBall() const override {
-        return true;
+        packet.input_time = input_time;
     }
+
+    Model* enemy_model_;
+    Model* snowball_model_;
+    std::vector<SceneObject*> objects_;
+    // Bounding volumes of all objects, for collisions and culling
+    Broadphase* broadphase_;
+    Player player_;
+    EnemyCreator enemy_creator_;
+    SnapshotWriter snapshot_writer_;
+
+    // The simulation runs in fixed ticks whatever the frame rate
+    double tick_seconds_;
+    bool gpu_culling_;
+    uint64_t tick_ = 0;
+    uint32_t previous_buttons_ = 0;
+    InputRecorder* recorder_;
+    InputReplay* replay_;
+    Scenario* scenario_;
+    bool free_running_;
+
+    std::mutex input_mutex_;
+    TickInput pending_input_ = {0.0f, 0.0f, 0};
+    uint32_t held_buttons_ = 0;
+    std::chrono::steady_clock::time_point pending_time_;
+    glm::ivec2 framebuffer_size_ = glm::ivec2(kWindowWidth, kWindowHeight);
+
+    TripleBuffer<FramePacket> packets_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<bool> finished_{false};
+    std::thread thread_;
 };
 
-class Player : public Camera {
-public:
-    explicit Player(const glm::vec3& position = glm::vec3(0.0f),
-                    GLfloat collider_radius = 1.0f,
-                    GLfloat mouse_speed = 0.005f,
-                    GLfloat timedelay = 0.2f):
-            position_(position),
-            collider_radius_(collider_radius),
-            mouse_speed_(mouse_speed),
-            timedelay_(timedelay) {}
+void PrintUsage(const char* program) {
+    fprintf(stderr, "usage: %s [--record <journal> | --replay <journal>] [--tick-rate <hz>] [--broadphase tree|sap]"
+                    " [--vsync on|off|adaptive] [--fps <limit>] [--culling auto|cpu|gpu]"
+                    " [--budget <tag>[.gpu]=<MiB>]... [--track-leaks]"
+                    " [--scenario <file> [--headless] [--report <json>]]\n"
+                    "tags: renderer, assets, simulation, ui\n",
+            program);
+}
 
-    glm::vec3 GetPosition() const {
-        return position_;
+// "<tag>=<MiB>" budgets the tag's heap, "<tag>.gpu=<MiB>" its GL objects
+bool ParseBudget(const char* text) {
+    const char* equals = strchr(text, '=');
+    if (equals == nullptr || atof(equals + 1) <= 0.0) {
+        return false;
     }
-
-    GLfloat GetColliderRadius() const {
-        return collider_radius_;
+    std::string name(text, equals);
+    bool gpu = name.size() > 4 && name.compare(name.size() - 4, 4, ".gpu") == 0;
+    if (gpu) {
+        name.resize(name.size() - 4);
     }
+    MemoryTag tag;
+    if (!parseMemoryTag(name.c_str(), tag) || tag == MEMORY_OTHER) {
+        return false;
+    }
+    MemoryTracker& tracker = MemoryTracker::Instance();
+    MemoryTagStats stats = tracker.Stats(tag);
+    size_t bytes = size_t(atof(equals + 1) * 1024.0 * 1024.0);
+    tracker.SetBudget(tag, gpu ? stats.budget : bytes, gpu ? bytes : stats.gpu_budget);
+    return true;
+}
 
-    SnowBall* CreateSnowBall() {
-        double xpos, ypos;
-        glfwGetCursorPos(window, &xpos, &ypos);
-        glfwSetCursorPos(window, 1024 / 2, 768 / 2);
+// Runs a scenario without a window or GL context, ticking as fast as it can;
+// the models only carry what the simulation reads
+int RunHeadless(Scenario& scenario, BroadphaseType broadphase_type, int tick_rate, const char* report_path) {
+    Model* enemy_model;
+    Model* snowball_model;
+    {
+        MemoryScope scope(MEMORY_ASSETS, "headless models");
+        MeshData enemy_mesh;
+        if (!loadMesh("cube.obj", enemy_mesh)) {
+            fprintf(stderr, "Failed to load the game's assets\n");
+            return -1;
+        }
+        MeshData snowball_mesh;
+        BuildSnowballMesh(snowball_mesh);
+        enemy_model = Model::CreateHeadless("cube.obj", enemy_mesh);
+        snowball_model = Model::CreateHeadless("snowball_sphere", snowball_mesh);
+    }
 
-        horizontal_angle_ += mouse_speed_ * GLfloat(1024 / 2 - xpos);
-        vertical_angle_ += mouse_speed_ * GLfloat(768 / 2 - ypos);
+    Simulation* simulation;
+    {
+        MemoryScope scope(MEMORY_SIMULATION, "simulation");
+        simulation = new Simulation(enemy_model, snowball_model, broadphase_type, scenario.Seed(), tick_rate, false,
+                                    nullptr, nullptr, &scenario, true);
+    }
+    simulation->Start();
 
-        glm::vec3 camera_direction = CameraDirection();
+    // Stands in for the render thread, taking the packets and drawing nothing
+    while (!simulation->IsFinished()) {
+        simulation->Packets().Acquire();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    simulation->Stop();
+    printf("Ran scenario %s headless for %llu ticks, final scene %08x\n", scenario.Name().c_str(),
+           (unsigned long long)simulation->GetTick(), simulation->StateHash());
+    delete simulation;
+
+    Profiler::Instance().Report();
+    bool written = scenario.WriteReport(report_path, "headless");
+    delete enemy_model;
+    delete snowball_model;
+    return written ? 0 : 1;
+}
 
-        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-            if (glfwGetTime() > next_creation_time_) {
-                next_creation_time_ = glfwGetTime() + timedelay_;
-                auto* snowball = new SnowBall(position_ + camera_direction * 1.5f,
-                                              camera_direction);
-                return snowball;
+int main(int argc, char* argv[]) {
+    // A recorded session replays with the same inputs and seed and must end in the same scene
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+    // A scenario plays itself, in the window or without one, and reports how the game held up
+    const char* scenario_path = nullptr;
+    const char* report_path = nullptr;
+    bool headless = false;
+    int tick_rate = kTickRate;
+    BroadphaseType broadphase_type = BROADPHASE_AABB_TREE;
+    // Left to the driver the swap interval may be anything, so vsync is always set explicitly
+    VsyncMode vsync_mode = VSYNC_ON;
+    double fps_limit = 0.0;
+    // Auto culls on the GPU where the context supports it and on the CPU otherwise
+    enum CullingMode { CULLING_AUTO, CULLING_CPU, CULLING_GPU } culling_mode = CULLING_AUTO;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            scenario_path = argv[++i];
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            report_path = argv[++i];
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            tick_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--broadphase") == 0 && i + 1 < argc) {
+            ++i;
+            if (strcmp(argv[i], "tree") == 0) {
+                broadphase_type = BROADPHASE_AABB_TREE;
+            } else if (strcmp(argv[i], "sap") == 0) {
+                broadphase_type = BROADPHASE_SWEEP_AND_PRUNE;
+            } else {
+                PrintUsage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--vsync") == 0 && i + 1 < argc) {
+            ++i;
+            if (strcmp(argv[i], "on") == 0) {
+                vsync_mode = VSYNC_ON;
+            } else if (strcmp(argv[i], "off") == 0) {
+                vsync_mode = VSYNC_OFF;
+            } else if (strcmp(argv[i], "adaptive") == 0) {
+                vsync_mode = VSYNC_ADAPTIVE;
+            } else {
+                PrintUsage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc && atof(argv[i + 1]) >= 0.0) {
+            fps_limit = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc && ParseBudget(argv[i + 1])) {
+            ++i;
+        } else if (strcmp(argv[i], "--track-leaks") == 0) {
+            MemoryTracker::Instance().EnableLeakTracking();
+        } else if (strcmp(argv[i], "--culling") == 0 && i + 1 < argc) {
+            ++i;
+            if (strcmp(argv[i], "auto") == 0) {
+                culling_mode = CULLING_AUTO;
+            } else if (strcmp(argv[i], "cpu") == 0) {
+                culling_mode = CULLING_CPU;
+            } else if (strcmp(argv[i], "gpu") == 0) {
+                culling_mode = CULLING_GPU;
+            } else {
+                PrintUsage(argv[0]);
+                return 2;
             }
+        } else {
+            PrintUsage(argv[0]);
+            return 2;
         }
-
-        return nullptr;
+    }
+    // A scenario's starting scene is not in the journal, so the two do not mix
+    if ((record_path != nullptr && replay_path != nullptr) ||
+        (scenario_path != nullptr && (record_path != nullptr || replay_path != nullptr)) ||
+        (scenario_path == nullptr && (headless || report_path != nullptr))) {
+        PrintUsage(argv[0]);
+        return 2;
     }
 
-protected:
-    glm::vec3 position_;
-    GLfloat collider_radius_;
-    GLfloat mouse_speed_;
-    GLfloat timedelay_;
-    GLfloat next_creation_time_ = glfwGetTime();
-};
-
-class EnemyCreator {
-public:
-    explicit EnemyCreator(GLfloat timedelay = 3.0f,
-                          GLfloat min_radius = 5.0f,
-                          GLfloat max_radius = 50.0f,
-                          GLfloat min_size = 0.5f,
-                          GLfloat max_size = 4.0f):
-            timedelay_(timedelay),
-            rng_(std::random_device()()),
-            angle_(0, 2*PI),
-            radius_(min_radius, max_radius),
-            size_(min_size, max_size) {}
-
-    SceneObject* CreateEnemy(const glm::vec3& position) {
-        if (glfwGetTime() <= next_creation_time_) {
-            return nullptr;
+    // Once main's locals are gone, so what is still live at that point was leaked
+    MemoryTracker::Instance();
+    atexit([]() {
+        MemoryTracker::Instance().Report();
+        MemoryTracker::Instance().DumpLeaks();
+    });
+
+    InputReplay replay;
+    uint32_t seed = std::random_device()();
+    if (replay_path != nullptr) {
+        if (!replay.Open(replay_path)) {
+            return 1;
         }
+        seed = replay.Info().seed;
+        tick_rate = replay.Info().tick_rate;
+    }
+    InputRecorder recorder;
+    if (record_path != nullptr && !recorder.Open(record_path, seed, tick_rate)) {
+        return 1;
+    }
+    Scenario scenario;
+    if (scenario_path != nullptr) {
+        if (!scenario.Load(scenario_path)) {
+            return 1;
+        }
+        seed = scenario.Seed();
+    }
 
-        next_creation_time_ = glfwGetTime() + timedelay_;
-
-        GLfloat angle_rotation = angle_(rng_);
-        GLfloat phi = angle_(rng_);
-        GLfloat theta = angle_(rng_);
-
-        glm::vec3 rotation_axis(
-                cos(phi) * sin(theta),
-                sin(phi),
-                cos(phi) * cos(theta)
-        );
-
-        GLfloat angle_position = angle_(rng_);
-        glm::vec3 direction(
-                sin(angle_position),
-                0.0f,
-                cos(angle_position)
-        );
-
-        GLfloat radius = radius_(rng_);
-        glm::vec3 new_position = position + radius * direction;
-
-        GLfloat size = size_(rng_);
-        SceneObject* new_obj = new CubeEnemy(new_position,
-                                             rotation_axis,
-                                             angle_rotation,
-                                             size);
-
-        return new_obj;
+    // A shipped game reads every asset out of the pack, in development the loose files are used
+    if (FILE* pack = fopen("assets.pack", "rb")) {
+        fclose(pack);
+        AssetVfs::Instance().Mount("assets.pack");
     }
 
-private:
-    GLfloat timedelay_;
-    GLfloat next_creation_time_ = glfwGetTime();
-    std::mt19937 rng_;
-    std::uniform_real_distribution<> angle_;
-    std::uniform_real_distribution<> radius_;
-    std::uniform_real_distribution<> size_;
-};
+    if (headless) {
+        return RunHeadless(scenario, broadphase_type, tick_rate, report_path);
+    }
 
-int main() {
     // Initialise GLFW
     if (!glfwInit()) {
         fprintf( stderr, "Failed to initialize GLFW\n" );
@@ -432,13 +629,22 @@ int main() {
     }
 
     glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // Open a window and create its OpenGL context
-    window = glfwCreateWindow( 1024, 768, "Shooter", NULL, NULL);
+    // GPU culling needs 4.3; everything else runs on 3.3
+    window = NULL;
+    if (culling_mode != CULLING_CPU) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow( kWindowWidth, kWindowHeight, "Shooter", NULL, NULL);
+    }
+    if (window == NULL) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow( kWindowWidth, kWindowHeight, "Shooter", NULL, NULL);
+    }
     if (window == NULL) {
         fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n" );
         getchar();
@@ -446,6 +652,7 @@ int main() {
         return -1;
     }
     glfwMakeContextCurrent(window);
+    FramePacer::ApplyVsync(vsync_mode);
 
     // Initialize GLEW
     glewExperimental = true; // Needed for core profile
@@ -464,7 +671,7 @@ int main() {
 
     // Set the mouse at the center of the screen
     glfwPollEvents();
-    glfwSetCursorPos(window, 1024/2, 768/2);
+    glfwSetCursorPos(window, kWindowWidth/2, kWindowHeight/2);
 
     // Dark black background
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -476,122 +683,291 @@ int main() {
     // Cull triangles which normal is not towards the camera
     glEnable(GL_CULL_FACE);
 
-    GLuint VertexArrayID;
-    glGenVertexArrays(1, &VertexArrayID);
-    glBindVertexArray(VertexArrayID);
-
-    // Create and compile our GLSL program from the shaders
-    GLuint programID = LoadShaders("SimpleVertexShader.vertexshader",
-                                   "SimpleFragmentShader.fragmentshader");
+    // Camera data goes to every program through one uniform buffer update per frame
+    GLuint frame_uniform_buffer;
+    ClusteredLights* clustered_lights;
+    {
+        MemoryScope scope(MEMORY_RENDERER, "renderer");
+        frame_uniform_buffer = CreateFrameUniformBuffer();
+        clustered_lights = new ClusteredLights();
+    }
 
-    GLuint TextureID  = glGetUniformLocation(programID, "myTextureSampler");
-    GLuint ProjectionID = glGetUniformLocation(programID, "Projection");
-    GLuint ViewID = glGetUniformLocation(programID, "View");
-    GLuint ModelID = glGetUniformLocation(programID, "Model");
+    // Textures that are not loaded at startup stream in the background and show a placeholder until they arrive
+    auto texture_streamer = new TextureStreamer();
+
+    // Startup assets load as a task graph: files are read, decoded and cooked
+    // on worker threads while this thread, which holds the context, creates
+    // the GL objects as soon as their inputs are ready
+    AssetLoader loader;
+
+    std::string vertex_shader_code;
+    std::string fragment_shader_code;
+    AssetLoader::TaskId vertex_shader_task = loader.Add("SimpleVertexShader.vertexshader", [&]() {
+        return ReadShaderSource("SimpleVertexShader.vertexshader", vertex_shader_code);
+    });
+    AssetLoader::TaskId fragment_shader_task = loader.Add("SimpleFragmentShader.fragmentshader", [&]() {
+        return ReadShaderSource("SimpleFragmentShader.fragmentshader", fragment_shader_code);
+    });
+
+    GLuint programID = 0;
+    GLint EmissiveID = -1;
+    loader.Add("program", AssetLoader::Step(), [&]() {
+        programID = CompileShaders("SimpleVertexShader.vertexshader", vertex_shader_code,
+                                   "SimpleFragmentShader.fragmentshader", fragment_shader_code);
+        if (programID == 0) {
+            return false;
+        }
+        // Samplers never change unit, so they are set once instead of every draw
+        glUseProgram(programID);
+        glUniform1i(GetUniformLocation(programID, "TextureSampler"), 0);
+        ClusteredLights::SetupProgram(programID);
+        EmissiveID = GetUniformLocation(programID, "Emissive");
+        return true;
+    }, {vertex_shader_task, fragment_shader_task});
+
+    // The pixels are used straight out of the file, which stays open until the texture is created
+    struct StartupTexture {
+        const char* path;
+        AssetData file;
+        unsigned int width;
+        unsigned int height;
+        const unsigned char* pixels;
+        TextureHandle handle;
+    };
+    auto add_texture = [&](StartupTexture& texture) {
+        return loader.Add(texture.path, [&texture]() {
+            return AssetVfs::Instance().Open(texture.path, texture.file) &&
+                   parseBMP(texture.file.Data(), texture.file.Size(), texture.width, texture.height, texture.pixels);
+        }, [&texture, texture_streamer]() {
+            texture.handle = texture_streamer->AddResident(texture.path, texture.width, texture.height,
+                                                           texture.pixels);
+            texture.file.Close();
+            return true;
+        });
+    };
+    StartupTexture enemy_texture = {"enemy_texture.bmp", AssetData(), 0, 0, nullptr, nullptr};
+    AssetLoader::TaskId enemy_texture_task = add_texture(enemy_texture);
+
+    MeshData enemy_mesh;
+    AssetLoader::TaskId enemy_mesh_task = loader.Add("cube.obj", [&]() {
+        return loadMesh("cube.obj", enemy_mesh);
+    });
+    MeshData snowball_mesh;
+    AssetLoader::TaskId snowball_mesh_task = loader.Add("snowball_sphere", [&]() {
+        BuildSnowballMesh(snowball_mesh);
+        return true;
+    });
 
-    GLuint vertexbuffer;
-    glGenBuffers(1, &vertexbuffer);
+    // Every enemy and snowball references one of these meshes instead of owning a copy
+    Model* enemy_model = nullptr;
+    AssetLoader::TaskId enemy_model_task = loader.Add("enemy model", AssetLoader::Step(), [&]() {
+        enemy_model = new Model("cube.obj", enemy_texture.handle, std::move(enemy_mesh));
+        return true;
+    }, {enemy_mesh_task, enemy_texture_task});
+    Model* snowball_model = nullptr;
+    // No snowball exists before the first throw, so their texture streams in
+    // behind the first frames instead of holding up startup
+    AssetLoader::TaskId snowball_model_task = loader.Add("snowball model", AssetLoader::Step(), [&]() {
+        snowball_model = new Model("snowball_sphere", texture_streamer->Request("ice_texture.bmp"),
+                                   std::move(snowball_mesh));
+        snowball_model->SetEmissive(1.0f);
+        return true;
+    }, {snowball_mesh_task});
+
+    GpuCuller* gpu_culler = nullptr;
+    std::string cull_shader_code;
+    if (culling_mode != CULLING_CPU && GpuCuller::IsSupported()) {
+        AssetLoader::TaskId cull_shader_task = loader.Add("FrustumCullComputeShader.computeshader", [&]() {
+            return ReadShaderSource("FrustumCullComputeShader.computeshader", cull_shader_code);
+        });
+        loader.Add("gpu culler", AssetLoader::Step(), [&]() {
+            gpu_culler = new GpuCuller();
+            if (!gpu_culler->Init("FrustumCullComputeShader.computeshader", cull_shader_code)) {
+                delete gpu_culler;
+                gpu_culler = nullptr;
+                return false;
+            }
+            enemy_model->AddTo(*gpu_culler);
+            snowball_model->AddTo(*gpu_culler);
+            return true;
+        }, {cull_shader_task, enemy_model_task, snowball_model_task});
+    }
 
-    GLuint uvbuffer;
-    glGenBuffers(1, &uvbuffer);
+    loader.Run([](size_t done, size_t total, const std::string& name) {
+        MemoryScope scope(MEMORY_UI, "window title");
+        std::ostringstream title;
+        title << "Shooter - loading " << done << "/" << total << ": " << name;
+        glfwSetWindowTitle(window, title.str().c_str());
+    });
+    glfwSetWindowTitle(window, "Shooter");
+    loader.Report();
+
+    // What the assets keep resident, once the streamed textures are in and again at exit
+    auto report_memory = [&]() {
+        MemoryReport report;
+        if (enemy_model != nullptr) {
+            enemy_model->ReportMemory(report);
+        }
+        if (snowball_model != nullptr) {
+            snowball_model->ReportMemory(report);
+        }
+        texture_streamer->ReportMemory(report);
+        report.Print();
+    };
+    bool startup_memory_reported = false;
+
+    // The culler is optional, everything else is needed to play
+    if (programID == 0 || enemy_model == nullptr || snowball_model == nullptr) {
+        fprintf(stderr, "Failed to load the game's assets\n");
+        delete enemy_model;
+        delete snowball_model;
+        delete gpu_culler;
+        delete texture_streamer;
+        delete clustered_lights;
+        MemoryTracker::Instance().UntrackGpu(GPU_BUFFER, frame_uniform_buffer);
+        glDeleteBuffers(1, &frame_uniform_buffer);
+        DeleteProgram(programID);
+        glfwTerminate();
+        return -1;
+    }
 
-    std::vector<SceneObject*> objects;
-    auto player = new Player();
+    if (gpu_culler == nullptr && culling_mode == CULLING_GPU) {
+        printf("GPU culling needs OpenGL 4.3, culling on the CPU instead\n");
+    }
 
-    GLfloat prev_time = glfwGetTime();
+    Simulation* simulation;
+    {
+        MemoryScope scope(MEMORY_SIMULATION, "simulation");
+        simulation = new Simulation(enemy_model, snowball_model, broadphase_type, seed, tick_rate,
+                                    gpu_culler != nullptr,
+                                    record_path != nullptr ? &recorder : nullptr,
+                                    replay_path != nullptr ? &replay : nullptr,
+                                    scenario_path != nullptr ? &scenario : nullptr, false);
+    }
+    simulation->Start();
 
-    EnemyCreator enemy_creator;
+    // This thread polls input and draws whatever packet the simulation published last
+    FramePacket* packet = nullptr;
+    FramePacer pacer(fps_limit);
+    auto last_present = std::chrono::steady_clock::now();
 
     do {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        MemoryScope frame_scope(MEMORY_RENDERER, "frame");
+
+        // Input is read after the limiter's wait rather than before it, so the
+        // simulation gets the newest state of the devices
+        pacer.Pace();
+        {
+            MemoryScope input_scope(MEMORY_UI, "input");
+            glfwPollEvents();
+
+            // A replay or scenario brings its own input
+            if (replay_path == nullptr && scenario_path == nullptr) {
+                simulation->SubmitInput(SampleInput(window));
+            }
+        }
 
-        GLfloat current_time = glfwGetTime();
-        GLfloat timediff = current_time - prev_time;
+        int framebuffer_width, framebuffer_height;
+        glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+        simulation->SetFramebufferSize(framebuffer_width, framebuffer_height);
 
-        for (SceneObject* obj : objects) {
-            obj->Shift(obj->GetDirection() * obj->GetSpeed() * timediff);
+        FramePacket* latest = simulation->Packets().Acquire();
+        if (latest != nullptr) {
+            packet = latest;
         }
 
-        prev_time = current_time;
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        std::vector<bool> remains(objects.size(), true);
+        texture_streamer->Update();
+        if (!startup_memory_reported && texture_streamer->IsIdle()) {
+            report_memory();
+            startup_memory_reported = true;
+        }
 
-        for (size_t i = 0; i < objects.size(); ++i) {
-            if (remains[i] == false and objects[i]->IsSnowBall() == false) {
-                continue;
-            }
+        if (packet != nullptr) {
+            FrameUniforms& frame_uniforms = packet->uniforms;
+            frame_uniforms.ViewportSize = glm::vec2(framebuffer_width, framebuffer_height);
+            frame_uniforms.Time = glfwGetTime();
+            UpdateFrameUniformBuffer(frame_uniform_buffer, frame_uniforms);
 
-            for (size_t j = i + 1; j < objects.size(); ++j) {
-                if (objects[i]->IsIntersected(objects[j])) {
-                    if (objects[i]->IsSnowBall() xor objects[j]->IsSnowBall()) {
-                        remains[i] = remains[j] = false;
-                    }
-                }
+            clustered_lights->Update(packet->lights, frame_uniforms);
+
+            if (gpu_culler != nullptr) {
+                gpu_culler->Cull(packet->instances, frame_uniforms.ViewProjection);
             }
-        }
 
-        std::vector<SceneObject*> alive_objects;
+            glUseProgram(programID);
+            clustered_lights->Bind();
 
-        for (size_t i = 0; i < objects.size(); ++i) {
-            if (remains[i]) {
-                alive_objects.push_back(objects[i]);
+            if (gpu_culler != nullptr) {
+                gpu_culler->Draw(EmissiveID);
             } else {
-                delete objects[i];
+                for (auto& batch : packet->batches) {
+                    glUniform1f(EmissiveID, batch.first->GetEmissive());
+                    for (GLuint lod = 0; lod < batch.second.size(); ++lod) {
+                        batch.first->DrawInstances(batch.second[lod], lod);
+                    }
+                }
             }
         }
 
-        objects = alive_objects;
+        glfwSwapBuffers(window);
 
-        SnowBall* new_snowball = player->CreateSnowBall();
-        if (new_snowball != nullptr) {
-            objects.push_back(new_snowball);
+        // A scenario's frame times are from present to present
+        if (scenario_path != nullptr) {
+            auto now = std::chrono::steady_clock::now();
+            scenario.RecordFrame(std::chrono::duration<double, std::milli>(now - last_present).count());
+            last_present = now;
         }
 
-        SceneObject* new_enemy = enemy_creator.CreateEnemy(player->GetPosition());
-        if (new_enemy != nullptr) {
-            objects.push_back(new_enemy);
+        // Once per packet, from sampling the newest input it reflects to its first present
+        if (latest != nullptr && latest->input_time != std::chrono::steady_clock::time_point()) {
+            Profiler::Instance().Record("frame.input_latency_ms", std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - latest->input_time).count());
         }
 
-        glm::mat4 Projection = glm::perspective(glm::radians(player->FOV()),
-                                                4.0f / 3.0f,
-                                                player->GetColliderRadius(),
-                                                300.0f);
-        glm::mat4 View = glm::lookAt(
-                player->GetPosition(),
-                player->GetPosition() + player->CameraDirection(),
-                player->CameraUp()
-        );
-
-        glUseProgram(programID);
-
-        glUniformMatrix4fv(ProjectionID, 1, GL_FALSE, &Projection[0][0]);
-        glUniformMatrix4fv(ViewID, 1, GL_FALSE, &View[0][0]);
-
-        for (SceneObject* obj : objects) {
-            glm::mat4 Translate = glm::translate(glm::mat4(), obj->GetPosition());
-
-            glm::mat4 Model = Translate;
-            glUniformMatrix4fv(ModelID, 1, GL_FALSE, &Model[0][0]);
-
-            obj->Draw(TextureID, vertexbuffer, uvbuffer);
-        }
+    } while (!simulation->IsFinished() &&
+             glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
+             glfwWindowShouldClose(window) == 0);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    simulation->Stop();
 
-    } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
-             glfwWindowShouldClose(window) == 0);
+    int exit_code = 0;
+    uint64_t tick = simulation->GetTick();
+    uint32_t state_hash = simulation->StateHash();
+    if (record_path != nullptr) {
+        recorder.Close(state_hash);
+        printf("Recorded %llu ticks to %s, final scene %08x\n", (unsigned long long)tick, record_path, state_hash);
+    }
+    if (replay_path != nullptr && simulation->IsFinished()) {
+        bool identical = state_hash == replay.Info().state_hash;
+        printf("Replayed %llu ticks from %s, final scene %08x: %s\n", (unsigned long long)tick, replay_path,
+               state_hash, identical ? "identical to the recording" : "DIVERGED from the recording");
+        exit_code = identical ? 0 : 1;
+    }
 
-    for (SceneObject* obj : objects) {
-        delete obj;
+    delete simulation;
+    Profiler::Instance().Report();
+    DurationStats frame_stats = pacer.Stats();
+    printf("Last %zu frames: mean %.3f ms, std dev %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           frame_stats.count, frame_stats.mean, frame_stats.std_dev, frame_stats.p50, frame_stats.p95,
+           frame_stats.p99, frame_stats.max);
+    report_memory();
+    if (scenario_path != nullptr && !scenario.WriteReport(report_path, "windowed")) {
+        exit_code = 1;
     }
 
-    glDeleteBuffers(1, &vertexbuffer);
-    glDeleteBuffers(1, &uvbuffer);
-    glDeleteProgram(programID);
-    glDeleteVertexArrays(1, &VertexArrayID);
+    delete enemy_model;
+    delete snowball_model;
+    delete texture_streamer;
+    delete clustered_lights;
+    delete gpu_culler;
+
+    MemoryTracker::Instance().UntrackGpu(GPU_BUFFER, frame_uniform_buffer);
+    glDeleteBuffers(1, &frame_uniform_buffer);
+    DeleteProgram(programID);
 
     glfwTerminate();
 
-    return 0;
+    return exit_code;
 }
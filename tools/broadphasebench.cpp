@@ -0,0 +1,111 @@
+// Compares the broadphases on scenes like the game's: enemies that never move
+// and snowballs flying through them, from sparse to very crowded.
+//
+//   broadphasebench [enemies] [snowballs] [ticks]
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "../common/broadphase.hpp"
+
+struct Body {
+    glm::vec3 position;
+    glm::vec3 velocity;
+    float radius;
+    int proxy;
+};
+
+struct Result {
+    double build_ms;
+    double tick_ms;
+    long long pairs;  // pairs whose boxes really overlap, must match between broadphases
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Result Run(BroadphaseType type, std::vector<Body> bodies, float extent, int ticks) {
+    const float tick_seconds = 1.0f / 60.0f;
+    Broadphase* broadphase = Broadphase::Create(type);
+    Result result = {0.0, 0.0, 0};
+
+    auto start = std::chrono::steady_clock::now();
+    for (Body& body : bodies) {
+        body.proxy = broadphase->CreateProxy(AABB::Sphere(body.position, body.radius), &body);
+    }
+    broadphase->UpdatePairs([](int, int) {});
+    result.build_ms = MillisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        for (Body& body : bodies) {
+            if (body.velocity == glm::vec3(0.0f)) {
+                continue;
+            }
+            glm::vec3 step = body.velocity * tick_seconds;
+            // Snowballs that leave the scene come back on the other side
+            if (glm::abs(body.position.x + step.x) > extent || glm::abs(body.position.z + step.z) > extent) {
+                body.position = -body.position;
+            }
+            AABB swept = AABB::Union(AABB::Sphere(body.position, body.radius),
+                                     AABB::Sphere(body.position + step, body.radius));
+            broadphase->MoveProxy(body.proxy, swept, step);
+            body.position += step;
+        }
+        broadphase->UpdatePairs([&](int a, int b) {
+            auto first = static_cast<const Body*>(broadphase->GetUserData(a));
+            auto second = static_cast<const Body*>(broadphase->GetUserData(b));
+            if (glm::length(first->position - second->position) < first->radius + second->radius) {
+                ++result.pairs;
+            }
+        });
+    }
+    result.tick_ms = MillisecondsSince(start) / ticks;
+
+    delete broadphase;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    int enemies = argc > 1 ? atoi(argv[1]) : 20000;
+    int snowballs = argc > 2 ? atoi(argv[2]) : 500;
+    int ticks = argc > 3 ? atoi(argv[3]) : 120;
+
+    // Half the side of the square the enemies are spread over
+    const float extents[] = {2000.0f, 500.0f, 150.0f, 50.0f};
+    const BroadphaseType types[] = {BROADPHASE_AABB_TREE, BROADPHASE_SWEEP_AND_PRUNE};
+
+    printf("%d enemies, %d snowballs, %d ticks\n", enemies, snowballs, ticks);
+    printf("%-16s %8s %10s %10s %12s\n", "broadphase", "extent", "build ms", "tick ms", "contacts");
+
+    for (float extent : extents) {
+        // Same placement as EnemyCreator: random sizes on the ground plane
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> coordinate(-extent, extent);
+        std::uniform_real_distribution<float> size(0.5f, 4.0f);
+        std::uniform_real_distribution<float> angle(0.0f, 6.2832f);
+
+        std::vector<Body> bodies;
+        for (int i = 0; i < enemies; ++i) {
+            bodies.push_back({glm::vec3(coordinate(rng), 0.0f, coordinate(rng)), glm::vec3(0.0f), 2.0f * size(rng), 0});
+        }
+        for (int i = 0; i < snowballs; ++i) {
+            float a = angle(rng);
+            bodies.push_back({glm::vec3(coordinate(rng), 0.0f, coordinate(rng)),
+                              13.0f * glm::vec3(sinf(a), 0.0f, cosf(a)), 0.75f, 0});
+        }
+
+        for (BroadphaseType type : types) {
+            Broadphase* named = Broadphase::Create(type);
+            Result result = Run(type, bodies, extent, ticks);
+            printf("%-16s %8.0f %10.2f %10.3f %12lld\n", named->Name(), extent, result.build_ms, result.tick_ms,
+                   result.pairs);
+            delete named;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Generates the LOD chain of models and stores it in their mesh cache, where
+// the game's LOD selection finds it. Every level is simplified from the full
+// mesh down to a ratio of its triangles, or until the error limit (relative
+// to the model's extent) is reached, whichever comes first; a level that
+// would not remove a tenth of the previous one ends the chain.
+//
+//   lodgen [--ratios 0.5,0.25,0.125] [--max-error <error>] <model.obj>...
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../common/meshcache.hpp"
+#include "../common/meshoptimizer.hpp"
+#include "../common/meshsimplify.hpp"
+
+static bool ParseRatios(const char* text, std::vector<float>& ratios) {
+    ratios.clear();
+    while (*text) {
+        char* end;
+        float ratio = strtof(text, &end);
+        if (end == text || ratio <= 0.0f || ratio >= 1.0f) {
+            return false;
+        }
+        ratios.push_back(ratio);
+        text = *end == ',' ? end + 1 : end;
+    }
+    return !ratios.empty();
+}
+
+int main(int argc, char* argv[]) {
+    const float default_ratios[] = MESH_LOD_RATIOS;
+    std::vector<float> ratios(default_ratios, default_ratios + sizeof(default_ratios) / sizeof(default_ratios[0]));
+    float max_error = FLT_MAX;
+    int first_path = 1;
+    while (first_path < argc && strncmp(argv[first_path], "--", 2) == 0) {
+        if (strcmp(argv[first_path], "--ratios") == 0 && first_path + 1 < argc &&
+            ParseRatios(argv[first_path + 1], ratios)) {
+            first_path += 2;
+        } else if (strcmp(argv[first_path], "--max-error") == 0 && first_path + 1 < argc &&
+                   atof(argv[first_path + 1]) > 0.0) {
+            max_error = atof(argv[first_path + 1]);
+            first_path += 2;
+        } else {
+            first_path = argc;
+        }
+    }
+    if (first_path >= argc) {
+        fprintf(stderr, "usage: %s [--ratios 0.5,0.25,0.125] [--max-error <error>] <model.obj>...\n", argv[0]);
+        return 2;
+    }
+
+    int exit_code = 0;
+    for (int i = first_path; i < argc; ++i) {
+        const char* path = argv[i];
+        MeshData mesh;
+        if (!loadMesh(path, mesh)) {
+            exit_code = 1;
+            continue;
+        }
+
+        printf("%s\n", path);
+        printf("  %-6s %10s %10s %10s\n", "level", "triangles", "error", "ACMR");
+        VertexCacheStats stats = analyzeVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE);
+        printf("  %-6d %10zu %10.4f %10.3f\n", 0, mesh.indices.size() / 3, 0.0, stats.acmr);
+
+        auto start = std::chrono::steady_clock::now();
+        buildMeshLods(mesh, ratios, max_error);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        for (size_t level = 0; level < mesh.lods.size(); ++level) {
+            const MeshLod& lod = mesh.lods[level];
+            stats = analyzeVertexCache(lod.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE);
+            printf("  %-6zu %10zu %10.4f %10.3f\n", level + 1, lod.indices.size() / 3, lod.error, stats.acmr);
+        }
+        printf("  %zu levels in %.2f ms\n", mesh.lods.size(), ms);
+
+        std::string cache_path = std::string(path) + ".meshcache";
+        if (!saveMeshCache(cache_path.c_str(), mesh, meshSourceStamp(path))) {
+            exit_code = 1;
+        }
+    }
+    return exit_code;
+}
@@ -0,0 +1,131 @@
+// Compares the ways a model can be loaded: the hand-rolled OBJ parser as is,
+// the parser followed by indexing, then by optimizeMesh, the assimp import
+// with its ImproveCacheLocality post-processing as a baseline (when built
+// with USE_ASSIMP) and a hit in the binary mesh cache. For each it reports
+// the load time, the post-transform vertex cache efficiency and the overdraw.
+//
+//   meshbench [repeats] <model.obj>...
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../common/meshcache.hpp"
+#include "../common/meshoptimizer.hpp"
+#include "../common/objloader.hpp"
+
+// Typical post-transform cache sizes, in vertices
+const size_t kCacheSizes[] = {16, 32};
+
+// Best of the repeats, so a cold first read does not skew the numbers
+static double BestMilliseconds(int repeats, const std::function<bool()>& load) {
+    double best = 0.0;
+    for (int i = 0; i < repeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        if (!load()) {
+            return -1.0;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || ms < best) {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+static void Report(const char* loader, double ms, const MeshData& mesh) {
+    if (ms < 0.0) {
+        printf("  %-14s failed\n", loader);
+        return;
+    }
+    printf("  %-14s %10.3f ms %9zu vertices %9zu triangles", loader, ms, mesh.vertices.size(),
+           mesh.indices.size() / 3);
+    for (size_t cache_size : kCacheSizes) {
+        VertexCacheStats stats = analyzeVertexCache(mesh.indices, mesh.vertices.size(), cache_size);
+        printf("  ACMR(%zu) %.3f ATVR(%zu) %.3f", cache_size, stats.acmr, cache_size, stats.atvr);
+    }
+    printf("  overdraw %.3f\n", analyzeOverdraw(mesh.vertices, mesh.indices));
+}
+
+int main(int argc, char* argv[]) {
+    int first_path = 1;
+    int repeats = 10;
+    if (argc > 1 && atoi(argv[1]) > 0) {
+        repeats = atoi(argv[1]);
+        first_path = 2;
+    }
+    if (first_path >= argc) {
+        fprintf(stderr, "usage: %s [repeats] <model.obj>...\n", argv[0]);
+        return 2;
+    }
+
+    for (int i = first_path; i < argc; ++i) {
+        const char* path = argv[i];
+        printf("%s\n", path);
+
+        // loadOBJ repeats every corner of every triangle, so its indices are just 0, 1, 2, ...
+        MeshData unindexed;
+        double ms = BestMilliseconds(repeats, [&]() {
+            unindexed = MeshData();
+            return loadOBJ(path, unindexed.vertices, unindexed.uvs, unindexed.normals);
+        });
+        for (size_t index = 0; index < unindexed.vertices.size(); ++index) {
+            unindexed.indices.push_back(index);
+        }
+        Report("loadOBJ", ms, unindexed);
+
+        MeshData indexed;
+        ms = BestMilliseconds(repeats, [&]() {
+            std::vector<glm::vec3> vertices;
+            std::vector<glm::vec2> uvs;
+            std::vector<glm::vec3> normals;
+            indexed = MeshData();
+            if (!loadOBJ(path, vertices, uvs, normals)) {
+                return false;
+            }
+            indexMesh(vertices, uvs, normals, indexed.indices, indexed.vertices, indexed.uvs, indexed.normals);
+            return true;
+        });
+        Report("loadOBJ+index", ms, indexed);
+
+        // Timed on its own, the load is the row above
+        MeshData optimized;
+        ms = BestMilliseconds(repeats, [&]() {
+            optimized = indexed;
+            optimizeMesh(optimized);
+            return true;
+        });
+        Report("optimizeMesh", ms, optimized);
+
+#ifdef USE_ASSIMP
+        MeshData imported;
+        ms = BestMilliseconds(repeats, [&]() {
+            imported = MeshData();
+            return loadAssImp(path, imported.indices, imported.vertices, imported.uvs, imported.normals);
+        });
+        Report("assimp", ms, imported);
+#else
+        printf("  %-14s not built, configure with USE_ASSIMP\n", "assimp");
+#endif
+
+        // The cache the game would read on its next start
+        std::string cache_path = std::string(path) + ".bench.meshcache";
+        uint64_t stamp = meshSourceStamp(path);
+        MeshData cached;
+        ms = -1.0;
+        if (saveMeshCache(cache_path.c_str(), optimized, stamp)) {
+            ms = BestMilliseconds(repeats, [&]() {
+                cached = MeshData();
+                return loadMeshCache(cache_path.c_str(), stamp, cached);
+            });
+            remove(cache_path.c_str());
+        }
+        Report("mesh cache", ms, cached);
+    }
+    return 0;
+}
@@ -0,0 +1,501 @@
+// Times the engine's hot functions one at a time, so a regression shows up as
+// a number that moved instead of a game that feels slower. Every case warms
+// up, sizes a batch of operations to take about a millisecond and times a
+// number of batches; it reports the median time per operation with its
+// median absolute deviation, and the heap bytes and allocations per
+// operation. Inputs come from fixed seeds, so runs are comparable across
+// commits; --csv and --json write the results for keeping or diffing.
+//
+//   shooter_microbench [--filter <text>] [--repetitions <n>] [--csv <file>] [--json <file>]
+//
+// Run it from the directory with the game's assets; cases whose files are
+// missing are skipped.
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../common/broadphase.hpp"
+#include "../common/memorytracker.hpp"
+#include "../common/objloader.hpp"
+#include "../common/scene.hpp"
+#include "../common/texture.hpp"
+
+struct Options {
+    const char* filter = nullptr;
+    size_t repetitions = 15;
+    double warmup_ms = 100.0;
+    double batch_ms = 1.0;
+};
+
+struct Result {
+    std::string name;
+    size_t repetitions;
+    size_t batch;  // operations per repetition
+    double ns_per_op;
+    double mad_ns;
+    double bytes_per_op;
+    double allocs_per_op;
+};
+
+// Results end up here, so the compiler cannot drop the work that made them
+static volatile float sink;
+
+static double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+}
+
+// Heap traffic of the whole program since startup, counted by the MemoryTracker
+struct HeapTotals {
+    size_t bytes = 0;
+    size_t allocations = 0;
+
+    static HeapTotals Now() {
+        HeapTotals totals;
+        for (int tag = 0; tag < MEMORY_TAG_COUNT; ++tag) {
+            MemoryTagStats stats = MemoryTracker::Instance().Stats(MemoryTag(tag));
+            totals.bytes += stats.allocated_bytes;
+            totals.allocations += stats.allocations;
+        }
+        return totals;
+    }
+};
+
+// loadOBJ and readBMP_custom log every call, which would flood the report
+// and time the terminal along with them
+class QuietStdout {
+public:
+    QuietStdout() {
+        fflush(stdout);
+        saved_ = dup(fileno(stdout));
+#ifdef _WIN32
+        int null_device = open("NUL", O_WRONLY);
+#else
+        int null_device = open("/dev/null", O_WRONLY);
+#endif
+        dup2(null_device, fileno(stdout));
+        close(null_device);
+    }
+
+    ~QuietStdout() {
+        fflush(stdout);
+        dup2(saved_, fileno(stdout));
+        close(saved_);
+    }
+
+private:
+    int saved_;
+};
+
+class Harness {
+public:
+    explicit Harness(const Options& options): options_(options) {}
+
+    // Whether the case is selected, for cases whose inputs are expensive to build
+    bool Wants(const std::string& name) const {
+        return options_.filter == nullptr || name.find(options_.filter) != std::string::npos;
+    }
+
+    // Times op in batches
+    void Run(const std::string& name, const std::function<void()>& op) {
+        Run(name, nullptr, op);
+    }
+
+    // With a setup, which runs untimed before every op, each op is timed on its own
+    void Run(const std::string& name, const std::function<void()>& setup, const std::function<void()>& op) {
+        if (!Wants(name)) {
+            return;
+        }
+        typedef std::chrono::steady_clock clock;
+        Result result = {name, options_.repetitions, 1, 0.0, 0.0, 0.0, 0.0};
+        std::vector<double> samples;
+        {
+            QuietStdout quiet;
+
+            size_t warmup_ops = 0;
+            double warmup_ns = 0.0;
+            while (warmup_ns < options_.warmup_ms * 1e6) {
+                if (setup) {
+                    setup();
+                }
+                auto start = clock::now();
+                op();
+                warmup_ns += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+                ++warmup_ops;
+            }
+            if (!setup) {
+                result.batch = std::max<size_t>(1, size_t(options_.batch_ms * 1e6 * warmup_ops / warmup_ns));
+            }
+
+            HeapTotals heap_used;
+            for (size_t repetition = 0; repetition < options_.repetitions; ++repetition) {
+                if (setup) {
+                    setup();
+                }
+                HeapTotals before = HeapTotals::Now();
+                auto start = clock::now();
+                for (size_t i = 0; i < result.batch; ++i) {
+                    op();
+                }
+                double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+                HeapTotals after = HeapTotals::Now();
+                heap_used.bytes += after.bytes - before.bytes;
+                heap_used.allocations += after.allocations - before.allocations;
+                samples.push_back(ns / result.batch);
+            }
+
+            double ops = double(result.batch) * options_.repetitions;
+            result.bytes_per_op = heap_used.bytes / ops;
+            result.allocs_per_op = heap_used.allocations / ops;
+        }
+
+        result.ns_per_op = Median(samples);
+        std::vector<double> deviations;
+        for (double sample : samples) {
+            deviations.push_back(fabs(sample - result.ns_per_op));
+        }
+        result.mad_ns = Median(deviations);
+
+        printf("%-36s %14.1f %10.1f %12.1f %10.1f %8zu\n", name.c_str(), result.ns_per_op, result.mad_ns,
+               result.bytes_per_op, result.allocs_per_op, result.batch);
+        fflush(stdout);
+        results_.push_back(result);
+    }
+
+    void PrintHeader() const {
+        printf("%-36s %14s %10s %12s %10s %8s\n", "benchmark", "ns/op", "MAD ns", "bytes/op", "allocs/op",
+               "batch");
+    }
+
+    bool WriteCsv(const char* path) const {
+        FILE* file = fopen(path, "w");
+        if (file == nullptr) {
+            fprintf(stderr, "Could not write %s\n", path);
+            return false;
+        }
+        fprintf(file, "name,repetitions,batch,ns_per_op,mad_ns,bytes_per_op,allocs_per_op\n");
+        for (const Result& result : results_) {
+            fprintf(file, "%s,%zu,%zu,%.3f,%.3f,%.3f,%.3f\n", result.name.c_str(), result.repetitions,
+                    result.batch, result.ns_per_op, result.mad_ns, result.bytes_per_op, result.allocs_per_op);
+        }
+        fclose(file);
+        return true;
+    }
+
+    bool WriteJson(const char* path) const {
+        FILE* file = fopen(path, "w");
+        if (file == nullptr) {
+            fprintf(stderr, "Could not write %s\n", path);
+            return false;
+        }
+        fprintf(file, "{\n  \"benchmarks\": [\n");
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const Result& result = results_[i];
+            fprintf(file, "    {\"name\": \"%s\", \"repetitions\": %zu, \"batch\": %zu, \"ns_per_op\": %.3f, "
+                          "\"mad_ns\": %.3f, \"bytes_per_op\": %.3f, \"allocs_per_op\": %.3f}%s\n",
+                    result.name.c_str(), result.repetitions, result.batch, result.ns_per_op, result.mad_ns,
+                    result.bytes_per_op, result.allocs_per_op, i + 1 < results_.size() ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+        fclose(file);
+        return true;
+    }
+
+private:
+    Options options_;
+    std::vector<Result> results_;
+};
+
+static bool FileExists(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file != nullptr) {
+        fclose(file);
+    }
+    return file != nullptr;
+}
+
+// A sphere as an indexed OBJ, the kind of file loadOBJ sees for a large model
+static bool WriteSphereObj(const std::string& path, int sectors, int stacks) {
+    std::vector<glm::vec3> corners;
+    std::vector<glm::vec3> corner_normals;
+    std::vector<glm::vec2> corner_uvs;
+    createSphere(1.0f, sectors, stacks, corners, corner_normals, corner_uvs);
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    indexMesh(corners, corner_uvs, corner_normals, indices, vertices, uvs, normals);
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    for (const glm::vec3& v : vertices) {
+        fprintf(file, "v %f %f %f\n", v.x, v.y, v.z);
+    }
+    for (const glm::vec2& uv : uvs) {
+        fprintf(file, "vt %f %f\n", uv.x, uv.y);
+    }
+    for (const glm::vec3& n : normals) {
+        fprintf(file, "vn %f %f %f\n", n.x, n.y, n.z);
+    }
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", indices[i] + 1, indices[i] + 1, indices[i] + 1,
+                indices[i + 1] + 1, indices[i + 1] + 1, indices[i + 1] + 1,
+                indices[i + 2] + 1, indices[i + 2] + 1, indices[i + 2] + 1);
+    }
+    fclose(file);
+    return true;
+}
+
+// A 24 bpp BMP of noise, as large as a detailed texture
+static bool WriteBmp(const std::string& path, unsigned int width, unsigned int height) {
+    unsigned int image_size = bmpRowSize(width) * height;
+    unsigned char header[54] = {'B', 'M'};
+    auto put = [&](int offset, unsigned int value) {
+        for (int i = 0; i < 4; ++i) {
+            header[offset + i] = (unsigned char)(value >> (8 * i));
+        }
+    };
+    put(0x02, 54 + image_size);
+    put(0x0A, 54);
+    put(0x0E, 40);
+    put(0x12, width);
+    put(0x16, height);
+    header[0x1A] = 1;
+    header[0x1C] = 24;
+    put(0x22, image_size);
+
+    std::vector<unsigned char> pixels(image_size);
+    std::mt19937 rng(1);
+    for (unsigned char& pixel : pixels) {
+        pixel = (unsigned char)rng();
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+                   fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+    fclose(file);
+    return written;
+}
+
+// Enemies at the game's sizes, at a constant density however many there
+// are, and a tenth as many snowballs flying through them
+static void BuildScene(int enemies, std::vector<SceneObject*>& objects, Broadphase& broadphase) {
+    float extent = 4.0f * sqrtf(float(enemies));
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coordinate(-extent, extent);
+    std::uniform_real_distribution<float> size(0.5f, 4.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 2 * PI);
+    for (int i = 0; i < enemies; ++i) {
+        AddObject(new CubeEnemy(nullptr, glm::vec3(coordinate(rng), 0.0f, coordinate(rng)), glm::vec3(1, 0, 0),
+                                angle(rng), size(rng)), objects, broadphase);
+    }
+    for (int i = 0; i < enemies / 10; ++i) {
+        float a = angle(rng);
+        AddObject(new SnowBall(nullptr, glm::vec3(coordinate(rng), 0.0f, coordinate(rng)),
+                               glm::vec3(sinf(a), 0.0f, cosf(a))), objects, broadphase);
+    }
+}
+
+static void DestroyScene(std::vector<SceneObject*>& objects) {
+    for (SceneObject* obj : objects) {
+        delete obj;
+    }
+    objects.clear();
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    const char* csv_path = nullptr;
+    const char* json_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            options.repetitions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--filter <text>] [--repetitions <n>] [--csv <file>] [--json <file>]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    Harness harness(options);
+    harness.PrintHeader();
+
+    // 15x15 is the snowball mesh
+    const int tessellations[] = {15, 64, 256};
+    for (int tessellation : tessellations) {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec2> uvs;
+        harness.Run("createSphere/" + std::to_string(tessellation) + "x" + std::to_string(tessellation), [&]() {
+            vertices.clear();
+            normals.clear();
+            uvs.clear();
+            createSphere(1.0f, tessellation, tessellation, vertices, normals, uvs);
+            sink = vertices.back().x;
+        });
+    }
+
+    // Generated inputs go to the temporary directory and are removed at the end
+    std::error_code error;
+    std::filesystem::path temp_dir = std::filesystem::temp_directory_path(error);
+    std::string huge_obj = (temp_dir / "shooter_microbench_sphere.obj").string();
+    std::string large_bmp = (temp_dir / "shooter_microbench_noise.bmp").string();
+
+    std::vector<std::pair<std::string, std::string>> objs;
+    if (FileExists("cube.obj")) {
+        objs.push_back({"loadOBJ/cube.obj", "cube.obj"});
+    } else {
+        printf("%-36s skipped, cube.obj is not in the working directory\n", "loadOBJ/cube.obj");
+    }
+    if (harness.Wants("loadOBJ/sphere_512x256") && WriteSphereObj(huge_obj, 512, 256)) {
+        objs.push_back({"loadOBJ/sphere_512x256", huge_obj});
+    }
+    for (const auto& obj : objs) {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        harness.Run(obj.first, [&]() {
+            vertices.clear();
+            uvs.clear();
+            normals.clear();
+            loadOBJ(obj.second.c_str(), vertices, uvs, normals);
+            sink = vertices.empty() ? 0.0f : vertices.back().x;
+        });
+    }
+
+    // loadBMP_custom is this followed by the upload, which needs a GL context
+    std::vector<std::pair<std::string, std::string>> bmps;
+    if (FileExists("enemy_texture.bmp")) {
+        bmps.push_back({"readBMP_custom/enemy_texture.bmp", "enemy_texture.bmp"});
+    } else {
+        printf("%-36s skipped, enemy_texture.bmp is not in the working directory\n",
+               "readBMP_custom/enemy_texture.bmp");
+    }
+    if (harness.Wants("readBMP_custom/noise_2048x2048") && WriteBmp(large_bmp, 2048, 2048)) {
+        bmps.push_back({"readBMP_custom/noise_2048x2048", large_bmp});
+    }
+    for (const auto& bmp : bmps) {
+        std::vector<unsigned char> data;
+        harness.Run(bmp.first, [&]() {
+            unsigned int width, height;
+            readBMP_custom(bmp.second.c_str(), width, height, data);
+            sink = data.empty() ? 0.0f : data.back();
+        });
+    }
+
+    // One snowball against a batch of enemies, the narrow test of a pair
+    if (harness.Wants("IsIntersected/1024")) {
+        Broadphase* broadphase = Broadphase::Create(BROADPHASE_AABB_TREE);
+        std::vector<SceneObject*> objects;
+        BuildScene(1024, objects, *broadphase);
+        SceneObject* snowball = objects.back();
+        harness.Run("IsIntersected/1024", [&]() {
+            int hits = 0;
+            for (int i = 0; i < 1024; ++i) {
+                hits += snowball->IsIntersected(objects[i]);
+            }
+            sink = float(hits);
+        });
+        DestroyScene(objects);
+        delete broadphase;
+    }
+
+    // The collision pass leaves everything in place, so it can run on the same scene again
+    const int scene_sizes[] = {1000, 10000, 100000};
+    for (int enemies : scene_sizes) {
+        std::string name = "CollideScene/" + std::to_string(enemies);
+        if (!harness.Wants(name)) {
+            continue;
+        }
+        Broadphase* broadphase = Broadphase::Create(BROADPHASE_AABB_TREE);
+        std::vector<SceneObject*> objects;
+        BuildScene(enemies, objects, *broadphase);
+        broadphase->UpdatePairs([](int, int) {});
+        harness.Run(name, [&]() {
+            CollideScene(1.0f / 60.0f, objects, *broadphase);
+        });
+        DestroyScene(objects);
+        delete broadphase;
+    }
+
+    // A tenth of the scene is destroyed before every pass and replaced after it
+    for (int enemies : scene_sizes) {
+        std::string name = "CompactScene/" + std::to_string(enemies);
+        if (!harness.Wants(name)) {
+            continue;
+        }
+        Broadphase* broadphase = Broadphase::Create(BROADPHASE_AABB_TREE);
+        std::vector<SceneObject*> objects;
+        BuildScene(enemies, objects, *broadphase);
+        size_t scene_size = objects.size();
+        std::mt19937 rng(2);
+        std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+        harness.Run(name, [&]() {
+            while (objects.size() < scene_size) {
+                AddObject(new CubeEnemy(nullptr, glm::vec3(coordinate(rng), 0.0f, coordinate(rng))), objects,
+                          *broadphase);
+            }
+            for (size_t i = 0; i < objects.size(); i += 10) {
+                objects[i]->Destroy();
+            }
+        }, [&]() {
+            CompactScene(objects, *broadphase);
+        });
+        DestroyScene(objects);
+        delete broadphase;
+    }
+
+    // The player's view as Publish builds it, for a batch of orientations
+    std::vector<Camera> cameras;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> angle(-PI, PI);
+    for (int i = 0; i < 256; ++i) {
+        cameras.emplace_back(angle(rng), angle(rng) / 2);
+    }
+    harness.Run("Camera/basis_256", [&]() {
+        glm::vec3 sum(0.0f);
+        for (Camera& camera : cameras) {
+            sum += camera.CameraDirection() + camera.CameraRight() + camera.CameraUp();
+        }
+        sink = sum.x + sum.y + sum.z;
+    });
+
+    std::filesystem::remove(huge_obj, error);
+    std::filesystem::remove(large_bmp, error);
+
+    bool written = true;
+    if (csv_path != nullptr) {
+        written = harness.WriteCsv(csv_path) && written;
+    }
+    if (json_path != nullptr) {
+        written = harness.WriteJson(json_path) && written;
+    }
+    return written ? 0 : 1;
+}
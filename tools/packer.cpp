@@ -0,0 +1,68 @@
+// Builds the asset pack the game mounts at startup. Every file is stored
+// under the name it is given on the command line, which is the name the
+// loaders ask for; OBJ models also get their mesh cache cooked in, so the
+// game never parses them.
+//
+//   packer <output.pack> <asset>...
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "../common/assetpack.hpp"
+#include "../common/mappedfile.hpp"
+#include "../common/meshcache.hpp"
+
+static bool EndsWith(const std::string& text, const char* suffix) {
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+// The same cook loadMesh does on a cache miss
+static bool CookMesh(const char* path, std::vector<unsigned char>& out) {
+    MeshData mesh;
+    if (!cookMesh(path, mesh)) {
+        return false;
+    }
+    // Packed caches are not tied to a source file
+    serializeMeshCache(mesh, 0, out);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <output.pack> <asset>...\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<PackInput> inputs;
+    size_t total_size = 0;
+    for (int i = 2; i < argc; ++i) {
+        MappedFile file;
+        if (!file.Open(argv[i])) {
+            return 1;
+        }
+        PackInput input;
+        input.name = argv[i];
+        input.data.assign(file.Data(), file.Data() + file.Size());
+        total_size += input.data.size();
+        inputs.push_back(std::move(input));
+
+        if (EndsWith(argv[i], ".obj")) {
+            PackInput cooked;
+            cooked.name = std::string(argv[i]) + ".meshcache";
+            if (!CookMesh(argv[i], cooked.data)) {
+                return 1;
+            }
+            total_size += cooked.data.size();
+            inputs.push_back(std::move(cooked));
+        }
+    }
+
+    if (!writeAssetPack(argv[1], inputs)) {
+        return 1;
+    }
+    printf("Packed %zu assets, %zu bytes, into %s\n", inputs.size(), total_size, argv[1]);
+    return 0;
+}
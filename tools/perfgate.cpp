@@ -0,0 +1,280 @@
+// Compares scenario reports with the checked-in performance baseline and
+// fails when a metric regressed past its tolerance.
+//
+//   perfgate [--skip-timings] <baseline.json> <report.json>...
+//
+// The baseline maps every gated scenario to its metrics, each named by its
+// path in the report, with the value measured when the baseline was taken
+// and the fraction it may grow by before the gate fails:
+//
+//   {"enemies_1k_sustained_fire": {"tick_ms.p99": {"baseline": 0.37, "tolerance": 2.0}, ...}, ...}
+//
+// Every metric is a cost, so only growth is a regression. Timings, the
+// metrics with "_ms" in their path, depend on the machine and the build;
+// --skip-timings leaves them out, as the CTest gate does unless it is
+// configured with PERFGATE_TIMINGS.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "../common/mappedfile.hpp"
+
+struct JsonNumber {
+    std::string path;
+    double value;
+};
+
+// Just enough JSON for the reports and the baseline: every number is kept
+// under its path, object keys and array indices joined by dots, in document
+// order; strings are kept the same way
+class JsonReader {
+public:
+    JsonReader(const char* data, size_t size) : position_(data), end_(data + size) {}
+
+    bool Parse(std::vector<JsonNumber>& numbers, std::vector<std::pair<std::string, std::string>>& strings) {
+        numbers_ = &numbers;
+        strings_ = &strings;
+        if (!Value("")) {
+            return false;
+        }
+        SkipSpaces();
+        return position_ == end_;
+    }
+
+private:
+    void SkipSpaces() {
+        while (position_ < end_ && (*position_ == ' ' || *position_ == '\t' || *position_ == '\n' ||
+                                    *position_ == '\r')) {
+            ++position_;
+        }
+    }
+
+    bool Expect(char c) {
+        SkipSpaces();
+        if (position_ < end_ && *position_ == c) {
+            ++position_;
+            return true;
+        }
+        return false;
+    }
+
+    static std::string Join(const std::string& path, const std::string& key) {
+        return path.empty() ? key : path + "." + key;
+    }
+
+    // Escapes are kept as they are, nothing here needs them decoded
+    bool String(std::string& text) {
+        if (!Expect('"')) {
+            return false;
+        }
+        const char* start = position_;
+        while (position_ < end_ && *position_ != '"') {
+            position_ += *position_ == '\\' ? 2 : 1;
+        }
+        if (position_ >= end_) {
+            return false;
+        }
+        text.assign(start, position_);
+        ++position_;
+        return true;
+    }
+
+    bool Value(const std::string& path) {
+        SkipSpaces();
+        if (position_ >= end_) {
+            return false;
+        }
+        if (*position_ == '{') {
+            ++position_;
+            if (Expect('}')) {
+                return true;
+            }
+            do {
+                std::string key;
+                if (!String(key) || !Expect(':') || !Value(Join(path, key))) {
+                    return false;
+                }
+            } while (Expect(','));
+            return Expect('}');
+        }
+        if (*position_ == '[') {
+            ++position_;
+            if (Expect(']')) {
+                return true;
+            }
+            size_t index = 0;
+            do {
+                if (!Value(Join(path, std::to_string(index++)))) {
+                    return false;
+                }
+            } while (Expect(','));
+            return Expect(']');
+        }
+        if (*position_ == '"') {
+            std::string text;
+            if (!String(text)) {
+                return false;
+            }
+            strings_->push_back(std::make_pair(path, text));
+            return true;
+        }
+        for (const char* word : {"true", "false", "null"}) {
+            size_t length = strlen(word);
+            if (size_t(end_ - position_) >= length && memcmp(position_, word, length) == 0) {
+                position_ += length;
+                return true;
+            }
+        }
+
+        // strtod would run past the end of an unterminated buffer
+        std::string number;
+        while (position_ < end_ && strchr("+-.0123456789eE", *position_) != nullptr) {
+            number += *position_++;
+        }
+        char* parsed_end;
+        double value = strtod(number.c_str(), &parsed_end);
+        if (number.empty() || *parsed_end != '\0') {
+            return false;
+        }
+        numbers_->push_back({path, value});
+        return true;
+    }
+
+    const char* position_;
+    const char* end_;
+    std::vector<JsonNumber>* numbers_;
+    std::vector<std::pair<std::string, std::string>>* strings_;
+};
+
+bool ReadJson(const char* path, std::vector<JsonNumber>& numbers,
+              std::vector<std::pair<std::string, std::string>>& strings) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        return false;
+    }
+    JsonReader reader((const char*)file.Data(), file.Size());
+    if (!reader.Parse(numbers, strings)) {
+        fprintf(stderr, "%s is not valid JSON\n", path);
+        return false;
+    }
+    return true;
+}
+
+const JsonNumber* FindNumber(const std::vector<JsonNumber>& numbers, const std::string& path) {
+    for (const JsonNumber& number : numbers) {
+        if (number.path == path) {
+            return &number;
+        }
+    }
+    return nullptr;
+}
+
+struct GatedMetric {
+    std::string path;
+    double baseline;
+    double tolerance;
+};
+
+// The baseline's entries are "<scenario>.<metric path>.baseline" and
+// ".tolerance"; scenario names have no dots, metric paths do
+std::vector<GatedMetric> MetricsFor(const std::vector<JsonNumber>& baseline, const std::string& scenario) {
+    std::vector<GatedMetric> metrics;
+    std::string prefix = scenario + ".";
+    const std::string suffix = ".baseline";
+    for (const JsonNumber& entry : baseline) {
+        if (entry.path.compare(0, prefix.size(), prefix) != 0 || entry.path.size() <= prefix.size() + suffix.size() ||
+            entry.path.compare(entry.path.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        std::string path = entry.path.substr(prefix.size(), entry.path.size() - prefix.size() - suffix.size());
+        const JsonNumber* tolerance = FindNumber(baseline, prefix + path + ".tolerance");
+        metrics.push_back({path, entry.value, tolerance != nullptr ? tolerance->value : 0.0});
+    }
+    return metrics;
+}
+
+// Prints one line per metric; returns how many regressed or are missing
+int CheckReport(const char* report_path, const std::vector<JsonNumber>& baseline, bool skip_timings) {
+    std::vector<JsonNumber> report;
+    std::vector<std::pair<std::string, std::string>> strings;
+    if (!ReadJson(report_path, report, strings)) {
+        return -1;
+    }
+    std::string scenario;
+    for (const auto& string : strings) {
+        if (string.first == "scenario") {
+            scenario = string.second;
+        }
+    }
+    std::vector<GatedMetric> metrics = MetricsFor(baseline, scenario);
+    if (metrics.empty()) {
+        fprintf(stderr, "%s: no baseline for scenario \"%s\"\n", report_path, scenario.c_str());
+        return -1;
+    }
+
+    printf("%s (%s)\n", scenario.c_str(), report_path);
+    printf("  %-44s %14s %14s %9s %9s\n", "metric", "baseline", "current", "change", "limit");
+    int failures = 0;
+    int checked = 0;
+    for (const GatedMetric& metric : metrics) {
+        if (skip_timings && metric.path.find("_ms") != std::string::npos) {
+            continue;
+        }
+        ++checked;
+        const JsonNumber* current = FindNumber(report, metric.path);
+        if (current == nullptr) {
+            printf("  %-44s %14.10g %14s %9s %8.1f%%  MISSING\n", metric.path.c_str(), metric.baseline, "-", "-",
+                   metric.tolerance * 100.0);
+            ++failures;
+            continue;
+        }
+        double limit = metric.baseline * (1.0 + metric.tolerance);
+        bool regressed = current->value > limit;
+        printf("  %-44s %14.10g %14.10g", metric.path.c_str(), metric.baseline, current->value);
+        if (metric.baseline != 0.0) {
+            printf(" %+8.1f%%", (current->value / metric.baseline - 1.0) * 100.0);
+        } else {
+            printf(" %9s", "-");
+        }
+        printf(" %+8.1f%%%s\n", metric.tolerance * 100.0, regressed ? "  REGRESSED" : "");
+        if (regressed) {
+            ++failures;
+        }
+    }
+    printf("%d of %d metrics regressed\n", failures, checked);
+    return failures;
+}
+
+int main(int argc, char* argv[]) {
+    bool skip_timings = false;
+    int first = 1;
+    if (first < argc && strcmp(argv[first], "--skip-timings") == 0) {
+        skip_timings = true;
+        ++first;
+    }
+    if (argc - first < 2) {
+        fprintf(stderr, "usage: %s [--skip-timings] <baseline.json> <report.json>...\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<JsonNumber> baseline;
+    std::vector<std::pair<std::string, std::string>> strings;
+    if (!ReadJson(argv[first], baseline, strings)) {
+        return 2;
+    }
+
+    int exit_code = 0;
+    for (int i = first + 1; i < argc; ++i) {
+        int failures = CheckReport(argv[i], baseline, skip_timings);
+        if (failures < 0) {
+            return 2;
+        }
+        if (failures > 0) {
+            exit_code = 1;
+        }
+    }
+    return exit_code;
+}
@@ -0,0 +1,50 @@
+// Converts scene snapshots between the binary and the text format.
+//
+//   snapshotconv <input> <output> [binary|compressed|text]
+//
+// Without a format the output uses the opposite of the input: binary files
+// become text and text files become compressed binary.
+#include <stdio.h>
+#include <string.h>
+
+#include "../common/mappedfile.hpp"
+#include "../common/snapshot.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "usage: %s <input> <output> [binary|compressed|text]\n", argv[0]);
+        return 2;
+    }
+    const char* input = argv[1];
+    const char* output = argv[2];
+
+    bool input_is_text;
+    {
+        MappedFile file;
+        if (!file.Open(input)) {
+            return 1;
+        }
+        input_is_text = isTextSnapshot((const char*)file.Data(), file.Size());
+    }
+
+    SnapshotFormat format = input_is_text ? SNAPSHOT_COMPRESSED : SNAPSHOT_TEXT;
+    if (argc == 4) {
+        if (strcmp(argv[3], "binary") == 0) {
+            format = SNAPSHOT_BINARY;
+        } else if (strcmp(argv[3], "compressed") == 0) {
+            format = SNAPSHOT_COMPRESSED;
+        } else if (strcmp(argv[3], "text") == 0) {
+            format = SNAPSHOT_TEXT;
+        } else {
+            fprintf(stderr, "unknown format %s\n", argv[3]);
+            return 2;
+        }
+    }
+
+    SceneSnapshot snapshot;
+    if (!loadSnapshot(input, snapshot) || !saveSnapshot(output, snapshot, format)) {
+        return 1;
+    }
+    printf("Converted %zu objects from %s to %s\n", snapshot.entities.size(), input, output);
+    return 0;
+}